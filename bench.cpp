@@ -0,0 +1,201 @@
+#include "bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static const char* PASS_NAMES[BenchTimings::PASS_COUNT] = { "update", "shadow", "lit" };
+static const int PERCENTILES[] = { 50, 90, 95, 99 };
+
+bool BenchScript::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "[BENCH] cannot open script %s\n", path.c_str());
+        return false;
+    }
+    keys.clear();
+    actions.clear();
+    std::string line;
+    for (int n = 1; std::getline(in, line); ++n) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream s(line);
+        std::string cmd;
+        if (!(s >> cmd)) continue;
+        float t;
+        if (!(s >> t)) {
+            fprintf(stderr, "[BENCH] %s:%d: %s needs a time\n", path.c_str(), n, cmd.c_str());
+            return false;
+        }
+        if (cmd == "key") {
+            Key k;
+            k.time = t;
+            if (!(s >> k.pose.position.x >> k.pose.position.y >> k.pose.position.z >> k.pose.yaw >> k.pose.pitch)) {
+                fprintf(stderr, "[BENCH] %s:%d: key expects t x y z yaw pitch\n", path.c_str(), n);
+                return false;
+            }
+            keys.push_back(k);
+        }
+        else if (cmd == "pick" || cmd == "drink" || cmd == "drop") {
+            Action a;
+            a.time = t;
+            a.type = cmd == "pick" ? Action::Pick : cmd == "drink" ? Action::Drink : Action::Drop;
+            if (!(s >> a.drinkable)) a.drinkable = -1;
+            actions.push_back(a);
+        }
+        else {
+            fprintf(stderr, "[BENCH] %s:%d: unknown command %s\n", path.c_str(), n, cmd.c_str());
+            return false;
+        }
+    }
+    if (keys.empty()) {
+        fprintf(stderr, "[BENCH] %s has no camera keys\n", path.c_str());
+        return false;
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.time < b.time; });
+    return true;
+}
+
+BenchScript::Pose BenchScript::pose(float t) const {
+    if (t <= keys.front().time) return keys.front().pose;
+    if (t >= keys.back().time) return keys.back().pose;
+    size_t i = 0;
+    while (keys[i + 1].time < t) ++i;
+    // neighbours of the segment, the end keys stand in for missing ones
+    const Pose& p0 = keys[i > 0 ? i - 1 : i].pose;
+    const Pose& p1 = keys[i].pose;
+    const Pose& p2 = keys[i + 1].pose;
+    const Pose& p3 = keys[std::min(i + 2, keys.size() - 1)].pose;
+    float span = keys[i + 1].time - keys[i].time;
+    float u = span > 0.0f ? (t - keys[i].time) / span : 1.0f;
+    float u2 = u * u, u3 = u2 * u;
+    float w0 = 0.5f * (-u3 + 2.0f * u2 - u);
+    float w1 = 0.5f * (3.0f * u3 - 5.0f * u2 + 2.0f);
+    float w2 = 0.5f * (-3.0f * u3 + 4.0f * u2 + u);
+    float w3 = 0.5f * (u3 - u2);
+    Pose p;
+    p.position = p0.position * w0 + p1.position * w1 + p2.position * w2 + p3.position * w3;
+    p.yaw = p0.yaw * w0 + p1.yaw * w1 + p2.yaw * w2 + p3.yaw * w3;
+    p.pitch = glm::clamp(p0.pitch * w0 + p1.pitch * w1 + p2.pitch * w2 + p3.pitch * w3, -89.0f, 89.0f);
+    return p;
+}
+
+std::vector<BenchScript::Action> BenchScript::actionsBetween(float from, float to) const {
+    std::vector<Action> out;
+    for (const Action& a : actions)
+        if (a.time > from && a.time <= to) out.push_back(a);
+    return out;
+}
+
+BenchTimings::BenchTimings(int frames, int warmup)
+    : frames(frames), warmup(std::min(warmup, frames - 1)),
+    cpuMs(frames * PASS_COUNT, 0.0f), gpuMs(frames * PASS_COUNT, 0.0f) {
+    if (GLEW_VERSION_3_3 || GLEW_ARB_timer_query) {
+        queries.resize(frames * (PASS_COUNT + 1));
+        glGenQueries((GLsizei)queries.size(), queries.data());
+    }
+    else
+        printf("[BENCH] no timer queries, GPU times are not measured\n");
+}
+
+BenchTimings::~BenchTimings() {
+    if (!queries.empty()) glDeleteQueries((GLsizei)queries.size(), queries.data());
+}
+
+void BenchTimings::beginFrame() {
+    if (++frame >= frames) return;
+    passStart = Clock::now();
+    if (gpuTimers()) glQueryCounter(queries[frame * (PASS_COUNT + 1)], GL_TIMESTAMP);
+}
+
+void BenchTimings::endPass(Pass pass) {
+    if (frame < 0 || frame >= frames) return;
+    Clock::time_point now = Clock::now();
+    cpuMs[frame * PASS_COUNT + pass] = std::chrono::duration<float, std::milli>(now - passStart).count();
+    passStart = now;
+    if (gpuTimers()) glQueryCounter(queries[frame * (PASS_COUNT + 1) + pass + 1], GL_TIMESTAMP);
+}
+
+void BenchTimings::readGpuTimes() {
+    int measured = std::min(frame + 1, frames);
+    for (int f = 0; f < measured; ++f) {
+        GLuint64 stamps[PASS_COUNT + 1];
+        for (int q = 0; q <= PASS_COUNT; ++q)
+            glGetQueryObjectui64v(queries[f * (PASS_COUNT + 1) + q], GL_QUERY_RESULT, &stamps[q]);
+        for (int p = 0; p < PASS_COUNT; ++p)
+            gpuMs[f * PASS_COUNT + p] = (float)((stamps[p + 1] - stamps[p]) * 1e-6);
+    }
+}
+
+std::vector<std::vector<float>> BenchTimings::series(const std::vector<float>& perPass) const {
+    std::vector<std::vector<float>> rows(PASS_COUNT + 1);
+    int measured = std::min(frame + 1, frames);
+    for (int f = warmup; f < measured; ++f) {
+        float total = 0.0f;
+        for (int p = 0; p < PASS_COUNT; ++p) {
+            rows[p + 1].push_back(perPass[f * PASS_COUNT + p]);
+            total += perPass[f * PASS_COUNT + p];
+        }
+        rows[0].push_back(total);
+    }
+    for (auto& r : rows) std::sort(r.begin(), r.end());
+    return rows;
+}
+
+std::string BenchTimings::jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c >= 0x20) out += c;
+    }
+    return out + "\"";
+}
+
+static void writeStats(FILE* f, const char* name, const std::vector<std::vector<float>>& rows) {
+    fprintf(f, "  \"%s\": {\n", name);
+    for (size_t r = 0; r < rows.size(); ++r) {
+        const std::vector<float>& s = rows[r];
+        double sum = 0.0;
+        for (float v : s) sum += v;
+        fprintf(f, "    \"%s\": { \"mean\": %.4f", r ? PASS_NAMES[r - 1] : "frame", s.empty() ? 0.0 : sum / s.size());
+        for (int p : PERCENTILES)
+            fprintf(f, ", \"p%d\": %.4f", p, s.empty() ? 0.0f : s[std::min(s.size() - 1, s.size() * p / 100)]);
+        fprintf(f, ", \"max\": %.4f }%s\n", s.empty() ? 0.0f : s.back(), r + 1 < rows.size() ? "," : "");
+    }
+    fprintf(f, "  }");
+}
+
+bool BenchTimings::write(const std::string& path, const std::vector<std::pair<std::string, std::string>>& info) {
+    if (gpuTimers()) readGpuTimes();
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "[BENCH] cannot write %s\n", path.c_str());
+        return false;
+    }
+    fprintf(f, "{\n");
+    for (const auto& kv : info) fprintf(f, "  \"%s\": %s,\n", kv.first.c_str(), kv.second.c_str());
+    fprintf(f, "  \"frames\": %d,\n  \"warmup_frames\": %d,\n", std::min(frame + 1, frames), warmup);
+    writeStats(f, "cpu_ms", series(cpuMs));
+    if (gpuTimers()) {
+        fprintf(f, ",\n");
+        writeStats(f, "gpu_ms", series(gpuMs));
+    }
+    fprintf(f, "\n}\n");
+    fclose(f);
+    printf("[BENCH] wrote %s\n", path.c_str());
+    return true;
+}
+
+void BenchTimings::printSummary() const {
+    const std::vector<float>* sources[2] = { &cpuMs, &gpuMs };
+    for (int g = 0; g < (gpuTimers() ? 2 : 1); ++g) {
+        std::vector<std::vector<float>> rows = series(*sources[g]);
+        for (size_t r = 0; r < rows.size(); ++r) {
+            const std::vector<float>& s = rows[r];
+            if (s.empty()) continue;
+            printf("[BENCH] %s %-6s p50 %7.3f ms  p95 %7.3f ms  p99 %7.3f ms  max %7.3f ms\n",
+                g ? "gpu" : "cpu", r ? PASS_NAMES[r - 1] : "frame", s[s.size() / 2],
+                s[std::min(s.size() - 1, s.size() * 95 / 100)],
+                s[std::min(s.size() - 1, s.size() * 99 / 100)], s.back());
+        }
+    }
+}
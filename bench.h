@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Camera path and actions of a --bench run, read from a text script with
+// one command per line ('#' starts a comment, times in seconds):
+//
+//   key   t  x y z  yaw pitch   camera keyframe
+//   pick  t [drinkable]         pick up the drinkable in focus, or the given one
+//   drink t                     drink the held drinkable
+//   drop  t                     put the held drinkable back
+//
+// Keyframes are sorted by time and joined by a Catmull-Rom spline, so the
+// camera moves without kinks through every key; before the first and after
+// the last key it holds still.
+class BenchScript {
+public:
+    struct Pose {
+        glm::vec3 position;
+        float yaw, pitch;
+    };
+    struct Action {
+        enum Type { Pick, Drink, Drop };
+        float time;
+        Type type;
+        int drinkable; // Pick only, -1: whatever is in focus
+    };
+
+    bool load(const std::string& path);
+
+    Pose pose(float t) const;
+    // actions with from < time <= to, in script order
+    std::vector<Action> actionsBetween(float from, float to) const;
+    float duration() const { return keys.empty() ? 0.0f : keys.back().time; }
+
+private:
+    struct Key {
+        float time;
+        Pose pose;
+    };
+    std::vector<Key> keys;
+    std::vector<Action> actions;
+};
+
+// CPU and GPU time of every frame of a benchmark, split into the passes of
+// the main loop. GPU times come from GL_TIMESTAMP queries at the pass
+// boundaries; the queries of all frames are kept and only read back in
+// write(), so measuring never waits on the GPU.
+class BenchTimings {
+public:
+    enum Pass { Update, Shadow, Lit, PASS_COUNT };
+
+    // warmup: leading frames left out of the statistics
+    BenchTimings(int frames, int warmup);
+    ~BenchTimings();
+
+    void beginFrame();
+    // the pass ends here and the next one starts
+    void endPass(Pass pass);
+
+    // mean and percentiles of every pass and the whole frame as JSON;
+    // info is written as extra "key": value members
+    bool write(const std::string& path, const std::vector<std::pair<std::string, std::string>>& info);
+    // percentile table on stdout, GPU rows once write() has read them back
+    void printSummary() const;
+    // s as a quoted JSON string, for info values
+    static std::string jsonString(const std::string& s);
+
+    bool gpuTimers() const { return !queries.empty(); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    int frames, warmup;
+    int frame = -1;
+    Clock::time_point passStart;
+
+    // [frame][pass], milliseconds
+    std::vector<float> cpuMs, gpuMs;
+    // [frame][0]: frame start, [frame][pass + 1]: end of pass
+    std::vector<GLuint> queries;
+
+    void readGpuTimes();
+    // rows of one statistic table: "frame" first, then every pass
+    std::vector<std::vector<float>> series(const std::vector<float>& perPass) const;
+};
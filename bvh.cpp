@@ -0,0 +1,221 @@
+#include "bvh.h"
+#include "simd4.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// ------------------------------------------------------------- build
+
+namespace {
+struct Box {
+    glm::vec3 lo = glm::vec3(FLT_MAX), hi = glm::vec3(-FLT_MAX);
+    void grow(const glm::vec3& p) { lo = glm::min(lo, p); hi = glm::max(hi, p); }
+    void grow(const Box& b) { lo = glm::min(lo, b.lo); hi = glm::max(hi, b.hi); }
+    float area() const {
+        if (lo.x > hi.x) return 0.0f;
+        glm::vec3 e = hi - lo;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+};
+const int BINS = 12;
+}
+
+void TriangleBvh::build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+    int count = (int)(indices.size() / 3);
+    std::vector<Box> boxes(count);
+    std::vector<glm::vec3> centroids(count);
+    std::vector<int> ids(count);
+    for (int t = 0; t < count; ++t) {
+        for (int k = 0; k < 3; ++k) boxes[t].grow(positions[indices[t * 3 + k]]);
+        centroids[t] = (boxes[t].lo + boxes[t].hi) * 0.5f;
+        ids[t] = t;
+    }
+
+    nodes.clear();
+    nodes.reserve(std::max(2 * count, 1));
+    nodes.push_back(Node());
+    struct Task { int node, begin, end, depth; };
+    std::vector<Task> tasks = { { 0, 0, count, 0 } };
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+        Box bounds, centers;
+        for (int i = task.begin; i < task.end; ++i) {
+            bounds.grow(boxes[ids[i]]);
+            centers.grow(centroids[ids[i]]);
+        }
+        Node& node = nodes[task.node];
+        node.lo = bounds.lo;
+        node.hi = bounds.hi;
+        int n = task.end - task.begin;
+
+        // binned SAH over all three axes
+        int bestAxis = -1, bestBin = 0;
+        float bestCost = n * bounds.area();
+        if (n > LEAF_SIZE && task.depth < MAX_DEPTH) {
+            for (int axis = 0; axis < 3; ++axis) {
+                float lo = centers.lo[axis], extent = centers.hi[axis] - lo;
+                if (extent <= 0.0f) continue;
+                Box binBox[BINS];
+                int binCount[BINS] = {};
+                for (int i = task.begin; i < task.end; ++i) {
+                    int b = std::min((int)((centroids[ids[i]][axis] - lo) / extent * BINS), BINS - 1);
+                    binBox[b].grow(boxes[ids[i]]);
+                    binCount[b]++;
+                }
+                // right-hand sweep first, then test every split from the left
+                float rightArea[BINS];
+                int rightCount[BINS];
+                Box acc;
+                int accCount = 0;
+                for (int b = BINS - 1; b > 0; --b) {
+                    acc.grow(binBox[b]);
+                    accCount += binCount[b];
+                    rightArea[b] = acc.area();
+                    rightCount[b] = accCount;
+                }
+                acc = Box();
+                accCount = 0;
+                for (int b = 1; b < BINS; ++b) {
+                    acc.grow(binBox[b - 1]);
+                    accCount += binCount[b - 1];
+                    if (accCount == 0 || rightCount[b] == 0) continue;
+                    float cost = accCount * acc.area() + rightCount[b] * rightArea[b];
+                    if (cost < bestCost) { bestCost = cost; bestAxis = axis; bestBin = b; }
+                }
+            }
+        }
+
+        int mid = -1;
+        if (bestAxis >= 0) {
+            float lo = centers.lo[bestAxis], extent = centers.hi[bestAxis] - lo;
+            mid = (int)(std::partition(ids.begin() + task.begin, ids.begin() + task.end, [&](int t) {
+                return std::min((int)((centroids[t][bestAxis] - lo) / extent * BINS), BINS - 1) < bestBin;
+            }) - ids.begin());
+        }
+        else if (n > 4 * LEAF_SIZE && task.depth < MAX_DEPTH) {
+            // no split pays off but the leaf would be slow: halve by count
+            bestAxis = 0;
+            glm::vec3 e = centers.hi - centers.lo;
+            if (e.y > e[bestAxis]) bestAxis = 1;
+            if (e.z > e[bestAxis]) bestAxis = 2;
+            mid = task.begin + n / 2;
+            std::nth_element(ids.begin() + task.begin, ids.begin() + mid, ids.begin() + task.end,
+                [&](int a, int b) { return centroids[a][bestAxis] < centroids[b][bestAxis]; });
+        }
+
+        if (mid <= task.begin || mid >= task.end) {
+            node.first = task.begin;
+            node.count = n;
+            node.axis = 0;
+            continue;
+        }
+        int left = (int)nodes.size();
+        node.first = left;
+        node.count = 0;
+        node.axis = bestAxis;
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        tasks.push_back({ left, task.begin, mid, task.depth + 1 });
+        tasks.push_back({ left + 1, mid, task.end, task.depth + 1 });
+    }
+
+    triangles.resize(count);
+    triangleIds = ids;
+    for (int i = 0; i < count; ++i) {
+        int t = ids[i];
+        glm::vec3 a = positions[indices[t * 3]], b = positions[indices[t * 3 + 1]], c = positions[indices[t * 3 + 2]];
+        triangles[i] = { a, b - a, c - a };
+    }
+}
+
+// ------------------------------------------------------------- traversal
+
+template <bool AnyHit>
+int TriangleBvh::trace(RayPacket& r) const {
+    if (nodes.empty() || triangles.empty()) return 0;
+    F4 ox = F4::load(r.ox), oy = F4::load(r.oy), oz = F4::load(r.oz);
+    F4 dx = F4::load(r.dx), dy = F4::load(r.dy), dz = F4::load(r.dz);
+    F4 tMax = F4::load(r.tMax);
+    // axis-parallel rays: a huge reciprocal instead of inf keeps 0 * inf out of the slabs
+    float inv[3][4];
+    for (int k = 0; k < 4; ++k) {
+        const float d[3] = { r.dx[k], r.dy[k], r.dz[k] };
+        for (int a = 0; a < 3; ++a)
+            inv[a][k] = 1.0f / (std::fabs(d[a]) > 1e-12f ? d[a] : std::copysign(1e-12f, d[a]));
+    }
+    F4 ix = F4::load(inv[0]), iy = F4::load(inv[1]), iz = F4::load(inv[2]);
+    int active = bits(F4(0.0f) < tMax);
+    int hitBits = 0;
+    if (!AnyHit)
+        for (int k = 0; k < 4; ++k) r.triangle[k] = -1;
+
+    int stack[2 * MAX_DEPTH + 2];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0 && active) {
+        const Node& n = nodes[stack[--sp]];
+        F4 tx0 = (F4(n.lo.x) - ox) * ix, tx1 = (F4(n.hi.x) - ox) * ix;
+        F4 ty0 = (F4(n.lo.y) - oy) * iy, ty1 = (F4(n.hi.y) - oy) * iy;
+        F4 tz0 = (F4(n.lo.z) - oz) * iz, tz1 = (F4(n.hi.z) - oz) * iz;
+        F4 tNear = max4(max4(min4(tx0, tx1), min4(ty0, ty1)), max4(min4(tz0, tz1), F4(0.0f)));
+        F4 tFar = min4(min4(max4(tx0, tx1), max4(ty0, ty1)), min4(max4(tz0, tz1), tMax));
+        if (!(bits(tNear <= tFar) & active)) continue;
+
+        if (n.count == 0) {
+            // near child last on the stack, judged by the first live lane
+            int lane = 0;
+            while (!(active >> lane & 1)) lane++;
+            float d = n.axis == 0 ? r.dx[lane] : n.axis == 1 ? r.dy[lane] : r.dz[lane];
+            stack[sp++] = d < 0.0f ? n.first : n.first + 1;
+            stack[sp++] = d < 0.0f ? n.first + 1 : n.first;
+            continue;
+        }
+
+        // Moller-Trumbore, one triangle against all lanes
+        for (int i = n.first; i < n.first + n.count; ++i) {
+            const Triangle& tri = triangles[i];
+            F4 e1x(tri.e1.x), e1y(tri.e1.y), e1z(tri.e1.z);
+            F4 e2x(tri.e2.x), e2y(tri.e2.y), e2z(tri.e2.z);
+            F4 px = dy * e2z - dz * e2y, py = dz * e2x - dx * e2z, pz = dx * e2y - dy * e2x;
+            F4 det = e1x * px + e1y * py + e1z * pz;
+            F4 invDet = F4(1.0f) / det;
+            F4 sx = ox - F4(tri.v0.x), sy = oy - F4(tri.v0.y), sz = oz - F4(tri.v0.z);
+            F4 u = (sx * px + sy * py + sz * pz) * invDet;
+            F4 qx = sy * e1z - sz * e1y, qy = sz * e1x - sx * e1z, qz = sx * e1y - sy * e1x;
+            F4 v = (dx * qx + dy * qy + dz * qz) * invDet;
+            F4 t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+            F4 hit = (F4(1e-12f) < abs4(det)) & (F4(0.0f) <= u) & (F4(0.0f) <= v) & (u + v <= F4(1.0f))
+                & (F4(0.0f) < t) & (t < tMax);
+            int m = bits(hit) & active;
+            if (!m) continue;
+            if (AnyHit) {
+                hitBits |= m;
+                active &= ~m;
+                if (!active) break;
+                continue;
+            }
+            tMax = select(hit, t, tMax);
+            float us[4], vs[4];
+            u.store(us);
+            v.store(vs);
+            for (int k = 0; k < 4; ++k)
+                if (m >> k & 1) {
+                    r.triangle[k] = triangleIds[i];
+                    r.u[k] = us[k];
+                    r.v[k] = vs[k];
+                }
+        }
+    }
+    if (!AnyHit) tMax.store(r.tMax);
+    return hitBits;
+}
+
+void TriangleBvh::intersect(RayPacket& rays) const {
+    trace<false>(rays);
+}
+
+int TriangleBvh::occluded(const RayPacket& rays) const {
+    RayPacket copy = rays;
+    return trace<true>(copy);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Four rays traced together. Lanes are independent; a lane with tMax <= 0
+// is inactive. After intersect(), triangle is -1 for lanes that hit nothing
+// and tMax is the distance of the nearest hit.
+struct RayPacket {
+    float ox[4], oy[4], oz[4];
+    float dx[4], dy[4], dz[4];
+    float tMax[4];
+    int triangle[4];
+    float u[4], v[4]; // barycentrics of the hit, p = v0 + u * e1 + v * e2
+};
+
+// Bounding volume hierarchy over a static triangle soup, built once with
+// binned SAH. Rays are traced in packets of four with SSE: a node is
+// entered when any lane hits its box, each triangle is tested against all
+// four lanes at once. Without SSE the same code runs on plain floats.
+class TriangleBvh {
+public:
+    void build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+    // nearest hit per lane
+    void intersect(RayPacket& rays) const;
+    // per lane: something between the origin and tMax; bit k is lane k
+    int occluded(const RayPacket& rays) const;
+
+    int triangleCount() const { return (int)triangles.size(); }
+    int nodeCount() const { return (int)nodes.size(); }
+
+private:
+    struct Node {
+        glm::vec3 lo;
+        int first;  // leaf: first triangle, inner: left child (right is first + 1)
+        glm::vec3 hi;
+        int count;  // leaf: triangle count, inner: 0
+        int axis;   // inner: split axis, picks the near child
+    };
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+    };
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles; // in leaf order
+    std::vector<int> triangleIds;    // original index of each
+
+    static const int LEAF_SIZE = 4;
+    static const int MAX_DEPTH = 64;
+
+    template <bool AnyHit>
+    int trace(RayPacket& rays) const;
+};
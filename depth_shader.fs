@@ -3,6 +3,10 @@
 in vec4 FragPos;
 uniform vec3  lightPos;
 uniform float far_plane;
+uniform bool  staticCaster;  // the lightmapped room, see ShadowAtlas
+
+// caster mask of the atlas, ignored when it has none
+layout(location = 0) out float movingCaster;
 
 void main() {
     
@@ -11,4 +15,5 @@ void main() {
     lightDistance /= far_plane;
    
     gl_FragDepth = lightDistance;
+    movingCaster = staticCaster ? 0.0 : 1.0;
 }
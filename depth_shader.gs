@@ -1,4 +1,5 @@
 #version 330 core
+#extension GL_ARB_viewport_array : require
 
 layout(triangles) in;
 layout(triangle_strip, max_vertices = 18) out;
@@ -10,7 +11,7 @@ out vec4 FragPos;
 void main() {
  
     for (int face = 0; face < 6; ++face) {
-        gl_Layer = face;   
+        gl_ViewportIndex = face;   // face tile inside the shadow atlas
 
    
         for (int i = 0; i < 3; ++i) {
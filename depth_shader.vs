@@ -1,9 +1,19 @@
 #version 330 core
 
 layout(location = 0) in vec3 aPos;
-uniform mat4 model;
+layout(location = 4) in uint instanceTransform;
+uniform mat4 M;
+uniform vec3 posOffset;   // dequantization of packed positions
+uniform vec3 posScale;
+uniform bool gpuDriven;   // M from instanceTransforms, as in v_textures.glsl
+uniform samplerBuffer instanceTransforms;
 
 void main() {
-   
-    gl_Position = model * vec4(aPos, 1.0);
+    mat4 model = M;
+    if (gpuDriven) {
+        int t = int(instanceTransform) * 7;
+        model = mat4(texelFetch(instanceTransforms, t), texelFetch(instanceTransforms, t + 1),
+                     texelFetch(instanceTransforms, t + 2), texelFetch(instanceTransforms, t + 3));
+    }
+    gl_Position = model * vec4(posOffset + aPos * posScale, 1.0);
 }
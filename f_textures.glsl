@@ -1,92 +1,119 @@
 #version 330 core
 
+#include "lighting.glsl"
+
 in vec3  fragPos;
 in vec3  fragNormal;
 in vec2  fragTexCoord;
+flat in float fragTexLayer;
+in vec2  fragLightmapCoord;
 
 out vec4 outColor;
 
 uniform sampler2D  texture0;
+uniform sampler2DArray textureArray;   // static batch materials
+uniform bool       useTextureArray;
 uniform bool       isEmissive;
-uniform vec3       cameraPos;
-
-uniform vec3       lightPos[2];
-uniform vec3       lightColor[2];
-uniform samplerCube depthMap[2];
-uniform float      far_plane;
-
-const int SAMPLES = 20;
-const vec3 sampleOffsetDirections[SAMPLES] = vec3[](
-    vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1),
-    vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
-    vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
-    vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
-    vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
-);
-
-float ShadowCalculation(int idx, vec3 fragPos, vec3 lightPos)
+
+// baked diffuse lighting (lightmap.h); only the static batch has lightmap
+// coordinates, and it is the only texture array draw. Its shadows are in
+// the bake already: the caster mask of the atlas says where the nearest
+// caster moves, only those shadows still darken it
+uniform bool       useLightmap;
+uniform sampler2D  lightmap;
+uniform sampler2D  casterMask;
+
+// screen-space shadow mask (shadow_mask.fs), replaces the atlas filter
+uniform bool       useShadowMask;
+uniform sampler2D  shadowMask;       // shadow of slot 0..3
+uniform sampler2D  shadowMaskDepth;  // view depth of each mask texel
+uniform int        shadowMaskScale;  // scene pixels per mask texel
+
+// 1 where the atlas texel toward fragPos was written by a moving caster
+float movingCasterAt(int light, vec3 dir)
+{
+    vec3 f    = cubeFaceUV(dir);
+    vec4 rect = shadowRects[light * 6 + int(f.z)];
+    vec2 halfTexel = 0.5 / (rect.zw * vec2(textureSize(casterMask, 0)));
+    vec2 uv   = clamp(f.xy, halfTexel, 1.0 - halfTexel);
+    return texture(casterMask, rect.xy + uv * rect.zw).r;
+}
+
+// Mask value at this pixel. A reduced mask is upsampled bilinearly with
+// each texel weighted down by its depth difference, so shadows do not
+// bleed across silhouettes.
+vec4 shadowMaskAt(float viewDepth)
 {
-    vec3 fragToLight = fragPos - lightPos;
-    float currentDepth = length(fragToLight);
-
-    // scale filter radius by view distance
-    float viewDist   = length(cameraPos - fragPos);
-    float diskRadius = (1.0 + viewDist / far_plane) / 25.0;
-
-    float shadow = 0.0;
-    float bias   = 0.05;
-
-    for(int i = 0; i < SAMPLES; ++i) {
-        vec3 sampleDir    = fragToLight + sampleOffsetDirections[i] * diskRadius;
-        float closestDepth = texture(depthMap[idx], sampleDir).r;
-        closestDepth      *= far_plane;   // undo [0,1] mapping
-        if(currentDepth - bias > closestDepth)
-            shadow += 1.0;
+    if(shadowMaskScale <= 1)
+        return texelFetch(shadowMask, ivec2(gl_FragCoord.xy), 0);
+
+    ivec2 size = textureSize(shadowMask, 0);
+    // mask texel i holds scene pixel i * scale, whose center is at
+    // i * scale + 0.5 in window coordinates
+    vec2 p     = (gl_FragCoord.xy - 0.5) / float(shadowMaskScale);
+    ivec2 base = ivec2(floor(p));
+    vec2 f     = p - vec2(base);
+    vec4 sum   = vec4(0.0);
+    float total = 0.0;
+    for(int i = 0; i < 4; ++i) {
+        ivec2 o = ivec2(i & 1, i >> 1);
+        ivec2 q = clamp(base + o, ivec2(0), size - 1);
+        vec2  b = mix(1.0 - f, f, vec2(o));
+        float d = texelFetch(shadowMaskDepth, q, 0).r;
+        float w = b.x * b.y / (1e-3 + abs(d - viewDepth) / viewDepth);
+        sum   += w * texelFetch(shadowMask, q, 0);
+        total += w;
     }
-    return shadow / float(SAMPLES);
+    return sum / max(total, 1e-6);
 }
 
 void main() {
-    vec4 texColor = texture(texture0, fragTexCoord);
+    vec4 texColor = useTextureArray ? texture(textureArray, vec3(fragTexCoord, fragTexLayer))
+                                    : texture(texture0, fragTexCoord);
     if(isEmissive) {
         outColor = texColor * vec4(1.5, 1.5, 1.3, 1.0);
         return;
     }
+    bool baked = useLightmap && useTextureArray;
 
     vec3 norm    = normalize(fragNormal);
     vec3 viewDir = normalize(cameraPos - fragPos);
 
-    float shininess        = 64.0;
-    float ambientStrength  = 0.15;
-    float specularStrength = 0.3;
-
     vec3 result = vec3(0.0);
+    // baked: what moving casters take away from the bake, and the ambient
+    // part of it no shadow can take
+    vec3 blocked = vec3(0.0), ambientFloor = vec3(0.0);
+    vec4 maskShadow = useShadowMask ? shadowMaskAt(-(V * vec4(fragPos, 1.0)).z) : vec4(0.0);
+
+    uvec2 range = texelFetch(clusterData, clusterIndex(fragPos)).xy;
+    for(uint k = 0u; k < range.y; ++k) {
+        int i = int(texelFetch(lightIndices, int(range.x + k)).x);
+        vec4 posRadius = texelFetch(lightData, 2 * i);
+        vec4 colorSlot = texelFetch(lightData, 2 * i + 1);
+        int slot = int(colorSlot.a);
+        // the bake has every light; only shadowed ones can lose some of it
+        if(baked && slot < 0) continue;
+        vec3 LP = posRadius.xyz;
+        LightTerms t = blinnPhong(LP, colorSlot.rgb, posRadius.w, fragPos, norm, viewDir);
+
+        float shadow = slot < 0 ? 0.0
+                     : useShadowMask ? maskShadow[slot] : ShadowCalculation(slot, fragPos, LP);
+        // the bake has no specular, shadowed lights give baked texels none
+        if(baked) {
+            blocked      += shadow * movingCasterAt(slot, fragPos - LP) * t.diffuse;
+            ambientFloor += t.ambient;
+        }
+        else
+            result += t.ambient + (1.0 - shadow) * (t.diffuse + t.specular);
+    }
 
-    for(int i = 0; i < 2; ++i) {
-        vec3 LP = lightPos[i];
-        vec3 LC = lightColor[i];
-
-        // Blinn-Phong
-        vec3 L   = normalize(LP - fragPos);
-        float diff = max(dot(norm, L), 0.0);
-        vec3 H     = normalize(L + viewDir);
-        float spec = pow(max(dot(norm, H), 0.0), shininess);
-
-        float dist = length(LP - fragPos);
-        float atten = 1.25 / (1.0 + 0.35 * dist + 0.25 * dist * dist);
-
-        vec3 ambient  = ambientStrength * LC;
-        vec3 diffuse  = diff * LC;
-        vec3 specular = specularStrength * spec * LC;
-
-        ambient  *= atten;
-        diffuse  *= atten;
-        specular *= atten;
-
-        float shadow = ShadowCalculation(i, fragPos, LP);
-        result += ambient + (1.0 - shadow) * (diffuse + specular);
+    // a texel also in static shadow never had the blocked light: never
+    // darken it below the ambient of the lights, or past black
+    if(baked) {
+        vec3 bakedLight = texture(lightmap, fragLightmapCoord).rgb;
+        result = max(bakedLight - blocked, min(bakedLight, ambientFloor));
     }
 
-    outColor = vec4(result, 1.0) * texColor;
+    outColor = vec4(max(result, 0.0), 1.0) * texColor;
 
 }
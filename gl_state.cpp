@@ -0,0 +1,152 @@
+#include "gl_state.h"
+#include <cstdio>
+
+GLStateCache glState;
+
+static const GLuint UNKNOWN = (GLuint)-1;
+
+void GLStateCache::invalidate() {
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    activeUnit = -1;
+    for (auto& unit : textures)
+        for (auto& t : unit) t = UNKNOWN;
+    drawFramebuffer = readFramebuffer = UNKNOWN;
+    for (auto& v : viewports) v = glm::vec4(-1.0f);
+    enabled.clear();
+    depthFn = GL_NONE;
+    depthWrite = colorWrite = -1;
+}
+
+bool GLStateCache::useProgram(GLuint p) {
+    if (!count(Program, p != program)) return false;
+    glUseProgram(p);
+    program = p;
+    return true;
+}
+
+bool GLStateCache::bindVertexArray(GLuint vao) {
+    if (!count(VertexArray, vao != vertexArray)) return false;
+    glBindVertexArray(vao);
+    vertexArray = vao;
+    return true;
+}
+
+bool GLStateCache::setActiveUnit(int unit) {
+    if (!count(ActiveTexture, unit != activeUnit)) return false;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    activeUnit = unit;
+    return true;
+}
+
+bool GLStateCache::bindTexture(int unit, GLenum target, GLuint texture) {
+    int slot = target == GL_TEXTURE_2D ? Target2D
+        : target == GL_TEXTURE_2D_ARRAY ? Target2DArray
+        : target == GL_TEXTURE_CUBE_MAP ? TargetCube : -1;
+    if (slot >= 0 && unit < MAX_UNITS && textures[unit][slot] == texture) {
+        count(Texture, false);
+        return false;
+    }
+    setActiveUnit(unit);
+    glBindTexture(target, texture);
+    if (slot >= 0 && unit < MAX_UNITS) textures[unit][slot] = texture;
+    return count(Texture, true);
+}
+
+bool GLStateCache::bindFramebuffer(GLenum target, GLuint fbo) {
+    bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+    bool changed = (draw && drawFramebuffer != fbo) || (read && readFramebuffer != fbo);
+    if (!count(Framebuffer, changed)) return false;
+    glBindFramebuffer(target, fbo);
+    if (draw) drawFramebuffer = fbo;
+    if (read) readFramebuffer = fbo;
+    return true;
+}
+
+bool GLStateCache::viewport(int x, int y, int width, int height) {
+    // glViewport sets every indexed viewport at once
+    glm::vec4 v((float)x, (float)y, (float)width, (float)height);
+    bool changed = false;
+    for (const auto& cur : viewports) changed |= cur != v;
+    if (!count(Viewport, changed)) return false;
+    glViewport(x, y, width, height);
+    for (auto& cur : viewports) cur = v;
+    return true;
+}
+
+bool GLStateCache::viewportIndexed(int index, float x, float y, float width, float height) {
+    glm::vec4 v(x, y, width, height);
+    if (!count(Viewport, index >= MAX_VIEWPORTS || viewports[index] != v)) return false;
+    glViewportIndexedf(index, x, y, width, height);
+    if (index < MAX_VIEWPORTS) viewports[index] = v;
+    return true;
+}
+
+bool GLStateCache::setCap(GLenum cap, bool on) {
+    auto it = enabled.find(cap);
+    if (!count(Enable, it == enabled.end() || it->second != on)) return false;
+    if (on) glEnable(cap);
+    else glDisable(cap);
+    enabled[cap] = on;
+    return true;
+}
+
+bool GLStateCache::enable(GLenum cap) { return setCap(cap, true); }
+bool GLStateCache::disable(GLenum cap) { return setCap(cap, false); }
+
+bool GLStateCache::depthFunc(GLenum func) {
+    if (!count(DepthColor, func != depthFn)) return false;
+    glDepthFunc(func);
+    depthFn = func;
+    return true;
+}
+
+bool GLStateCache::depthMask(bool write) {
+    if (!count(DepthColor, (int)write != depthWrite)) return false;
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    depthWrite = write;
+    return true;
+}
+
+bool GLStateCache::colorMask(bool write) {
+    if (!count(DepthColor, (int)write != colorWrite)) return false;
+    GLboolean w = write ? GL_TRUE : GL_FALSE;
+    glColorMask(w, w, w, w);
+    colorWrite = write;
+    return true;
+}
+
+GLStateCache::Counters GLStateCache::counters() const {
+    Counters c = { draws, triangles, 0 };
+    for (int k = 0; k < KindCount; ++k) c.stateChanges += totalIssued[k] + frameIssued[k];
+    return c;
+}
+
+void GLStateCache::endFrame() {
+    for (int k = 0; k < KindCount; ++k) {
+        lastIssued[k] = frameIssued[k];
+        lastFiltered[k] = frameFiltered[k];
+        totalIssued[k] += frameIssued[k];
+        totalFiltered[k] += frameFiltered[k];
+        frameIssued[k] = frameFiltered[k] = 0;
+    }
+    frames++;
+}
+
+void GLStateCache::printStats() const {
+    static const char* names[KindCount] = {
+        "program", "vertex array", "texture", "active texture", "framebuffer", "viewport", "enable",
+        "depth / color"
+    };
+    long long issued = 0, filtered = 0;
+    printf("[GLSTATE] %d frames, calls issued / filtered (last frame | per frame average)\n", frames);
+    for (int k = 0; k < KindCount; ++k) {
+        double n = frames > 0 ? (double)frames : 1.0;
+        printf("  %-15s %5d / %5d | %8.1f / %8.1f\n", names[k], lastIssued[k], lastFiltered[k],
+            totalIssued[k] / n, totalFiltered[k] / n);
+        issued += totalIssued[k];
+        filtered += totalFiltered[k];
+    }
+    if (issued + filtered > 0)
+        printf("  %.0f%% of state calls filtered\n", 100.0 * filtered / (issued + filtered));
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <unordered_map>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Shadow copy of the GL binding state that drops calls which would not
+// change anything. Every bind, at creation time as well as during a frame,
+// goes through here, so the cache always matches the context. Deleting an
+// object GL unbinds it, but the cache still holds its name and a new
+// object may get the same name; code that deletes names which may still be
+// cached as bound calls invalidate() afterwards (see ShadowMask::release).
+class GLStateCache {
+public:
+    enum Kind { Program, VertexArray, Texture, ActiveTexture, Framebuffer, Viewport, Enable, DepthColor, KindCount };
+
+    static const int MAX_UNITS = 16;
+    static const int MAX_VIEWPORTS = 16;
+
+    GLStateCache() { invalidate(); }
+
+    // forget everything, the next call of every kind is issued
+    void invalidate();
+
+    // each returns true if the GL call was actually made
+    bool useProgram(GLuint program);
+    bool bindVertexArray(GLuint vao);
+    bool bindTexture(int unit, GLenum target, GLuint texture);
+    // a filtered bindTexture leaves the active unit alone; call this before
+    // glTexParameter and friends on the texture of a unit
+    bool activeTexture(int unit) { return setActiveUnit(unit); }
+    bool bindFramebuffer(GLenum target, GLuint framebuffer);
+    bool viewport(int x, int y, int width, int height);
+    bool viewportIndexed(int index, float x, float y, float width, float height);
+    bool enable(GLenum cap);
+    bool disable(GLenum cap);
+    bool depthFunc(GLenum func);
+    bool depthMask(bool write);
+    bool colorMask(bool write);
+
+    // every draw call reports here; GPU-driven draws count no triangles,
+    // only the GPU knows how many it kept
+    void countDraw(long long triangles) { draws++; this->triangles += triangles; }
+    // running totals since startup, differences give per-pass counts
+    struct Counters {
+        long long draws, triangles, stateChanges; // state calls issued
+    };
+    Counters counters() const;
+
+    // call once per frame: folds the frame's counts into the totals
+    void endFrame();
+    // issued / filtered per kind for the last frame and averaged overall
+    void printStats() const;
+
+private:
+    // texture targets tracked per unit, anything else is always issued
+    enum { Target2D, Target2DArray, TargetCube, TargetCount };
+
+    GLuint program;
+    GLuint vertexArray;
+    int activeUnit;
+    GLuint textures[MAX_UNITS][TargetCount];
+    GLuint drawFramebuffer, readFramebuffer;
+    glm::vec4 viewports[MAX_VIEWPORTS];
+    std::unordered_map<GLenum, bool> enabled;
+    GLenum depthFn;
+    int depthWrite, colorWrite; // -1 unknown
+
+    int frameIssued[KindCount] = {}, frameFiltered[KindCount] = {};
+    int lastIssued[KindCount] = {}, lastFiltered[KindCount] = {};
+    long long totalIssued[KindCount] = {}, totalFiltered[KindCount] = {};
+    int frames = 0;
+    long long draws = 0, triangles = 0;
+
+    bool count(Kind kind, bool changed) {
+        (changed ? frameIssued : frameFiltered)[kind]++;
+        return changed;
+    }
+    bool setActiveUnit(int unit);
+    bool setCap(GLenum cap, bool on);
+};
+
+// the one context this program renders with
+extern GLStateCache glState;
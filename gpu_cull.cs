@@ -0,0 +1,115 @@
+#version 430 core
+
+// Frustum culling and LOD selection of GPU-driven instances, one
+// invocation per instance (see gpu_culling.h)
+layout(local_size_x = 64) in;
+
+struct Object {
+    vec4 sphere;      // object-space center, radius
+    uvec4 info;       // transform handle, level count
+    uvec4 levels[4];  // first index, index count, error bits
+};
+
+layout(std430, binding = 0) readonly buffer Objects { Object objects[]; };
+layout(std430, binding = 1) writeonly buffer Commands { uint commands[]; };
+layout(std430, binding = 2) buffer Counters { uint counters[]; };
+// 7 per view: frustum planes 0..5, then eye and pixels per unit
+layout(std430, binding = 3) readonly buffer Views { vec4 views[]; };
+
+uniform samplerBuffer instanceTransforms; // 7 texels per transform, world matrix first
+uniform int objectCount;
+uniform int firstCommand;
+uniform int firstCounter;  // visible, triangles, full detail triangles, occluded
+uniform int viewCount;
+uniform float maxPixelError;
+
+// hierarchical-Z pyramid of this frame's occluders (hiz_buffer.h)
+uniform bool useHzb;
+uniform sampler2D hzb;
+uniform mat4 hzbViewProj;
+
+// keep in sync with HiZBuffer::occluded()
+bool hzbOccluded(vec3 lo, vec3 hi) {
+    vec2 uvMin = vec2(1e30), uvMax = vec2(-1e30);
+    float nearest = 1e30;
+    for (int c = 0; c < 8; ++c) {
+        vec4 q = hzbViewProj * vec4((c & 1) != 0 ? hi.x : lo.x, (c & 2) != 0 ? hi.y : lo.y,
+                                    (c & 4) != 0 ? hi.z : lo.z, 1.0);
+        if (q.w <= 1e-4) return false; // reaches behind the camera
+        vec3 ndc = q.xyz / q.w;
+        uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+        uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+
+    // rectangle in level 0 texels, grown by one
+    ivec2 size0 = textureSize(hzb, 0);
+    vec2 size = vec2(size0);
+    vec2 r0 = clamp(uvMin * size - 1.0, vec2(0.0), size - 1.0);
+    vec2 r1 = clamp(uvMax * size + 1.0, vec2(0.0), size - 1.0);
+    float extent = max(r1.x - r0.x, r1.y - r0.y);
+    int levelCount = int(log2(float(max(size0.x, size0.y)))) + 1;
+    int level = min(int(ceil(log2(max(extent, 1.0)))), levelCount - 1);
+    // level sizes derived like the CPU side; textureSize() at lod > 0 is
+    // not to be trusted on every driver
+    ivec2 last = max(size0 >> level, ivec2(1)) - 1;
+    ivec2 t0 = min(ivec2(r0) >> level, last), t1 = min(ivec2(r1) >> level, last);
+
+    float farthest = 0.0;
+    for (int y = t0.y; y <= t1.y; ++y)
+        for (int x = t0.x; x <= t1.x; ++x) farthest = max(farthest, texelFetch(hzb, ivec2(x, y), level).r);
+    return nearest > farthest;
+}
+
+void main() {
+    int i = int(gl_GlobalInvocationID.x);
+    if (i >= objectCount) return;
+    Object o = objects[i];
+
+    int t = int(o.info.x) * 7;
+    mat4 M = mat4(texelFetch(instanceTransforms, t), texelFetch(instanceTransforms, t + 1),
+                  texelFetch(instanceTransforms, t + 2), texelFetch(instanceTransforms, t + 3));
+    // bounding sphere in world space, error scaled by the largest axis scale
+    float scale = max(length(M[0].xyz), max(length(M[1].xyz), length(M[2].xyz)));
+    vec3 center = vec3(M * vec4(o.sphere.xyz, 1.0));
+    float radius = o.sphere.w * scale;
+
+    int levelCount = int(o.info.y);
+    int lod = levelCount - 1;
+    bool visible = false;
+    for (int v = 0; v < viewCount; ++v) {
+        bool inside = true;
+        for (int p = 0; p < 6; ++p) {
+            vec4 plane = views[7 * v + p];
+            if (dot(plane.xyz, center) + plane.w < -radius) { inside = false; break; }
+        }
+        if (!inside) continue;
+        visible = true;
+
+        // Model::selectLod
+        vec4 eye = views[7 * v + 6];
+        float distance = max(length(center - eye.xyz) - radius, 1e-3);
+        int level = 0;
+        for (int l = 1; l < levelCount; ++l)
+            if (uintBitsToFloat(o.levels[l].z) * scale * eye.w / distance <= maxPixelError) level = l;
+        lod = min(lod, level);
+    }
+
+    bool hidden = visible && useHzb && hzbOccluded(center - radius, center + radius);
+    if (hidden) visible = false;
+
+    uint count = o.levels[lod].y;
+    int c = (firstCommand + i) * 5;
+    commands[c] = count;
+    commands[c + 1] = visible ? 1u : 0u;
+    commands[c + 2] = o.levels[lod].x;
+    commands[c + 3] = 0u;
+    commands[c + 4] = o.info.x; // baseInstance: the transform handle
+
+    atomicAdd(counters[firstCounter + 2], o.levels[0].y / 3u);
+    if (hidden) atomicAdd(counters[firstCounter + 3], 1u);
+    if (visible) {
+        atomicAdd(counters[firstCounter], 1u);
+        atomicAdd(counters[firstCounter + 1], count / 3u);
+    }
+}
@@ -0,0 +1,197 @@
+#include "gpu_culling.h"
+#include "gl_state.h"
+#include "hiz_buffer.h"
+#include "meshlet.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
+
+// 5 uints per DrawElementsIndirectCommand: count, instanceCount,
+// firstIndex, baseVertex, baseInstance
+static const int COMMAND_SIZE = 5 * sizeof(GLuint);
+// per target: visible instances, triangles drawn, triangles at full detail,
+// instances hidden by the HZB
+static const int COUNTERS = 4;
+// texels per transform: world matrix columns, normal matrix columns
+static const int TRANSFORM_TEXELS = 7;
+// vec4s per view in the view buffer: frustum planes, eye and pixels per unit
+static const int VIEW_VEC4S = 7;
+
+bool GpuCulling::supported() {
+    return GLEW_VERSION_4_3
+        || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object
+            && GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
+
+GpuCulling::GpuCulling() {
+    cullShader = new ShaderProgram("gpu_cull.cs");
+}
+
+GpuCulling::~GpuCulling() {
+    GLuint buffers[6] = { objectBuffer, commandBuffer, counterBuffer, viewBuffer, instanceBuffer, transformBuffer };
+    glDeleteBuffers(6, buffers);
+    glDeleteTextures(1, &transformTexture);
+    delete cullShader;
+}
+
+void GpuCulling::add(Model* model, TransformStore::Handle transform) {
+    models.push_back(model);
+    handles.push_back(transform);
+}
+
+void GpuCulling::build(int transformCount) {
+    // group the instances by model, keeping the order within a model
+    std::vector<int> order(models.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = (int)i;
+    std::vector<Model*> firstSeen;
+    for (Model* m : models)
+        if (std::find(firstSeen.begin(), firstSeen.end(), m) == firstSeen.end()) firstSeen.push_back(m);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return std::find(firstSeen.begin(), firstSeen.end(), models[a])
+            < std::find(firstSeen.begin(), firstSeen.end(), models[b]);
+    });
+
+    std::vector<GpuObject> objects;
+    for (int i : order) {
+        Model* m = models[i];
+        if (batches.empty() || batches.back().model != m)
+            batches.push_back({ m, (int)objects.size(), 0 });
+        batches.back().objectCount++;
+
+        GpuObject o;
+        glm::vec3 lo = m->getBoundsMin(), hi = m->getBoundsMax();
+        o.sphere = glm::vec4((lo + hi) * 0.5f, glm::length(hi - lo) * 0.5f);
+        int levels = std::min(m->lodCount(), (int)MAX_LEVELS);
+        o.info = glm::uvec4((GLuint)handles[i], (GLuint)levels, 0, 0);
+        for (int l = 0; l < MAX_LEVELS; ++l) {
+            int src = std::min(l, levels - 1);
+            DrawItem item = m->drawItem(nullptr, glm::mat4(1.0f), glm::mat3(1.0f), true, src);
+            float error = m->lodError(src);
+            GLuint errorBits;
+            memcpy(&errorBits, &error, sizeof(errorBits));
+            o.levels[l] = glm::uvec4(item.firstIndex, (GLuint)item.indexCount, errorBits, 0);
+        }
+        objects.push_back(o);
+    }
+    objectCount = (int)objects.size();
+
+    glGenBuffers(1, &objectBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(objects.size(), 1) * sizeof(GpuObject),
+        objects.data(), GL_STATIC_DRAW);
+
+    // written by the compute shader, read as GL_DRAW_INDIRECT_BUFFER
+    glGenBuffers(1, &commandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(objectCount, 1) * TargetCount * COMMAND_SIZE,
+        nullptr, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &counterBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, TargetCount * COUNTERS * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    glGenBuffers(1, &viewBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // the instance attribute is the instance number, so baseInstance turns
+    // into the transform handle
+    std::vector<GLuint> ids(std::max(transformCount, 1));
+    for (size_t i = 0; i < ids.size(); ++i) ids[i] = (GLuint)i;
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+    for (const auto& b : batches) b.model->enableInstanceTransforms(instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &transformBuffer);
+    glGenTextures(1, &transformTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, transformBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+    glState.bindTexture(0, GL_TEXTURE_BUFFER, transformTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, transformBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    printf("[GPUCULL] %d instances of %zu models, %d B per object\n",
+        objectCount, batches.size(), (int)sizeof(GpuObject));
+}
+
+void GpuCulling::updateTransforms(const TransformStore& transforms) {
+    transformTexels.resize(std::max(transforms.size(), 1) * TRANSFORM_TEXELS);
+    for (int h = 0; h < transforms.size(); ++h) {
+        glm::vec4* t = &transformTexels[h * TRANSFORM_TEXELS];
+        const glm::mat4& M = transforms.world(h);
+        const glm::mat3& N = transforms.normal(h);
+        for (int c = 0; c < 4; ++c) t[c] = M[c];
+        for (int c = 0; c < 3; ++c) t[4 + c] = glm::vec4(N[c], 0.0f);
+    }
+    // new storage with the new matrices in one call; the GPU may still
+    // read last frame's, which stay alive until it is done with them
+    size_t bytes = transformTexels.size() * sizeof(glm::vec4);
+    glBindBuffer(GL_TEXTURE_BUFFER, transformBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, transformTexels.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glState.bindTexture(TRANSFORM_UNIT, GL_TEXTURE_BUFFER, transformTexture);
+}
+
+void GpuCulling::cull(Target target, const std::vector<glm::mat4>& viewProjs, const std::vector<LodView>& views,
+    float maxPixelError, const HiZBuffer* hzb) {
+    if (objectCount == 0) return;
+    int viewCount = (int)viewProjs.size();
+    viewData.resize(std::max(viewCount, 1) * VIEW_VEC4S);
+    for (int v = 0; v < viewCount; ++v) {
+        frustumPlanes(viewProjs[v], &viewData[v * VIEW_VEC4S]);
+        viewData[v * VIEW_VEC4S + 6] = glm::vec4(views[v].eye, views[v].pixelsPerUnit);
+    }
+
+    GLuint zero[COUNTERS] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, target * sizeof(zero), sizeof(zero), zero);
+    // new storage every cull, the previous dispatch may still read the old views
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, viewBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, viewData.size() * sizeof(glm::vec4), viewData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    cullShader->use();
+    glUniform1i(cullShader->u("objectCount"), objectCount);
+    glUniform1i(cullShader->u("firstCommand"), target * objectCount);
+    glUniform1i(cullShader->u("firstCounter"), target * COUNTERS);
+    glUniform1i(cullShader->u("viewCount"), viewCount);
+    glUniform1f(cullShader->u("maxPixelError"), maxPixelError);
+    glUniform1i(cullShader->u("instanceTransforms"), TRANSFORM_UNIT);
+    glUniform1i(cullShader->u("useHzb"), hzb != nullptr);
+    glUniform1i(cullShader->u("hzb"), HZB_UNIT);
+    if (hzb) {
+        glState.bindTexture(HZB_UNIT, GL_TEXTURE_2D, hzb->texture());
+        glUniformMatrix4fv(cullShader->u("hzbViewProj"), 1, GL_FALSE, glm::value_ptr(hzb->viewProjection()));
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, counterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, viewBuffer);
+    glDispatchCompute((objectCount + 63) / 64, 1, 1);
+    // the commands are read by the draws, the counters maybe by printStats
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void GpuCulling::submit(RenderQueue& queue, ShaderProgram* shader, RenderQueue::Pass pass, Target target) const {
+    bool depthOnly = pass != RenderQueue::PassOpaque;
+    for (const auto& b : batches) {
+        DrawItem item = b.model->drawItem(shader, glm::mat4(1.0f), glm::mat3(1.0f), depthOnly);
+        item.indirectBuffer = commandBuffer;
+        item.indirectOffset = (GLintptr)(target * objectCount + b.firstObject) * COMMAND_SIZE;
+        item.indirectCount = b.objectCount;
+        queue.submit(item, pass);
+    }
+}
+
+void GpuCulling::printStats() {
+    GLuint counters[TargetCount][COUNTERS];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    static const char* names[TargetCount] = { "shadow", "camera" };
+    for (int t = 0; t < TargetCount; ++t)
+        printf("[GPUCULL] %s: %u of %d instances drawn, %u occluded, %u of %u triangles, %zu indirect draws\n",
+            names[t], counters[t][0], objectCount, counters[t][3], counters[t][1], counters[t][2], batches.size());
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "model.h"
+#include "render_queue.h"
+#include "shaderprogram.h"
+#include "transform_store.h"
+
+// GPU-driven submission of model instances (needs GL 4.3). Every instance
+// is an entry of an object buffer: bounding sphere, transform handle and
+// the index range of each LOD level. The gpu_cull.cs compute shader tests
+// them against a set of view frusta and writes one
+// DrawElementsIndirectCommand per instance (instanceCount 0 when culled),
+// picking the level the way Model::selectLod does. Instances of a model are
+// stored next to each other, so a pass issues one glMultiDrawElementsIndirect
+// per model however many instances there are. The vertex shaders read the
+// matrices from a buffer texture, indexed by the transform handle that
+// arrives through baseInstance and the instance transform attribute.
+class HiZBuffer;
+
+class GpuCulling {
+public:
+    // results of the shadow and camera cull live side by side in the buffer
+    enum Target { TargetShadow = 0, TargetCamera = 1, TargetCount };
+    static const int MAX_LEVELS = 4;
+    // texture unit of the matrix buffer. Every shader reading
+    // instanceTransforms must point it here even when GPU culling is off:
+    // left at 0 it would share a unit with a sampler2D, and draws fail.
+    static const int TRANSFORM_UNIT = 9;
+    static const int HZB_UNIT = 10; // compute only
+
+    // compute shaders, storage buffers and indirect multi-draws available
+    static bool supported();
+
+    GpuCulling();
+    ~GpuCulling();
+
+    // register instances before build(); transformCount sizes the
+    // instance transform attribute (highest handle + 1)
+    void add(Model* model, TransformStore::Handle transform);
+    void build(int transformCount);
+
+    // upload this frame's matrices, after TransformStore::update()
+    void updateTransforms(const TransformStore& transforms);
+    // keep every instance inside any of the frusta, at the finest level
+    // one of those views needs; with hzb also drop the occluded ones. The
+    // views go to the shader in a storage buffer, there is no limit on them
+    void cull(Target target, const std::vector<glm::mat4>& viewProjs, const std::vector<LodView>& views,
+        float maxPixelError, const HiZBuffer* hzb = nullptr);
+    // one DrawItem per model, drawing the commands of the target
+    void submit(RenderQueue& queue, ShaderProgram* shader, RenderQueue::Pass pass, Target target) const;
+
+    // reads the counters back (a stall), only for the periodic stats
+    void printStats();
+
+private:
+    // std430 layout of gpu_cull.cs
+    struct GpuObject {
+        glm::vec4 sphere;                // object-space center, radius
+        glm::uvec4 info;                 // transform handle, level count
+        glm::uvec4 levels[MAX_LEVELS];   // first index, index count, error bits
+    };
+    struct Batch {
+        Model* model;
+        int firstObject, objectCount;
+    };
+
+    std::vector<Model*> models;                     // per object, in add() order
+    std::vector<TransformStore::Handle> handles;
+    std::vector<Batch> batches;
+    int objectCount = 0;
+
+    ShaderProgram* cullShader;
+    GLuint objectBuffer = 0, commandBuffer = 0, counterBuffer = 0, viewBuffer = 0;
+    GLuint instanceBuffer = 0;                      // 0, 1, 2, ... per transform handle
+    GLuint transformBuffer = 0, transformTexture = 0;
+    std::vector<glm::vec4> transformTexels;
+
+    std::vector<glm::vec4> viewData; // per view: 6 frustum planes, eye and pixels per unit
+};
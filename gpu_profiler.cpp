@@ -0,0 +1,142 @@
+#include "gpu_profiler.h"
+
+GpuProfiler::~GpuProfiler() {
+    for (auto& f : ring)
+        if (!f.queries.empty()) glDeleteQueries((GLsizei)f.queries.size(), f.queries.data());
+    if (csv) fclose(csv);
+}
+
+bool GpuProfiler::openCsv(const std::string& path) {
+    csv = fopen(path.c_str(), "w");
+    if (!csv) {
+        fprintf(stderr, "[GPUPROF] cannot write %s\n", path.c_str());
+        return false;
+    }
+    fprintf(csv, "frame,scope,depth,gpu_ms,draws,triangles,state_changes\n");
+    return true;
+}
+
+int GpuProfiler::timestamp(Frame& f) {
+    if (f.usedQueries == (int)f.queries.size()) {
+        // grow by a block; the first frames settle how many a frame needs
+        size_t old = f.queries.size();
+        f.queries.resize(old + 16);
+        glGenQueries(16, &f.queries[old]);
+    }
+    glQueryCounter(f.queries[f.usedQueries], GL_TIMESTAMP);
+    return f.usedQueries++;
+}
+
+bool GpuProfiler::ready(const Frame& f) const {
+    if (f.usedQueries == 0) return true;
+    GLint available = 0;
+    glGetQueryObjectiv(f.queries[f.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    return available != 0;
+}
+
+void GpuProfiler::beginFrame() {
+    Frame& f = current();
+    // RING - 1 frames old by now; GL_QUERY_RESULT would block on a GPU
+    // that is further behind, the slot is needed now
+    if (f.number >= 0) {
+        if (ready(f)) collect(f);
+        else droppedFrames++;
+    }
+    f.number = frameNumber;
+    f.usedQueries = 0;
+    f.scopes.clear();
+    stack.clear();
+    push("frame");
+}
+
+void GpuProfiler::endFrame() {
+    while (!stack.empty()) pop();
+    ++frameNumber;
+}
+
+void GpuProfiler::push(const char* name, int index) {
+    Frame& f = current();
+    Scope s;
+    s.name = name;
+    s.index = index;
+    s.depth = (int)stack.size();
+    s.parent = stack.empty() ? -1 : stack.back();
+    s.begin = glState.counters();
+    s.beginQuery = timestamp(f);
+    s.endQuery = -1;
+    stack.push_back((int)f.scopes.size());
+    f.scopes.push_back(s);
+}
+
+void GpuProfiler::pop() {
+    if (stack.empty()) return;
+    Frame& f = current();
+    Scope& s = f.scopes[stack.back()];
+    stack.pop_back();
+    s.endQuery = timestamp(f);
+    s.end = glState.counters();
+}
+
+void GpuProfiler::collect(Frame& f) {
+    std::vector<std::string> paths(f.scopes.size());
+    for (size_t i = 0; i < f.scopes.size(); ++i) {
+        const Scope& s = f.scopes[i];
+        if (s.endQuery < 0) continue;
+        GLuint64 t0, t1;
+        glGetQueryObjectui64v(f.queries[s.beginQuery], GL_QUERY_RESULT, &t0);
+        glGetQueryObjectui64v(f.queries[s.endQuery], GL_QUERY_RESULT, &t1);
+        double ms = (t1 - t0) * 1e-6;
+        long long draws = s.end.draws - s.begin.draws;
+        long long triangles = s.end.triangles - s.begin.triangles;
+        long long states = s.end.stateChanges - s.begin.stateChanges;
+
+        std::string label = s.name;
+        if (s.index >= 0) label += " " + std::to_string(s.index);
+        // parents come first, their path is already known
+        paths[i] = (s.parent >= 0 ? paths[s.parent] + "/" : std::string()) + label;
+
+        auto it = totalIndex.find(paths[i]);
+        if (it == totalIndex.end()) {
+            it = totalIndex.emplace(paths[i], (int)totals.size()).first;
+            totals.push_back(Total());
+            totals.back().label = std::string(2 * s.depth, ' ') + label;
+        }
+        Total& t = totals[it->second];
+        t.ms += ms;
+        t.draws += draws;
+        t.triangles += triangles;
+        t.stateChanges += states;
+
+        if (csv)
+            fprintf(csv, "%lld,%s,%d,%.4f,%lld,%lld,%lld\n", f.number, paths[i].c_str(), s.depth, ms,
+                draws, triangles, states);
+    }
+    summedFrames++;
+    f.number = -1;
+}
+
+void GpuProfiler::finish() {
+    // oldest first, so the CSV stays in frame order
+    for (int k = 0; k < RING; ++k) {
+        Frame& f = ring[(frameNumber + k) % RING];
+        if (f.number >= 0 && f.number < frameNumber) collect(f);
+    }
+    if (csv) fflush(csv);
+}
+
+void GpuProfiler::printAverages() {
+    if (!summedFrames) return;
+    printf("[GPUPROF] per-frame average over %d frames\n", summedFrames);
+    if (droppedFrames)
+        printf("[GPUPROF] %d frames dropped, the GPU was more than %d frames behind\n",
+            droppedFrames, RING - 1);
+    printf("  %-24s %9s %7s %10s %7s\n", "scope", "gpu ms", "draws", "triangles", "state");
+    double n = summedFrames;
+    for (const Total& t : totals)
+        printf("  %-24s %9.3f %7.1f %10.0f %7.1f\n", t.label.c_str(), t.ms / n, t.draws / n,
+            t.triangles / n, t.stateChanges / n);
+    totals.clear();
+    totalIndex.clear();
+    summedFrames = 0;
+    droppedFrames = 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include "gl_state.h"
+
+// GPU time of named, nestable scopes (passes, lights) from GL_TIMESTAMP
+// queries. Every frame of a ring of RING frames owns its query objects, and
+// a frame is read back when its slot comes round again, RING - 1 frames
+// later. If the GPU has not finished it even then, the frame is dropped
+// and counted rather than waited for, so profiling never stalls.
+// Each scope also gets the draws, triangles and state changes issued inside
+// it, from the glState counters.
+//
+// Finished frames are summed per scope until printAverages(), and can be
+// appended to a CSV file as they finish, one row per scope.
+class GpuProfiler {
+public:
+    static const int RING = 4;
+
+    ~GpuProfiler();
+
+    // a "frame" scope around everything in between
+    void beginFrame();
+    void endFrame();
+
+    // name must outlive the profiler (a literal); index >= 0 is appended
+    void push(const char* name, int index = -1);
+    void pop();
+
+    // continuous output: frame, scope, depth, gpu_ms, draws, triangles, state_changes
+    bool openCsv(const std::string& path);
+    // read back every frame still in flight, waiting for the GPU
+    void finish();
+    // per-frame averages since the last call, then start over
+    void printAverages();
+
+private:
+    struct Scope {
+        const char* name;
+        int index;
+        int depth, parent;
+        int beginQuery, endQuery;
+        GLStateCache::Counters begin, end;
+    };
+    struct Frame {
+        long long number = -1; // -1: nothing to read
+        std::vector<GLuint> queries;
+        int usedQueries = 0;
+        std::vector<Scope> scopes;
+    };
+    struct Total {
+        std::string label; // indented by depth
+        double ms = 0.0;
+        long long draws = 0, triangles = 0, stateChanges = 0;
+    };
+
+    Frame ring[RING];
+    long long frameNumber = 0;
+    std::vector<int> stack; // open scopes of the current frame
+
+    std::vector<Total> totals;       // in order of first appearance
+    std::map<std::string, int> totalIndex; // scope path -> totals
+    int summedFrames = 0;
+    int droppedFrames = 0; // still in flight when their slot was needed
+    FILE* csv = nullptr;
+
+    Frame& current() { return ring[frameNumber % RING]; }
+    int timestamp(Frame& f);
+    // the frame's last timestamp has landed, and with it all the others
+    bool ready(const Frame& f) const;
+    void collect(Frame& f);
+};
+
+// push() on construction and pop() when the block ends; null profiler: no-op
+class GpuScope {
+public:
+    GpuScope(GpuProfiler* profiler, const char* name, int index = -1) : profiler(profiler) {
+        if (profiler) profiler->push(name, index);
+    }
+    ~GpuScope() {
+        if (profiler) profiler->pop();
+    }
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+    GpuProfiler* profiler;
+};
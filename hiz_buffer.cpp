@@ -0,0 +1,186 @@
+#include "hiz_buffer.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+HiZBuffer::HiZBuffer(int w, int h) : width(w), height(h) {
+    levelCount = 1;
+    while ((width >> levelCount) > 0 || (height >> levelCount) > 0) levelCount++;
+    reduceShader = new ShaderProgram("shadow_mask.vs", nullptr, "hiz_reduce.fs");
+    glGenVertexArrays(1, &emptyVAO);
+
+    // occluder depth, read with texelFetch only
+    glGenTextures(1, &depth);
+    glState.bindTexture(0, GL_TEXTURE_2D, depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenFramebuffers(1, &depthFramebuffer);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "[HZB] occluder framebuffer incomplete\n");
+
+    // farthest depth pyramid, one framebuffer per level
+    glGenTextures(1, &pyramid);
+    glState.bindTexture(0, GL_TEXTURE_2D, pyramid);
+    size_t texels = 0;
+    for (int l = 0; l < levelCount; ++l) {
+        int lw = std::max(1, width >> l), lh = std::max(1, height >> l);
+        glTexImage2D(GL_TEXTURE_2D, l, GL_R32F, lw, lh, 0, GL_RED, GL_FLOAT, nullptr);
+        cpuOffsets.push_back(texels);
+        texels += (size_t)lw * lh;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    levelFramebuffers.resize(levelCount);
+    glGenFramebuffers(levelCount, levelFramebuffers.data());
+    for (int l = 0; l < levelCount; ++l) {
+        glState.bindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[l]);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, pyramid, l);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            fprintf(stderr, "[HZB] level %d framebuffer incomplete\n", l);
+    }
+    glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    cpuTexels.resize(texels);
+    glGenBuffers(RING, packBuffers);
+    for (GLuint b : packBuffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, b);
+        glBufferData(GL_PIXEL_PACK_BUFFER, texels * sizeof(float), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    printf("[HZB] %dx%d, %d levels\n", width, height, levelCount);
+}
+
+HiZBuffer::~HiZBuffer() {
+    for (GLsync f : fences)
+        if (f) glDeleteSync(f);
+    glDeleteBuffers(RING, packBuffers);
+    glDeleteFramebuffers(levelCount, levelFramebuffers.data());
+    glDeleteFramebuffers(1, &depthFramebuffer);
+    glDeleteTextures(1, &pyramid);
+    glDeleteTextures(1, &depth);
+    glDeleteVertexArrays(1, &emptyVAO);
+    delete reduceShader;
+}
+
+void HiZBuffer::bindOccluders() {
+    glState.bindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+    glState.viewport(0, 0, width, height);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void HiZBuffer::build(const glm::mat4& viewProj) {
+    builtViewProj = viewProj;
+
+    // level 0 copies the depth, every further level reduces the one before;
+    // the source level is the only one the sampler sees, so the level being
+    // written is never read
+    reduceShader->use();
+    glState.bindVertexArray(emptyVAO);
+    GLint fromDepth = reduceShader->u("fromDepth");
+    for (int l = 0; l < levelCount; ++l) {
+        glState.bindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[l]);
+        glState.viewport(0, 0, std::max(1, width >> l), std::max(1, height >> l));
+        if (l == 0) {
+            glState.bindTexture(0, GL_TEXTURE_2D, depth);
+            glUniform1i(fromDepth, 1);
+        }
+        else {
+            glState.bindTexture(0, GL_TEXTURE_2D, pyramid);
+            glState.activeTexture(0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, l - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, l - 1);
+            glUniform1i(fromDepth, 0);
+        }
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glState.countDraw(1);
+    }
+    glState.activeTexture(0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+    // copy every level into the next pack buffer; fetch() maps it once the
+    // fence has passed. A slot nobody fetched in time is simply reused.
+    int slot = nextSlot;
+    nextSlot = (nextSlot + 1) % RING;
+    if (fences[slot]) glDeleteSync(fences[slot]);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[slot]);
+    for (int l = 0; l < levelCount; ++l) {
+        glState.bindFramebuffer(GL_FRAMEBUFFER, levelFramebuffers[l]);
+        glReadPixels(0, 0, std::max(1, width >> l), std::max(1, height >> l), GL_RED, GL_FLOAT,
+            (void*)(cpuOffsets[l] * sizeof(float)));
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    packViewProj[slot] = viewProj;
+    glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void HiZBuffer::fetch() {
+    // oldest slot first, so the newest finished one wins
+    for (int k = 0; k < RING; ++k) {
+        int slot = (nextSlot + k) % RING;
+        if (!fences[slot]) continue;
+        GLenum state = glClientWaitSync(fences[slot], 0, 0);
+        if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(fences[slot]);
+        fences[slot] = 0;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[slot]);
+        const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, cpuTexels.size() * sizeof(float),
+            GL_MAP_READ_BIT);
+        if (data) {
+            memcpy(cpuTexels.data(), data, cpuTexels.size() * sizeof(float));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            cpuViewProj = packViewProj[slot];
+            cpuValid = true;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+// keep in sync with hzbOccluded() in gpu_cull.cs
+bool HiZBuffer::occluded(const glm::vec3& lo, const glm::vec3& hi) {
+    if (!cpuValid) return false;
+    tested++;
+
+    const glm::mat4& clip = cpuViewProj;
+    glm::vec2 uvMin(FLT_MAX), uvMax(-FLT_MAX);
+    float nearest = FLT_MAX;
+    for (int c = 0; c < 8; ++c) {
+        glm::vec4 q = clip * glm::vec4(c & 1 ? hi.x : lo.x, c & 2 ? hi.y : lo.y, c & 4 ? hi.z : lo.z, 1.0f);
+        if (q.w <= 1e-4f) return false; // reaches behind the camera
+        glm::vec3 ndc = glm::vec3(q) / q.w;
+        uvMin = glm::min(uvMin, glm::vec2(ndc) * 0.5f + 0.5f);
+        uvMax = glm::max(uvMax, glm::vec2(ndc) * 0.5f + 0.5f);
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+
+    // rectangle in level 0 texels, grown by one: the occluders were only
+    // rasterized at texel centers
+    glm::vec2 size((float)width, (float)height);
+    glm::vec2 r0 = glm::clamp(uvMin * size - 1.0f, glm::vec2(0.0f), size - 1.0f);
+    glm::vec2 r1 = glm::clamp(uvMax * size + 1.0f, glm::vec2(0.0f), size - 1.0f);
+    float extent = std::max(r1.x - r0.x, r1.y - r0.y);
+    // the level where it spans at most two texels per axis
+    int level = std::min((int)std::ceil(std::log2(std::max(extent, 1.0f))), levelCount - 1);
+    int lw = std::max(1, width >> level), lh = std::max(1, height >> level);
+    int x0 = std::min((int)r0.x >> level, lw - 1), x1 = std::min((int)r1.x >> level, lw - 1);
+    int y0 = std::min((int)r0.y >> level, lh - 1), y1 = std::min((int)r1.y >> level, lh - 1);
+
+    const float* texels = &cpuTexels[cpuOffsets[level]];
+    float farthest = 0.0f;
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x) farthest = std::max(farthest, texels[y * lw + x]);
+    bool hidden = nearest > farthest;
+    if (hidden) occludedCount++;
+    return hidden;
+}
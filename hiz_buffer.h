@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "shaderprogram.h"
+
+// Hierarchical-Z occlusion culling. The big occluders (the static room) are
+// drawn depth-only into a small target from the camera, which is then
+// max-reduced into a mip pyramid: every texel of a level holds the farthest
+// depth of the four below it. A box is hidden if its nearest depth is behind
+// the farthest depth of the few texels its screen rectangle covers at the
+// level where that rectangle is about one texel wide.
+// GPU tests (gpu_cull.cs) sample this frame's pyramid. CPU tests use the
+// pyramid read back asynchronously one build earlier, with the camera it was
+// built from, so objects can appear a frame late after turning fast.
+class HiZBuffer {
+public:
+    // power-of-two size of level 0
+    HiZBuffer(int width = 256, int height = 128);
+    ~HiZBuffer();
+
+    // bind and clear the occluder depth target; draw depth only, then build()
+    void bindOccluders();
+    // reduce the occluder depth into the pyramid and start reading it back
+    void build(const glm::mat4& viewProj);
+    // pick up the newest finished read back, never waits
+    void fetch();
+
+    // world-space box hidden behind the read-back pyramid; counted in the
+    // stats below
+    bool occluded(const glm::vec3& lo, const glm::vec3& hi);
+
+    // this frame's pyramid, for GPU tests
+    GLuint texture() const { return pyramid; }
+    int levels() const { return levelCount; }
+    glm::ivec2 size() const { return glm::ivec2(width, height); }
+    const glm::mat4& viewProjection() const { return builtViewProj; }
+
+    // CPU tests since the last resetStats()
+    int tested = 0, occludedCount = 0;
+    void resetStats() { tested = occludedCount = 0; }
+
+private:
+    static const int RING = 2;
+
+    int width, height, levelCount;
+    GLuint depth = 0, depthFramebuffer = 0;
+    GLuint pyramid = 0;
+    std::vector<GLuint> levelFramebuffers;
+    GLuint emptyVAO = 0;
+    ShaderProgram* reduceShader;
+    glm::mat4 builtViewProj = glm::mat4(1.0f);
+
+    // read back: one pixel pack buffer and fence per slot
+    GLuint packBuffers[RING] = {};
+    GLsync fences[RING] = {};
+    glm::mat4 packViewProj[RING];
+    int nextSlot = 0;
+
+    // the fetched pyramid, level after level
+    std::vector<float> cpuTexels;
+    std::vector<size_t> cpuOffsets;
+    glm::mat4 cpuViewProj = glm::mat4(1.0f);
+    bool cpuValid = false;
+};
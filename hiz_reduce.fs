@@ -0,0 +1,23 @@
+#version 330 core
+
+// One level of the hierarchical-Z pyramid (hiz_buffer.h). The bound
+// source only exposes the level below, read at lod 0.
+uniform sampler2D source;
+uniform bool fromDepth; // level 0: copy the occluder depth
+
+out float farthest;
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    if (fromDepth) {
+        farthest = texelFetch(source, p, 0).r;
+        return;
+    }
+    // odd or 1 texel high sources: clamp instead of reading past the edge
+    ivec2 last = textureSize(source, 0) - 1;
+    ivec2 q = p * 2;
+    farthest = max(max(texelFetch(source, min(q, last), 0).r,
+                       texelFetch(source, min(q + ivec2(1, 0), last), 0).r),
+                   max(texelFetch(source, min(q + ivec2(0, 1), last), 0).r,
+                       texelFetch(source, min(q + ivec2(1, 1), last), 0).r));
+}
@@ -0,0 +1,168 @@
+#include "impostor.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+static float signNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+glm::vec2 Impostor::octEncode(const glm::vec3& d) {
+    glm::vec3 n = d / (std::fabs(d.x) + std::fabs(d.y) + std::fabs(d.z));
+    glm::vec2 p(n.x, n.z);
+    if (n.y < 0.0f)
+        p = glm::vec2((1.0f - std::fabs(p.y)) * signNotZero(p.x), (1.0f - std::fabs(p.x)) * signNotZero(p.y));
+    return p;
+}
+
+glm::vec3 Impostor::octDecode(const glm::vec2& p) {
+    glm::vec3 d(p.x, 1.0f - std::fabs(p.x) - std::fabs(p.y), p.y);
+    if (d.y < 0.0f) {
+        float x = d.x;
+        d.x = (1.0f - std::fabs(d.z)) * signNotZero(x);
+        d.z = (1.0f - std::fabs(x)) * signNotZero(d.z);
+    }
+    return glm::normalize(d);
+}
+
+Impostor::Impostor(Model* model, int frames, int tileSize) : frames(std::max(frames, 2)), tileSize(tileSize) {
+    boundsCenter = (model->getBoundsMin() + model->getBoundsMax()) * 0.5f;
+    boundsRadius = glm::length(model->getBoundsMax() - model->getBoundsMin()) * 0.5f;
+    bake(model);
+
+    // unit quad, corners -1..1, then the world matrix per instance
+    static const float corners[8] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+    glGenVertexArrays(1, &quadVAO);
+    glGenBuffers(1, &quadVBO);
+    glGenBuffers(1, &instanceVBO);
+    glState.bindVertexArray(quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (int c = 0; c < 4; ++c) {
+        glEnableVertexAttribArray(1 + c);
+        glVertexAttribPointer(1 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(c * sizeof(glm::vec4)));
+        glVertexAttribDivisor(1 + c, 1);
+    }
+    glState.bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+Impostor::~Impostor() {
+    GLuint buffers[2] = { quadVBO, instanceVBO };
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(1, &quadVAO);
+    GLuint textures[2] = { albedo, normalDepth };
+    glDeleteTextures(2, textures);
+}
+
+void Impostor::bake(Model* model) {
+    int size = frames * tileSize;
+    // stop the mip chain at 8 texels per tile, below that tiles bleed together
+    int maxLevel = 0;
+    while ((tileSize >> (maxLevel + 1)) >= 8) maxLevel++;
+
+    GLuint targets[2];
+    glGenTextures(2, targets);
+    albedo = targets[0];
+    normalDepth = targets[1];
+    for (GLuint t : targets) {
+        glState.bindTexture(0, GL_TEXTURE_2D, t);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // blending normals and depths with the empty border would bend the edges
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+            t == albedo ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_NEAREST);
+    }
+    glState.bindTexture(0, GL_TEXTURE_2D, normalDepth);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    GLuint depth, framebuffer;
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glGenFramebuffers(1, &framebuffer);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, albedo, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, normalDepth, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "[IMPOSTOR] bake framebuffer incomplete\n");
+
+    // empty texels: no coverage, a flat normal at the center depth
+    const float clearAlbedo[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const float clearNormal[4] = { 0.5f, 0.5f, 0.5f, 0.5f };
+    glState.depthMask(true);
+    glClearBufferfv(GL_COLOR, 0, clearAlbedo);
+    glClearBufferfv(GL_COLOR, 1, clearNormal);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    ShaderProgram bakeShader("impostor_bake.vs", nullptr, "impostor_bake.fs");
+    bakeShader.use();
+    const glm::vec3& c = boundsCenter;
+    float r = boundsRadius;
+    bakeShader.setMat4("P", glm::ortho(-r, r, -r, r, r, 3.0f * r));
+    glUniform4f(bakeShader.u("bounds"), c.x, c.y, c.z, r);
+    // the model in object space, drawn once per frame through the queue
+    RenderQueue queue;
+    queue.submit(model->drawItem(&bakeShader, glm::mat4(1.0f), glm::mat3(1.0f), false), RenderQueue::PassOpaque);
+    // the source meshes have coincident inner shells that z-fight with the
+    // outside; only front faces give every texel the normal facing the viewer
+    glState.enable(GL_CULL_FACE);
+    for (int j = 0; j < frames; ++j)
+        for (int i = 0; i < frames; ++i) {
+            glm::vec3 d = octDecode(glm::vec2(i, j) / (float)(frames - 1) * 2.0f - 1.0f);
+            glm::vec3 up = std::fabs(d.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+            bakeShader.setMat4("V", glm::lookAt(c + d * 2.0f * r, c, up));
+            bakeShader.setVec3("frameDir", d);
+            glState.viewport(i * tileSize, j * tileSize, tileSize, tileSize);
+            queue.execute();
+        }
+    glState.disable(GL_CULL_FACE);
+
+    for (GLuint t : targets) {
+        glState.bindTexture(0, GL_TEXTURE_2D, t);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depth);
+    printf("[IMPOSTOR] %dx%d frames of %d px baked, %d KB\n", frames, frames, tileSize,
+        (int)(2 * size * size * 4 * 4 / 3 / 1024));
+}
+
+void Impostor::upload() {
+    if (instances.empty()) return;
+    size_t bytes = instances.size() * sizeof(glm::mat4);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (bytes > instanceCapacity) {
+        instanceCapacity = bytes;
+        glBufferData(GL_ARRAY_BUFFER, bytes, instances.data(), GL_STREAM_DRAW);
+    }
+    else {
+        // orphan, the previous frame's draw may still read it
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Impostor::draw(ShaderProgram* shader) const {
+    if (instances.empty()) return;
+    shader->use();
+    glState.bindTexture(0, GL_TEXTURE_2D, albedo);
+    glState.bindTexture(2, GL_TEXTURE_2D, normalDepth);
+    glUniform4f(shader->u("bounds"), boundsCenter.x, boundsCenter.y, boundsCenter.z, boundsRadius);
+    glUniform1i(shader->u("frames"), frames);
+    glState.bindVertexArray(quadVAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)instances.size());
+    glState.countDraw(2 * (long long)instances.size());
+}
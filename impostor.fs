@@ -0,0 +1,54 @@
+#version 330 core
+
+#include "lighting.glsl"
+
+in vec2 atlasUV;
+in vec3 quadPos;
+flat in vec3 frameDir;
+flat in mat4 model;
+
+out vec4 outColor;
+
+uniform sampler2D impostorAlbedo;       // color, coverage
+uniform sampler2D impostorNormalDepth;  // object-space normal, depth along frameDir
+uniform vec4      bounds;               // object-space center, radius
+uniform bool      depthOnly;            // pre-pass: coverage and depth only
+
+uniform mat4       P;
+
+void main() {
+    vec4 albedo = texture(impostorAlbedo, atlasUV);
+    if(albedo.a < 0.5) discard;
+
+    // the baked surface in front of or behind the quad, at its real depth
+    vec4 nd = texture(impostorNormalDepth, atlasUV);
+    vec3 objPos = quadPos + frameDir * (nd.a * 2.0 - 1.0) * bounds.w;
+    vec3 fragPos = vec3(model * vec4(objPos, 1.0));
+    vec4 clip = P * V * vec4(fragPos, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+    if(depthOnly) {
+        outColor = vec4(0.0);
+        return;
+    }
+
+    vec3 norm    = normalize(mat3(model) * (nd.rgb * 2.0 - 1.0));
+    vec3 viewDir = normalize(cameraPos - fragPos);
+
+    // the light of f_textures.glsl, a single shadow tap is plenty at
+    // impostor distances
+    vec3 result = vec3(0.0);
+    uvec2 range = texelFetch(clusterData, clusterIndex(fragPos)).xy;
+    for(uint k = 0u; k < range.y; ++k) {
+        int i = int(texelFetch(lightIndices, int(range.x + k)).x);
+        vec4 posRadius = texelFetch(lightData, 2 * i);
+        vec4 colorSlot = texelFetch(lightData, 2 * i + 1);
+        vec3 LP = posRadius.xyz;
+        LightTerms t = blinnPhong(LP, colorSlot.rgb, posRadius.w, fragPos, norm, viewDir);
+
+        int slot = int(colorSlot.a);
+        float lit = slot < 0 ? 1.0 : shadowTap(slot, fragPos - LP, (length(LP - fragPos) - 0.05) / far_plane);
+        result += t.ambient + lit * (t.diffuse + t.specular);
+    }
+
+    outColor = vec4(result * albedo.rgb, 1.0);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "model.h"
+#include "shaderprogram.h"
+
+// Octahedral impostor of a model. At load time the model is rendered
+// orthographically from frames x frames directions spread over the sphere
+// by an octahedral map, one tile per direction, into two atlases:
+//   albedo        texture color, alpha = coverage
+//   normalDepth   object-space normal, depth along the view direction
+// Far instances are then drawn as one instanced quad each: the quad faces
+// the baked direction nearest to the camera and shows that tile. The
+// fragment shader (impostor.fs) rebuilds the surface position and normal
+// from normalDepth, writes the real depth and lights it like a mesh, with a
+// single shadow tap instead of the filtered lookup.
+class Impostor {
+public:
+    Impostor(Model* model, int frames = 12, int tileSize = 64);
+    ~Impostor();
+
+    // instances for the next draw(); upload() once they are all added
+    void clear() { instances.clear(); }
+    void add(const glm::mat4& M) { instances.push_back(M); }
+    void upload();
+    int instanceCount() const { return (int)instances.size(); }
+
+    // all instances in one draw, with shader = impostor.vs / impostor.fs
+    // (samplers impostorAlbedo on unit 0, impostorNormalDepth on unit 2)
+    void draw(ShaderProgram* shader) const;
+
+    // object-space bounding sphere the frames were taken around
+    const glm::vec3& center() const { return boundsCenter; }
+    float radius() const { return boundsRadius; }
+
+    // octahedral map of the unit sphere onto [-1, 1]^2, y is the pole axis;
+    // must match impostor.vs
+    static glm::vec2 octEncode(const glm::vec3& d);
+    static glm::vec3 octDecode(const glm::vec2& p);
+
+private:
+    int frames, tileSize;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+
+    GLuint albedo = 0, normalDepth = 0;
+    GLuint quadVAO = 0, quadVBO = 0, instanceVBO = 0;
+    std::vector<glm::mat4> instances;
+    size_t instanceCapacity = 0;
+
+    void bake(Model* model);
+};
@@ -0,0 +1,58 @@
+#version 330 core
+
+// Billboard of one impostor instance (impostor.h). The quad stands across
+// the baked direction nearest to the camera and maps that frame's tile.
+layout(location = 0) in vec2 corner;       // -1..1
+layout(location = 1) in vec4 instanceM0;   // world matrix, one column each
+layout(location = 2) in vec4 instanceM1;
+layout(location = 3) in vec4 instanceM2;
+layout(location = 4) in vec4 instanceM3;
+
+uniform mat4 V;
+uniform mat4 P;
+uniform vec3 cameraPos;
+uniform vec4 bounds;   // object-space center, radius
+uniform int  frames;   // tiles per atlas side
+
+out vec2 atlasUV;
+out vec3 quadPos;          // object space, on the plane through the center
+flat out vec3 frameDir;    // object space, towards the viewer of the frame
+flat out mat4 model;
+
+// the pre-pass and the lit pass draw impostors with this same shader
+invariant gl_Position;
+
+float signNotZero(float v) { return v >= 0.0 ? 1.0 : -1.0; }
+
+// Impostor::octEncode / octDecode
+vec2 octEncode(vec3 d) {
+    vec3 n = d / (abs(d.x) + abs(d.y) + abs(d.z));
+    vec2 p = n.xz;
+    if (n.y < 0.0) p = vec2((1.0 - abs(p.y)) * signNotZero(p.x), (1.0 - abs(p.x)) * signNotZero(p.y));
+    return p;
+}
+vec3 octDecode(vec2 p) {
+    vec3 d = vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+    if (d.y < 0.0) d.xz = vec2((1.0 - abs(d.z)) * signNotZero(d.x), (1.0 - abs(d.x)) * signNotZero(d.z));
+    return normalize(d);
+}
+
+void main() {
+    model = mat4(instanceM0, instanceM1, instanceM2, instanceM3);
+    // camera direction in object space: for rotation and uniform scale the
+    // transpose inverts up to a factor the normalize removes
+    vec3 toCamera = cameraPos - vec3(model * vec4(bounds.xyz, 1.0));
+    vec3 d = normalize(transpose(mat3(model)) * toCamera);
+    float last = float(frames - 1);
+    vec2 cell = clamp(floor((octEncode(d) * 0.5 + 0.5) * last + 0.5), 0.0, last);
+    frameDir = octDecode(cell / last * 2.0 - 1.0);
+
+    // axes of the frame's bake camera, as glm::lookAt builds them
+    vec3 up = abs(frameDir.y) > 0.99 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(-frameDir, up));
+    vec3 camUp = cross(right, -frameDir);
+
+    quadPos = bounds.xyz + (right * corner.x + camUp * corner.y) * bounds.w;
+    atlasUV = (cell + corner * 0.5 + 0.5) / float(frames);
+    gl_Position = P * V * model * vec4(quadPos, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec3 objPos;
+in vec3 objNormal;
+in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormalDepth;
+
+uniform sampler2D texture0;
+uniform vec4 bounds;     // object-space center, radius
+uniform vec3 frameDir;   // towards the viewer of this frame
+
+void main() {
+    outAlbedo = vec4(texture(texture0, fragTexCoord).rgb, 1.0);
+    // depth in front of the center plane, -radius..radius to 0..1
+    float depth = dot(objPos - bounds.xyz, frameDir) / bounds.w;
+    outNormalDepth = vec4(normalize(objNormal) * 0.5 + 0.5, depth * 0.5 + 0.5);
+}
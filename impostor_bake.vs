@@ -0,0 +1,23 @@
+#version 330 core
+
+// One frame of an impostor atlas (impostor.h): the model in object space,
+// seen orthographically along -frameDir
+layout(location = 0) in vec3 vertex;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+
+uniform mat4 V;
+uniform mat4 P;
+uniform vec3 posOffset;   // dequantization of packed positions
+uniform vec3 posScale;
+
+out vec3 objPos;
+out vec3 objNormal;
+out vec2 fragTexCoord;
+
+void main() {
+    objPos = posOffset + vertex * posScale;
+    objNormal = normal;
+    fragTexCoord = texCoord;
+    gl_Position = P * V * vec4(objPos, 1.0);
+}
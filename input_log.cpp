@@ -0,0 +1,96 @@
+#include "input_log.h"
+#include <cstdint>
+#include <cstring>
+
+static const char MAGIC[4] = { 'G', 'A', 'I', 'N' };
+
+static void putFloat(unsigned char* out, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, 4);
+    for (int i = 0; i < 4; ++i) out[i] = (unsigned char)(bits >> (8 * i));
+}
+
+static float getFloat(const unsigned char* in) {
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; ++i) bits |= (uint32_t)in[i] << (8 * i);
+    float v;
+    memcpy(&v, &bits, 4);
+    return v;
+}
+
+InputLog::~InputLog() {
+    close();
+}
+
+bool InputLog::record(const std::string& path) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "[INPUT] cannot write %s\n", path.c_str());
+        return false;
+    }
+    writing = true;
+    frameCount = 0;
+    fwrite(MAGIC, 1, 4, file);
+    fputc(VERSION, file);
+    return true;
+}
+
+void InputLog::append(const Frame& frame) {
+    if (!file || !writing) return;
+    unsigned char rec[13];
+    bool mouse = frame.mouseX != 0.0f || frame.mouseY != 0.0f;
+    putFloat(rec, frame.deltaTime);
+    rec[4] = (unsigned char)(frame.keys & ((1 << KEY_COUNT) - 1)) | (mouse ? MOUSE_BIT : 0);
+    if (mouse) {
+        putFloat(rec + 5, frame.mouseX);
+        putFloat(rec + 9, frame.mouseY);
+    }
+    fwrite(rec, 1, mouse ? 13 : 5, file);
+    ++frameCount;
+}
+
+bool InputLog::replay(const std::string& path) {
+    close();
+    file = fopen(path.c_str(), "rb");
+    if (!file) {
+        fprintf(stderr, "[INPUT] cannot open %s\n", path.c_str());
+        return false;
+    }
+    char magic[4];
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, MAGIC, 4) != 0 || fgetc(file) != VERSION) {
+        fprintf(stderr, "[INPUT] %s is not a version %d input log\n", path.c_str(), VERSION);
+        close();
+        return false;
+    }
+    writing = false;
+    // count the frames up front, a benchmark sizes its tables by them
+    frameCount = 0;
+    Frame f;
+    while (next(f)) ++frameCount;
+    fseek(file, 5, SEEK_SET);
+    return true;
+}
+
+bool InputLog::next(Frame& frame) {
+    if (!file || writing) return false;
+    unsigned char rec[13];
+    if (fread(rec, 1, 5, file) != 5) return false;
+    frame.deltaTime = getFloat(rec);
+    frame.keys = rec[4] & ~MOUSE_BIT;
+    frame.mouseX = frame.mouseY = 0.0f;
+    if (rec[4] & MOUSE_BIT) {
+        if (fread(rec + 5, 1, 8, file) != 8) return false;
+        frame.mouseX = getFloat(rec + 5);
+        frame.mouseY = getFloat(rec + 9);
+    }
+    return true;
+}
+
+void InputLog::close() {
+    if (!file) return;
+    fclose(file);
+    file = nullptr;
+    if (writing) printf("[INPUT] recorded %d frames\n", frameCount);
+    writing = false;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+// Per-frame input of a session, recorded to a small binary file and played
+// back later so two builds can be timed on exactly the same walk.
+//
+// File: "GAIN", a version byte, then one record per frame:
+//   float deltaTime, uint8 flags (bit k: key k held, bit 6: mouse moved)
+//   and, only when the mouse moved, float mouseX, mouseY
+// Floats are stored as their little-endian bit patterns, so a replay sees
+// the same values bit for bit and most frames take 5 bytes.
+class InputLog {
+public:
+    enum Key { W, A, S, D, E, F, KEY_COUNT };
+
+    struct Frame {
+        float deltaTime = 0.0f;
+        unsigned char keys = 0;             // bit per Key
+        float mouseX = 0.0f, mouseY = 0.0f; // look offsets before sensitivity
+        bool down(Key k) const { return (keys >> k & 1) != 0; }
+    };
+
+    ~InputLog();
+
+    bool record(const std::string& path);
+    void append(const Frame& frame);
+
+    bool replay(const std::string& path);
+    // false once the log is exhausted
+    bool next(Frame& frame);
+
+    void close();
+    // frames recorded so far, or all frames of the replayed log
+    int frames() const { return frameCount; }
+
+private:
+    static const int VERSION = 1;
+    static const unsigned char MOUSE_BIT = 1 << 6;
+
+    FILE* file = nullptr;
+    bool writing = false;
+    int frameCount = 0;
+};
@@ -0,0 +1,90 @@
+#include "job_pool.h"
+#include "trace.h"
+#include <algorithm>
+
+JobPool::JobPool(int threads) {
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int w = 0; w < threads; ++w) queues.emplace_back(new Queue());
+    for (int w = 1; w < threads; ++w) this->threads.emplace_back(&JobPool::workerLoop, this, w);
+}
+
+JobPool::~JobPool() {
+    {
+        std::lock_guard<std::mutex> l(wakeLock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void JobPool::run(int count, const std::function<void(int, int)>& job) {
+    if (count <= 0) return;
+    current = &job;
+    remaining = count;
+    total += count;
+    int n = workerCount();
+    for (int w = 0; w < n; ++w) {
+        std::lock_guard<std::mutex> l(queues[w]->lock);
+        for (int i = (int)((long long)count * w / n); i < (int)((long long)count * (w + 1) / n); ++i)
+            queues[w]->jobs.push_back(i);
+    }
+    {
+        std::lock_guard<std::mutex> l(wakeLock);
+        ++generation;
+    }
+    wake.notify_all();
+
+    work(0);
+    std::unique_lock<std::mutex> l(wakeLock);
+    done.wait(l, [&] { return remaining == 0; });
+}
+
+bool JobPool::next(int worker, int& job) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> l(own.lock);
+        if (!own.jobs.empty()) {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+    int n = workerCount();
+    for (int k = 1; k < n; ++k) {
+        Queue& victim = *queues[(worker + k) % n];
+        std::lock_guard<std::mutex> l(victim.lock);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            ++stolen;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobPool::work(int worker) {
+    int job;
+    while (next(worker, job)) {
+        TRACE_SCOPE("job");
+        (*current)(job, worker);
+        if (--remaining == 0) {
+            std::lock_guard<std::mutex> l(wakeLock);
+            done.notify_all();
+        }
+    }
+}
+
+void JobPool::workerLoop(int worker) {
+    TRACE_THREAD("job worker");
+    unsigned seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> l(wakeLock);
+            wake.wait(l, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+        }
+        work(worker);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one job deque each. run() deals the jobs
+// out in contiguous blocks, so neighbouring jobs start on the same thread;
+// a worker pops from the back of its own deque and, once that is empty,
+// steals from the front of the others. The calling thread is worker 0 and
+// works too, so a pool of one thread runs everything inline.
+class JobPool {
+public:
+    // threads <= 0: one per hardware thread
+    explicit JobPool(int threads = 0);
+    ~JobPool();
+
+    // job(index, worker) for every index in 0..count-1, returns when all
+    // are done; worker is 0..workerCount()-1, for per-thread scratch
+    void run(int count, const std::function<void(int, int)>& job);
+
+    int workerCount() const { return (int)queues.size(); }
+    // jobs run by another worker than the one they were dealt to
+    long long stolenJobs() const { return stolen; }
+    long long jobsRun() const { return total; }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<int> jobs;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex wakeLock;
+    std::condition_variable wake, done;
+    unsigned generation = 0;
+    bool quit = false;
+
+    const std::function<void(int, int)>* current = nullptr;
+    std::atomic<int> remaining{ 0 };
+    std::atomic<long long> stolen{ 0 };
+    long long total = 0;
+
+    bool next(int worker, int& job);
+    void work(int worker);
+    void workerLoop(int worker);
+};
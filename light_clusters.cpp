@@ -0,0 +1,201 @@
+#include "light_clusters.h"
+#include "gl_state.h"
+#include "trace.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+std::vector<int> shadowCasters(const std::vector<PointLight>& lights) {
+    std::vector<int> casters;
+    for (int i = 0; i < (int)lights.size() && (int)casters.size() < MAX_SHADOWED_LIGHTS; ++i)
+        if (lights[i].castsShadow) casters.push_back(i);
+    return casters;
+}
+
+float lightRange(const glm::vec3& color) {
+    // 1.25 * c / (1 + 0.35 d + 0.25 d^2) = 1/256, solved for d
+    float c = std::max(std::max(color.r, color.g), color.b);
+    float k = 1.0f - 1.25f * 256.0f * c;
+    if (k >= 0.0f) return 0.0f;
+    return (-0.35f + std::sqrt(0.35f * 0.35f - 4.0f * 0.25f * k)) / (2.0f * 0.25f);
+}
+
+LightClusters::LightClusters(int tx, int ty, int s) : tilesX(tx), tilesY(ty), slices(s) {
+    static const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+    for (int i = 0; i < 3; ++i) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        glState.bindTexture(0, GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+LightClusters::~LightClusters() {
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+}
+
+// slice 0 covers [0, zNear], slices 1.. split [zNear, zFar] exponentially
+float LightClusters::sliceDepth(int slice) const {
+    if (slice <= 0) return 0.0f;
+    return zNear * std::pow(zFar / zNear, (slice - 1) / (float)(slices - 1));
+}
+
+int LightClusters::sliceOf(float depth) const {
+    if (depth < zNear) return 0;
+    int s = 1 + (int)std::floor(std::log(depth / zNear) / std::log(zFar / zNear) * (slices - 1));
+    return std::min(s, slices - 1);
+}
+
+void LightClusters::buildClusterBounds() {
+    // tiles are whole pixels, the last column / row may hang off screen
+    int tileW = (width + tilesX - 1) / tilesX, tileH = (height + tilesY - 1) / tilesY;
+    float tanY = std::tan(fovY * 0.5f), tanX = tanY * width / (float)height;
+
+    clusterMin.assign((size_t)tilesX * tilesY * slices, glm::vec3(0.0f));
+    clusterMax = clusterMin;
+    for (int s = 0; s < slices; ++s) {
+        float d0 = sliceDepth(s), d1 = s == slices - 1 ? zFar : sliceDepth(s + 1);
+        for (int y = 0; y < tilesY; ++y)
+            for (int x = 0; x < tilesX; ++x) {
+                float nx0 = 2.0f * x * tileW / width - 1.0f, nx1 = 2.0f * (x + 1) * tileW / width - 1.0f;
+                float ny0 = 2.0f * y * tileH / height - 1.0f, ny1 = 2.0f * (y + 1) * tileH / height - 1.0f;
+                glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+                for (float d : { d0, d1 })
+                    for (float nx : { nx0, nx1 })
+                        for (float ny : { ny0, ny1 }) {
+                            glm::vec3 p(nx * tanX * d, ny * tanY * d, -d);
+                            lo = glm::min(lo, p);
+                            hi = glm::max(hi, p);
+                        }
+                size_t c = ((size_t)s * tilesY + y) * tilesX + x;
+                clusterMin[c] = lo;
+                clusterMax[c] = hi;
+            }
+    }
+}
+
+void LightClusters::update(const std::vector<PointLight>& lights, const glm::mat4& V, float fy,
+    int w, int h, float zn, float zf) {
+    TRACE_SCOPE("LightClusters::update");
+    if (w != width || h != height || fy != fovY || zn != zNear || zf != zFar) {
+        width = w; height = h; fovY = fy; zNear = zn; zFar = zf;
+        buildClusterBounds();
+    }
+
+    // light buffer; shadow slots follow shadowCasters()
+    lightTexels.clear();
+    int slot = 0;
+    for (const auto& L : lights) {
+        float shadow = -1.0f;
+        if (L.castsShadow && slot < MAX_SHADOWED_LIGHTS) shadow = (float)slot++;
+        lightTexels.push_back(glm::vec4(L.position, L.radius));
+        lightTexels.push_back(glm::vec4(L.color, shadow));
+    }
+    lightCount = (int)lights.size();
+
+    int tileW = (width + tilesX - 1) / tilesX, tileH = (height + tilesY - 1) / tilesY;
+    float tanY = std::tan(fovY * 0.5f), tanX = tanY * width / (float)height;
+
+    pairs.clear();
+    visibleLights = 0;
+    for (int li = 0; li < lightCount; ++li) {
+        glm::vec3 c = glm::vec3(V * glm::vec4(lights[li].position, 1.0f));
+        float r = lights[li].radius, depth = -c.z;
+        if (depth + r < 0.0f || depth - r > zFar) continue;
+
+        // candidate slices from the depth range, candidate tiles from the
+        // projected view-space box of the sphere (whole screen if it
+        // reaches behind the eye)
+        int s0 = sliceOf(std::max(depth - r, 0.0f)), s1 = sliceOf(std::min(depth + r, zFar));
+        int x0 = 0, x1 = tilesX - 1, y0 = 0, y1 = tilesY - 1;
+        if (depth - r > 1e-3f) {
+            float nx0 = FLT_MAX, nx1 = -FLT_MAX, ny0 = FLT_MAX, ny1 = -FLT_MAX;
+            for (float dz : { -r, r })
+                for (float dx : { -r, r })
+                    for (float dy : { -r, r }) {
+                        float d = depth + dz;
+                        float nx = (c.x + dx) / (d * tanX), ny = (c.y + dy) / (d * tanY);
+                        nx0 = std::min(nx0, nx); nx1 = std::max(nx1, nx);
+                        ny0 = std::min(ny0, ny); ny1 = std::max(ny1, ny);
+                    }
+            if (nx1 < -1.0f || nx0 > 1.0f || ny1 < -1.0f || ny0 > 1.0f) continue;
+            auto tile = [](float ndc, int size, int tileSize, int count) {
+                int t = (int)std::floor((ndc * 0.5f + 0.5f) * size / tileSize);
+                return std::max(0, std::min(count - 1, t));
+            };
+            x0 = tile(nx0, width, tileW, tilesX); x1 = tile(nx1, width, tileW, tilesX);
+            y0 = tile(ny0, height, tileH, tilesY); y1 = tile(ny1, height, tileH, tilesY);
+        }
+
+        bool any = false;
+        for (int s = s0; s <= s1; ++s)
+            for (int y = y0; y <= y1; ++y)
+                for (int x = x0; x <= x1; ++x) {
+                    size_t ci = ((size_t)s * tilesY + y) * tilesX + x;
+                    // sphere vs cluster box
+                    glm::vec3 q = glm::clamp(c, clusterMin[ci], clusterMax[ci]);
+                    if (glm::dot(q - c, q - c) > r * r) continue;
+                    pairs.push_back(glm::uvec2((GLuint)ci, (GLuint)li));
+                    any = true;
+                }
+        if (any) visibleLights++;
+    }
+
+    // counting sort of the pairs by cluster into contiguous light lists
+    size_t clusterCount = (size_t)tilesX * tilesY * slices;
+    counts.assign(clusterCount, 0);
+    for (const auto& p : pairs) counts[p.x]++;
+    clusterRanges.resize(clusterCount);
+    GLuint offset = 0;
+    for (size_t i = 0; i < clusterCount; ++i) {
+        clusterRanges[i] = glm::uvec2(offset, counts[i]);
+        offset += counts[i];
+        counts[i] = clusterRanges[i].x;
+    }
+    indices.resize(std::max<size_t>(pairs.size(), 1));
+    for (const auto& p : pairs) indices[counts[p.x]++] = p.y;
+
+    // glBufferData with the data already orphans the old store the GPU may still read
+    auto upload = [](GLuint buffer, const void* data, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+    };
+    if (lightTexels.empty()) lightTexels.push_back(glm::vec4(0.0f));
+    upload(buffers[0], lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+    upload(buffers[1], clusterRanges.data(), clusterRanges.size() * sizeof(glm::uvec2));
+    upload(buffers[2], indices.data(), indices.size() * sizeof(GLuint));
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::bind(ShaderProgram* shader, int firstUnit) {
+    static const char* samplers[3] = { "lightData", "clusterData", "lightIndices" };
+    for (int i = 0; i < 3; ++i) {
+        glState.bindTexture(firstUnit + i, GL_TEXTURE_BUFFER, textures[i]);
+        shader->setInt(samplers[i], firstUnit + i);
+    }
+    glm::ivec3 dims(tilesX, tilesY, slices);
+    glUniform3iv(shader->u("clusterDims"), 1, &dims.x);
+    int tileW = (width + tilesX - 1) / tilesX, tileH = (height + tilesY - 1) / tilesY;
+    glUniform2f(shader->u("clusterTileSize"), (float)tileW, (float)tileH);
+    // slice = 1 + floor(log(depth) * scale + bias), matching sliceOf()
+    float scale = (slices - 1) / std::log(zFar / zNear);
+    glUniform3f(shader->u("clusterDepth"), zNear, scale, -std::log(zNear) * scale);
+}
+
+void LightClusters::printStats() const {
+    int used = 0;
+    GLuint most = 0;
+    for (const auto& r : clusterRanges) {
+        if (r.y) used++;
+        most = std::max(most, r.y);
+    }
+    printf("[CLUSTERS] %dx%dx%d: %d lights, %d visible, %d of %zu clusters lit, "
+        "%.1f lights per lit cluster (max %u), %zu indices\n",
+        tilesX, tilesY, slices, lightCount, visibleLights, used, clusterRanges.size(),
+        used ? pairs.size() / (double)used : 0.0, most, pairs.size());
+}
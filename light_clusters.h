@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "shaderprogram.h"
+
+// Point light; castsShadow lights get a slot in the shadow atlas
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 color;
+    float radius; // distance at which the light stops mattering
+    bool castsShadow;
+};
+
+// distance at which the attenuation of the lit shader takes a light of this
+// color below 1/256, where the windowed falloff no longer changes its look
+float lightRange(const glm::vec3& color);
+
+// must match shadowRects[] in f_textures.glsl
+const int MAX_SHADOWED_LIGHTS = 4;
+
+// indices of the lights that own a shadow atlas slot, in slot order
+std::vector<int> shadowCasters(const std::vector<PointLight>& lights);
+
+// Clustered forward lighting. The view frustum is split into screen tiles
+// and exponential depth slices; every frame the CPU assigns each light to
+// the clusters its sphere touches and uploads three buffer textures:
+//   lightData     2 texels per light: position, radius / color, shadow slot
+//   clusterData   per cluster: first index, light count
+//   lightIndices  the light lists of all clusters back to back
+// The lit shader then only loops over the lights of its own cluster.
+class LightClusters {
+public:
+    LightClusters(int tilesX = 16, int tilesY = 9, int slices = 24);
+    ~LightClusters();
+
+    // zNear is where the first exponential slice starts, everything closer
+    // belongs to slice 0
+    void update(const std::vector<PointLight>& lights, const glm::mat4& V, float fovY,
+        int width, int height, float zNear, float zFar);
+    // bind the buffers to units firstUnit..firstUnit+2 and set the uniforms
+    void bind(ShaderProgram* shader, int firstUnit);
+
+    void printStats() const;
+
+private:
+    int tilesX, tilesY, slices;
+    int width = 0, height = 0;
+    float fovY = 0.0f, zNear = 0.0f, zFar = 0.0f;
+
+    // view-space bounds of every cluster, rebuilt when the projection changes
+    std::vector<glm::vec3> clusterMin, clusterMax;
+
+    std::vector<glm::vec4> lightTexels;
+    std::vector<glm::uvec2> clusterRanges;
+    std::vector<GLuint> indices;
+    std::vector<GLuint> counts;
+    std::vector<glm::uvec2> pairs; // (cluster, light) before the counting sort
+
+    GLuint buffers[3] = {}, textures[3] = {};
+
+    int lightCount = 0, visibleLights = 0;
+
+    float sliceDepth(int slice) const;
+    int sliceOf(float depth) const;
+    void buildClusterBounds();
+};
@@ -0,0 +1,138 @@
+// Lighting shared by the lit pass (f_textures.glsl), the bottle impostors
+// (impostor.fs) and the screen-space shadow mask (shadow_mask.fs).
+// ShaderProgram pastes it in place of #include "lighting.glsl", after the
+// #version line of each of them.
+
+uniform mat4       V;
+uniform vec3       cameraPos;
+
+// clustered lights (see light_clusters.h)
+uniform samplerBuffer  lightData;     // per light: position, radius / color, shadow slot
+uniform usamplerBuffer clusterData;   // per cluster: first index, count
+uniform usamplerBuffer lightIndices;
+uniform ivec3      clusterDims;       // tiles x, tiles y, depth slices
+uniform vec2       clusterTileSize;   // in pixels
+uniform vec3       clusterDepth;      // first slice depth, log scale, log bias
+
+uniform sampler2DShadow shadowAtlas;
+uniform vec4       shadowRects[4 * 6];  // per shadow slot and cube face: uv offset.xy, scale.zw
+uniform float      far_plane;
+uniform int        shadowTaps;   // 1, 4, 8 or 20 (see shadow_quality.h)
+
+// Progressive Poisson disk: every prefix of 4/8/20 points is well spread,
+// the first four sit on the rim and double as the penumbra probe.
+const int MAX_SAMPLES = 20;
+const vec2 poissonDisk[MAX_SAMPLES] = vec2[](
+    vec2(-0.855, -0.519), vec2( 0.808,  0.583), vec2( 0.534, -0.820), vec2(-0.546,  0.819),
+    vec2(-0.014, -0.018), vec2( 0.974, -0.202), vec2(-0.234, -0.971), vec2(-0.924,  0.180),
+    vec2( 0.178,  0.968), vec2( 0.505,  0.121), vec2(-0.309, -0.448), vec2(-0.424,  0.314),
+    vec2( 0.108,  0.468), vec2( 0.345, -0.351), vec2(-0.586, -0.100), vec2( 0.102, -0.702),
+    vec2( 0.905,  0.202), vec2( 0.820, -0.560), vec2(-0.152,  0.775), vec2(-0.577, -0.785)
+);
+
+// per-pixel rotation angle, breaks up the banding of a fixed kernel
+float interleavedGradientNoise(vec2 p)
+{
+    return fract(52.9829189 * fract(dot(p, vec2(0.06711056, 0.00583715))));
+}
+
+// Cube direction -> face index and face uv, same convention as GL cube maps
+vec3 cubeFaceUV(vec3 d)
+{
+    vec3 a = abs(d);
+    if(a.x >= a.y && a.x >= a.z)
+        return d.x > 0.0 ? vec3(0.5 * (vec2(-d.z, -d.y) / a.x + 1.0), 0.0)
+                         : vec3(0.5 * (vec2( d.z, -d.y) / a.x + 1.0), 1.0);
+    if(a.y >= a.z)
+        return d.y > 0.0 ? vec3(0.5 * (vec2( d.x,  d.z) / a.y + 1.0), 2.0)
+                         : vec3(0.5 * (vec2( d.x, -d.z) / a.y + 1.0), 3.0);
+    return d.z > 0.0 ? vec3(0.5 * (vec2( d.x, -d.y) / a.z + 1.0), 4.0)
+                     : vec3(0.5 * (vec2(-d.x, -d.y) / a.z + 1.0), 5.0);
+}
+
+// cluster of this fragment: screen tile plus exponential depth slice
+int clusterIndex(vec3 worldPos)
+{
+    float depth = -(V * vec4(worldPos, 1.0)).z;
+    int slice = depth < clusterDepth.x ? 0
+              : 1 + int(floor(log(depth) * clusterDepth.y + clusterDepth.z));
+    ivec2 tile = ivec2(gl_FragCoord.xy / clusterTileSize);
+    ivec3 c = clamp(ivec3(tile, slice), ivec3(0), clusterDims - 1);
+    return (c.z * clusterDims.y + c.y) * clusterDims.x + c.x;
+}
+
+// Blinn-Phong of one light, attenuated and faded to zero at its radius so
+// the cluster cut-off is invisible; lightmap.cpp and soft_raster.cpp use
+// the same curve
+struct LightTerms {
+    vec3 ambient, diffuse, specular;
+};
+LightTerms blinnPhong(vec3 LP, vec3 LC, float radius, vec3 fragPos, vec3 norm, vec3 viewDir)
+{
+    vec3 L     = normalize(LP - fragPos);
+    float diff = max(dot(norm, L), 0.0);
+    float spec = pow(max(dot(norm, normalize(L + viewDir)), 0.0), 64.0);
+
+    float dist  = length(LP - fragPos);
+    float atten = 1.25 / (1.0 + 0.35 * dist + 0.25 * dist * dist);
+    float fade  = clamp(1.0 - pow(dist / radius, 4.0), 0.0, 1.0);
+    atten *= fade * fade;
+
+    LightTerms t;
+    t.ambient  = 0.15 * atten * LC;
+    t.diffuse  = diff * atten * LC;
+    t.specular = 0.3 * spec * atten * LC;
+    return t;
+}
+
+// Hardware-compared atlas lookup: returns the lit fraction of a 2x2 bilinear
+// footprint, clamped half a texel inside the face so it never reads a neighbour
+float shadowTap(int light, vec3 dir, float refDepth)
+{
+    vec3 f    = cubeFaceUV(dir);
+    vec4 rect = shadowRects[light * 6 + int(f.z)];
+    vec2 halfTexel = 0.5 / (rect.zw * vec2(textureSize(shadowAtlas, 0)));
+    vec2 uv   = clamp(f.xy, halfTexel, 1.0 - halfTexel);
+    return texture(shadowAtlas, vec3(rect.xy + uv * rect.zw, refDepth));
+}
+
+// Shadow of a point light at fragPos, 0 = lit: shadowTaps taps of the
+// Poisson disk, stopping after the rim taps outside the penumbra
+float ShadowCalculation(int light, vec3 fragPos, vec3 lightPos)
+{
+    vec3 fragToLight = fragPos - lightPos;
+    float currentDepth = length(fragToLight);
+
+    float bias     = 0.05;
+    float refDepth = (currentDepth - bias) / far_plane;
+
+    if(shadowTaps <= 1)
+        return 1.0 - shadowTap(light, fragToLight, refDepth);
+
+    // scale filter radius by view distance
+    float viewDist   = length(cameraPos - fragPos);
+    float diskRadius = (1.0 + viewDist / far_plane) / 25.0 * 1.5;
+
+    // disk basis perpendicular to the lookup direction, rotated per pixel
+    vec3 dir  = fragToLight / currentDepth;
+    vec3 up   = abs(dir.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+    vec3 T    = normalize(cross(up, dir));
+    vec3 B    = cross(dir, T);
+    float ang = 6.2831853 * interleavedGradientNoise(gl_FragCoord.xy);
+    vec2 cs   = vec2(cos(ang), sin(ang));
+    T = (T * cs.x + B * cs.y) * diskRadius;
+    B = cross(dir, T);
+
+    // penumbra probe: if the four rim taps agree the fragment is fully lit
+    // or fully shadowed and the inner taps cannot change the result
+    float lit = 0.0;
+    for(int i = 0; i < 4; ++i)
+        lit += shadowTap(light, fragToLight + T * poissonDisk[i].x + B * poissonDisk[i].y, refDepth);
+    if(shadowTaps <= 4 || lit < 0.001 || lit > 3.999)
+        return 1.0 - lit * 0.25;
+
+    int taps = min(shadowTaps, MAX_SAMPLES);
+    for(int i = 4; i < taps; ++i)
+        lit += shadowTap(light, fragToLight + T * poissonDisk[i].x + B * poissonDisk[i].y, refDepth);
+    return 1.0 - lit / float(taps);
+}
@@ -0,0 +1,522 @@
+#include "lightmap.h"
+#include "gl_state.h"
+#include "lodepng.h"
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <thread>
+
+// RGBM: rgb * a * RGBM_RANGE, enough headroom for the lamps' hot spots
+static const float RGBM_RANGE = 4.0f;
+// ray origins leave the surface by this much along its face normal
+static const float SURFACE_OFFSET = 1e-3f;
+// shadow rays stop this short of the light, like the bias of the shadow maps
+static const float SHADOW_BIAS = 0.05f;
+
+Lightmap::Lightmap(int size) : atlasSize(std::min(std::max(size, 64), MAX_SIZE)) {}
+
+Lightmap::~Lightmap() {
+    glDeleteTextures(1, &textureID);
+}
+
+// ------------------------------------------------------------- unwrap
+
+bool Lightmap::unwrap(const std::vector<glm::vec3>& srcPositions, const std::vector<glm::vec3>& srcNormals,
+    const std::vector<int>& group, std::vector<unsigned int>& indices, std::vector<unsigned int>& remap) {
+    int triCount = (int)(indices.size() / 3);
+
+    // weld by position, the loader splits vertices on every uv and normal seam
+    std::map<std::array<long long, 3>, int> weldOf;
+    std::vector<int> weld(srcPositions.size());
+    for (size_t i = 0; i < srcPositions.size(); ++i) {
+        glm::vec3 q = glm::round(srcPositions[i] * 1e5f);
+        weld[i] = weldOf.insert({ { (long long)q.x, (long long)q.y, (long long)q.z }, (int)weldOf.size() }).first->second;
+    }
+
+    // signed dominant axis of every face: 0..5 = +x -x +y -y +z -z, on the
+    // side the vertex normals point to
+    std::vector<int> faceAxis(triCount);
+    for (int t = 0; t < triCount; ++t) {
+        const glm::vec3& a = srcPositions[indices[t * 3]];
+        glm::vec3 n = glm::cross(srcPositions[indices[t * 3 + 1]] - a, srcPositions[indices[t * 3 + 2]] - a);
+        glm::vec3 side = srcNormals[indices[t * 3]] + srcNormals[indices[t * 3 + 1]] + srcNormals[indices[t * 3 + 2]];
+        if (glm::dot(n, side) < 0.0f) n = -n;
+        glm::vec3 m = glm::abs(n);
+        int axis = m.x >= m.y && m.x >= m.z ? 0 : m.y >= m.z ? 1 : 2;
+        faceAxis[t] = axis * 2 + (n[axis] < 0.0f ? 1 : 0);
+    }
+
+    // charts: flood over shared welded edges between faces of one object
+    // and one signed axis
+    std::map<std::pair<int, int>, std::vector<int>> edgeFaces;
+    for (int t = 0; t < triCount; ++t)
+        for (int k = 0; k < 3; ++k) {
+            int a = weld[indices[t * 3 + k]], b = weld[indices[t * 3 + (k + 1) % 3]];
+            edgeFaces[{ std::min(a, b), std::max(a, b) }].push_back(t);
+        }
+    std::vector<int> chartOf(triCount, -1);
+    struct Chart {
+        int axis;
+        std::vector<int> faces;
+        glm::vec2 lo = glm::vec2(1e30f), hi = glm::vec2(-1e30f);
+        glm::ivec2 origin, extent; // packed rectangle in texels, gutter included
+    };
+    std::vector<Chart> charts;
+    std::vector<int> queue;
+    for (int seed = 0; seed < triCount; ++seed) {
+        if (chartOf[seed] >= 0) continue;
+        Chart chart;
+        chart.axis = faceAxis[seed];
+        chartOf[seed] = (int)charts.size();
+        queue.assign(1, seed);
+        while (!queue.empty()) {
+            int t = queue.back();
+            queue.pop_back();
+            chart.faces.push_back(t);
+            for (int k = 0; k < 3; ++k) {
+                int a = weld[indices[t * 3 + k]], b = weld[indices[t * 3 + (k + 1) % 3]];
+                for (int n : edgeFaces[{ std::min(a, b), std::max(a, b) }])
+                    if (chartOf[n] < 0 && faceAxis[n] == chart.axis && group[n] == group[seed]) {
+                        chartOf[n] = chartOf[seed];
+                        queue.push_back(n);
+                    }
+            }
+        }
+        charts.push_back(chart);
+    }
+
+    // flat projection along the chart's axis, in metres
+    auto project = [](const glm::vec3& p, int axis) {
+        int a = axis / 2;
+        return glm::vec2(p[(a + 1) % 3], p[(a + 2) % 3]);
+    };
+    float area = 0.0f;
+    for (auto& c : charts) {
+        for (int t : c.faces)
+            for (int k = 0; k < 3; ++k) {
+                glm::vec2 p = project(srcPositions[indices[t * 3 + k]], c.axis);
+                c.lo = glm::min(c.lo, p);
+                c.hi = glm::max(c.hi, p);
+            }
+        area += (c.hi.x - c.lo.x) * (c.hi.y - c.lo.y);
+    }
+
+    // shelf packing, tallest first; shrink the texel density until it fits,
+    // a bigger atlas once the gutters alone no longer do
+    std::vector<int> order(charts.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = (int)i;
+    float density = std::sqrt(0.8f * atlasSize * atlasSize / std::max(area, 1e-6f));
+    for (int attempt = 0;; ++attempt, density *= 0.92f) {
+        for (auto& c : charts)
+            c.extent = glm::ivec2(glm::ceil((c.hi - c.lo) * density)) + 2 * padding;
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            return charts[a].extent.y != charts[b].extent.y ? charts[a].extent.y > charts[b].extent.y : a < b;
+        });
+        int x = 0, y = 0, shelf = 0;
+        bool fits = true;
+        for (int i : order) {
+            Chart& c = charts[i];
+            if (x + c.extent.x > atlasSize) { x = 0; y += shelf; shelf = 0; }
+            if (c.extent.x > atlasSize || y + c.extent.y > atlasSize) { fits = false; break; }
+            c.origin = glm::ivec2(x, y);
+            x += c.extent.x;
+            shelf = std::max(shelf, c.extent.y);
+        }
+        if (fits) break;
+        if (attempt == 100) {
+            if (atlasSize * 2 > MAX_SIZE) {
+                fprintf(stderr, "[LIGHTMAP] %zu charts do not fit a %d atlas\n", charts.size(), atlasSize);
+                return false;
+            }
+            fprintf(stderr, "[LIGHTMAP] %zu charts do not fit a %d atlas, trying %d\n",
+                charts.size(), atlasSize, atlasSize * 2);
+            atlasSize *= 2;
+            density = std::sqrt(0.8f * atlasSize * atlasSize / std::max(area, 1e-6f)) / 0.92f;
+            attempt = -1;
+        }
+    }
+
+    // split vertices per chart and place them in the atlas
+    std::map<std::pair<unsigned int, int>, unsigned int> splitOf;
+    remap.clear();
+    positions.clear();
+    normals.clear();
+    uv.clear();
+    for (int t = 0; t < triCount; ++t) {
+        const Chart& c = charts[chartOf[t]];
+        for (int k = 0; k < 3; ++k) {
+            unsigned int src = indices[t * 3 + k];
+            auto it = splitOf.find({ src, chartOf[t] });
+            if (it == splitOf.end()) {
+                it = splitOf.insert({ { src, chartOf[t] }, (unsigned int)remap.size() }).first;
+                remap.push_back(src);
+                positions.push_back(srcPositions[src]);
+                normals.push_back(srcNormals[src]);
+                glm::vec2 texel = glm::vec2(c.origin + padding) + (project(srcPositions[src], c.axis) - c.lo) * density;
+                uv.push_back(texel / (float)atlasSize);
+            }
+            indices[t * 3 + k] = it->second;
+        }
+    }
+    triangleIndices = indices;
+    printf("[LIGHTMAP] %d triangles in %zu charts, %.0f texels per metre, %zu -> %zu vertices\n",
+        triCount, charts.size(), density, srcPositions.size(), remap.size());
+    return true;
+}
+
+// ------------------------------------------------------------- bake
+
+namespace {
+// one covered texel: where it is on the surface
+struct Sample {
+    glm::vec3 position, normal, face;
+    int texel;
+};
+
+// per-texel stratified sequence: Hammersley points shifted by a random offset
+float radicalInverse(unsigned int i) {
+    i = (i << 16) | (i >> 16);
+    i = ((i & 0x55555555u) << 1) | ((i & 0xAAAAAAAAu) >> 1);
+    i = ((i & 0x33333333u) << 2) | ((i & 0xCCCCCCCCu) >> 2);
+    i = ((i & 0x0F0F0F0Fu) << 4) | ((i & 0xF0F0F0F0u) >> 4);
+    i = ((i & 0x00FF00FFu) << 8) | ((i & 0xFF00FF00u) >> 8);
+    return i * 2.3283064e-10f;
+}
+float hashToUnit(unsigned int x) {
+    x ^= x >> 16; x *= 0x7FEB352Du;
+    x ^= x >> 15; x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// cosine-weighted direction around n
+glm::vec3 cosineDirection(const glm::vec3& n, float u1, float u2) {
+    float s = n.z >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (s + n.z), b = n.x * n.y * a;
+    glm::vec3 t(1.0f + s * n.x * n.x * a, s * b, -s * n.x);
+    glm::vec3 bt(b, s + n.y * n.y * a, -n.y);
+    float r = std::sqrt(u1), phi = 6.2831853f * u2;
+    return t * (r * std::cos(phi)) + bt * (r * std::sin(phi)) + n * std::sqrt(std::max(0.0f, 1.0f - u1));
+}
+}
+
+void Lightmap::bake(const std::vector<PointLight>& lights, int samples) {
+    auto start = std::chrono::high_resolution_clock::now();
+    TriangleBvh bvh;
+    bvh.build(positions, triangleIndices);
+    int triCount = (int)(triangleIndices.size() / 3);
+    albedo.resize(triCount, glm::vec3(0.5f));
+
+    // texel centers inside each triangle; a sliver that covers no center
+    // still gets the texel under its centroid
+    std::vector<Sample> work;
+    std::vector<int> owner((size_t)atlasSize * atlasSize, -1);
+    for (int t = 0; t < triCount; ++t) {
+        unsigned int i0 = triangleIndices[t * 3], i1 = triangleIndices[t * 3 + 1], i2 = triangleIndices[t * 3 + 2];
+        glm::vec2 a = uv[i0] * (float)atlasSize, b = uv[i1] * (float)atlasSize, c = uv[i2] * (float)atlasSize;
+        glm::vec3 face = glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]);
+        if (glm::dot(face, face) <= 0.0f) continue;
+        face = glm::normalize(face);
+        float det = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (std::fabs(det) < 1e-12f) continue;
+        auto add = [&](int x, int y, float wb, float wc) {
+            int texel = y * atlasSize + x;
+            if (owner[texel] >= 0) return;
+            owner[texel] = t;
+            float wa = 1.0f - wb - wc;
+            glm::vec3 n = normals[i0] * wa + normals[i1] * wb + normals[i2] * wc;
+            n = glm::dot(n, n) > 0.0f ? glm::normalize(n) : face;
+            // the vertex normals say which side is the outside, whatever the winding
+            glm::vec3 f = glm::dot(face, n) < 0.0f ? -face : face;
+            work.push_back({ positions[i0] * wa + positions[i1] * wb + positions[i2] * wc, n, f, texel });
+        };
+        glm::ivec2 lo = glm::clamp(glm::ivec2(glm::floor(glm::min(a, glm::min(b, c)))), 0, atlasSize - 1);
+        glm::ivec2 hi = glm::clamp(glm::ivec2(glm::ceil(glm::max(a, glm::max(b, c)))), 0, atlasSize - 1);
+        bool covered = false;
+        for (int y = lo.y; y <= hi.y; ++y)
+            for (int x = lo.x; x <= hi.x; ++x) {
+                glm::vec2 p(x + 0.5f, y + 0.5f);
+                float wb = ((p.x - a.x) * (c.y - a.y) - (p.y - a.y) * (c.x - a.x)) / det;
+                float wc = ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / det;
+                if (wb < -1e-4f || wc < -1e-4f || wb + wc > 1.0f + 1e-4f) continue;
+                add(x, y, wb, wc);
+                covered = true;
+            }
+        if (!covered) {
+            glm::ivec2 q = glm::clamp(glm::ivec2((a + b + c) / 3.0f), 0, atlasSize - 1);
+            add(q.x, q.y, 1.0f / 3.0f, 1.0f / 3.0f);
+        }
+    }
+
+    // the diffuse light of f_textures.glsl: returns the unshadowed diffuse
+    // term and adds the ambient term to ambient
+    auto lightTerm = [](const PointLight& L, const glm::vec3& p, const glm::vec3& n, glm::vec3& dir,
+        float& dist, glm::vec3& ambient) {
+        glm::vec3 d = L.position - p;
+        dist = glm::length(d);
+        dir = d / std::max(dist, 1e-6f);
+        float atten = 1.25f / (1.0f + 0.35f * dist + 0.25f * dist * dist);
+        float fade = glm::clamp(1.0f - std::pow(dist / L.radius, 4.0f), 0.0f, 1.0f);
+        atten *= fade * fade;
+        ambient += 0.15f * L.color * atten;
+        return std::max(glm::dot(n, dir), 0.0f) * L.color * atten;
+    };
+
+    // direct light at up to four points, shadow rays as one packet per light
+    auto direct4 = [&](const glm::vec3* p, const glm::vec3* n, const glm::vec3* face, int lanes,
+        glm::vec3* diffuse, glm::vec3* ambient, long long& rays) {
+        for (int k = 0; k < 4; ++k) diffuse[k] = ambient[k] = glm::vec3(0.0f);
+        for (const PointLight& L : lights) {
+            RayPacket packet;
+            glm::vec3 term[4];
+            for (int k = 0; k < 4; ++k) {
+                glm::vec3 dir(0.0f, 1.0f, 0.0f);
+                float dist = 0.0f;
+                term[k] = k < lanes ? lightTerm(L, p[k], n[k], dir, dist, ambient[k]) : glm::vec3(0.0f);
+                glm::vec3 o = k < lanes ? p[k] + face[k] * SURFACE_OFFSET : glm::vec3(0.0f);
+                packet.ox[k] = o.x; packet.oy[k] = o.y; packet.oz[k] = o.z;
+                packet.dx[k] = dir.x; packet.dy[k] = dir.y; packet.dz[k] = dir.z;
+                bool lit = term[k].x + term[k].y + term[k].z > 0.0f;
+                packet.tMax[k] = L.castsShadow && lit ? dist - SHADOW_BIAS : 0.0f;
+                rays += packet.tMax[k] > 0.0f;
+            }
+            int blocked = bvh.occluded(packet);
+            for (int k = 0; k < lanes; ++k)
+                if (!(blocked >> k & 1)) diffuse[k] += term[k];
+        }
+    };
+
+    std::vector<glm::vec3> lit((size_t)atlasSize * atlasSize, glm::vec3(0.0f));
+    std::vector<glm::vec3> bounce((size_t)atlasSize * atlasSize, glm::vec3(0.0f));
+    std::vector<char> valid((size_t)atlasSize * atlasSize, 0);
+    std::atomic<int> next(0);
+    std::atomic<long long> rayTotal(0);
+    const int CHUNK = 64;
+
+    auto worker = [&]() {
+        long long rays = 0;
+        for (;;) {
+            int begin = next.fetch_add(CHUNK);
+            if (begin >= (int)work.size()) break;
+            int end = std::min(begin + CHUNK, (int)work.size());
+            for (int first = begin; first < end; first += 4) {
+                int lanes = std::min(4, end - first);
+                const Sample* s = &work[first];
+                glm::vec3 p[4], n[4], f[4], diffuse[4], ambient[4], indirect[4];
+                for (int k = 0; k < 4; ++k) {
+                    const Sample& src = s[std::min(k, lanes - 1)];
+                    p[k] = src.position; n[k] = src.normal; f[k] = src.face;
+                    indirect[k] = glm::vec3(0.0f);
+                }
+                direct4(p, n, f, lanes, diffuse, ambient, rays);
+
+                // one bounce: what the surfaces seen along cosine rays reflect
+                for (int i = 0; i < samples; ++i) {
+                    RayPacket packet;
+                    glm::vec3 dirs[4];
+                    for (int k = 0; k < 4; ++k) {
+                        unsigned int texel = (unsigned int)s[std::min(k, lanes - 1)].texel;
+                        float u1 = std::fmod((i + 0.5f) / samples + hashToUnit(texel * 2u), 1.0f);
+                        float u2 = std::fmod(radicalInverse((unsigned int)i) + hashToUnit(texel * 2u + 1u), 1.0f);
+                        dirs[k] = cosineDirection(n[k], u1, u2);
+                        // a shading normal may tip the ray under the face
+                        if (glm::dot(dirs[k], f[k]) <= 0.0f) dirs[k] = glm::reflect(dirs[k], f[k]);
+                        glm::vec3 o = p[k] + f[k] * SURFACE_OFFSET;
+                        packet.ox[k] = o.x; packet.oy[k] = o.y; packet.oz[k] = o.z;
+                        packet.dx[k] = dirs[k].x; packet.dy[k] = dirs[k].y; packet.dz[k] = dirs[k].z;
+                        packet.tMax[k] = k < lanes ? 100.0f : 0.0f;
+                    }
+                    bvh.intersect(packet);
+                    rays += lanes;
+
+                    glm::vec3 hp[4], hn[4], hf[4], hitDiffuse[4], hitAmbient[4];
+                    int hits = 0, hitLane[4];
+                    for (int k = 0; k < lanes; ++k) {
+                        int t = packet.triangle[k];
+                        if (t < 0) continue;
+                        unsigned int i0 = triangleIndices[t * 3], i1 = triangleIndices[t * 3 + 1], i2 = triangleIndices[t * 3 + 2];
+                        glm::vec3 face = glm::normalize(glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]));
+                        float u = packet.u[k], v = packet.v[k];
+                        glm::vec3 hitN = normals[i0] * (1.0f - u - v) + normals[i1] * u + normals[i2] * v;
+                        hitN = glm::dot(hitN, hitN) > 0.0f ? glm::normalize(hitN) : face;
+                        if (glm::dot(face, hitN) < 0.0f) face = -face;
+                        // the back of a surface reflects nothing, light must not leak through
+                        if (glm::dot(face, dirs[k]) > 0.0f) continue;
+                        hp[hits] = positions[i0] * (1.0f - u - v) + positions[i1] * u + positions[i2] * v;
+                        hn[hits] = hitN;
+                        hf[hits] = face;
+                        hitLane[hits++] = k;
+                    }
+                    if (!hits) continue;
+                    direct4(hp, hn, hf, hits, hitDiffuse, hitAmbient, rays);
+                    for (int h = 0; h < hits; ++h) {
+                        int k = hitLane[h];
+                        indirect[k] += albedo[packet.triangle[k]] * hitDiffuse[h];
+                    }
+                }
+                for (int k = 0; k < lanes; ++k) {
+                    int texel = s[k].texel;
+                    lit[texel] = ambient[k] + diffuse[k];
+                    bounce[texel] = samples > 0 ? indirect[k] / (float)samples : glm::vec3(0.0f);
+                    valid[texel] = 1;
+                }
+            }
+        }
+        rayTotal += rays;
+    };
+    int threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; ++i) threads.emplace_back(worker);
+    worker();
+    for (auto& th : threads) th.join();
+
+    // the bounce is the noisy part: 3x3 mean over valid texels, charts are
+    // 2 * padding texels apart so they never blend
+    texels.assign((size_t)atlasSize * atlasSize, glm::vec3(0.0f));
+    for (int y = 0; y < atlasSize; ++y)
+        for (int x = 0; x < atlasSize; ++x) {
+            int i = y * atlasSize + x;
+            if (!valid[i]) continue;
+            glm::vec3 sum(0.0f);
+            int count = 0;
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int qx = x + dx, qy = y + dy;
+                    if (qx < 0 || qy < 0 || qx >= atlasSize || qy >= atlasSize) continue;
+                    int q = qy * atlasSize + qx;
+                    if (valid[q]) { sum += bounce[q]; count++; }
+                }
+            texels[i] = lit[i] + sum / (float)count;
+        }
+
+    // grow every chart into its gutter so bilinear lookups at the edges
+    // never read an empty texel
+    std::vector<glm::vec3> grown;
+    std::vector<char> grownValid;
+    for (int pass = 0; pass < padding; ++pass) {
+        grown = texels;
+        grownValid = valid;
+        for (int y = 0; y < atlasSize; ++y)
+            for (int x = 0; x < atlasSize; ++x) {
+                int i = y * atlasSize + x;
+                if (valid[i]) continue;
+                glm::vec3 sum(0.0f);
+                int count = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int qx = x + dx, qy = y + dy;
+                        if (qx < 0 || qy < 0 || qx >= atlasSize || qy >= atlasSize) continue;
+                        int q = qy * atlasSize + qx;
+                        if (valid[q]) { sum += texels[q]; count++; }
+                    }
+                if (count) { grown[i] = sum / (float)count; grownValid[i] = 1; }
+            }
+        texels.swap(grown);
+        valid.swap(grownValid);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    printf("[LIGHTMAP] baked %dx%d: %zu texels, %d bounce samples, BVH %d nodes, %.1f M rays in %.1f s "
+        "(%.2f M rays/s, %d threads)\n", atlasSize, atlasSize, work.size(), samples, bvh.nodeCount(),
+        rayTotal / 1e6, seconds, rayTotal / 1e6 / std::max(seconds, 1e-6), threadCount);
+    upload();
+}
+
+// ------------------------------------------------------------- storage
+
+// PNG text chunk keyword of the bake hash
+static const char* HASH_KEY = "LightmapHash";
+
+unsigned long long Lightmap::bakeHash(const std::vector<PointLight>& lights, int samples) const {
+    // FNV-1a, like the mesh LOD cache
+    unsigned long long h = 14695981039346656037ull;
+    auto mix = [&h](const void* data, size_t bytes) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < bytes; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    };
+    mix(&atlasSize, sizeof(atlasSize));
+    mix(&samples, sizeof(samples));
+    mix(positions.data(), positions.size() * sizeof(glm::vec3));
+    mix(normals.data(), normals.size() * sizeof(glm::vec3));
+    mix(triangleIndices.data(), triangleIndices.size() * sizeof(unsigned int));
+    mix(albedo.data(), albedo.size() * sizeof(glm::vec3));
+    // field by field, the padding after castsShadow is not initialized
+    for (const PointLight& l : lights) {
+        unsigned char shadowed = l.castsShadow ? 1 : 0;
+        mix(&l.position, sizeof(l.position));
+        mix(&l.color, sizeof(l.color));
+        mix(&l.radius, sizeof(l.radius));
+        mix(&shadowed, 1);
+    }
+    return h;
+}
+
+bool Lightmap::load(const std::string& path, unsigned long long hash) {
+    std::vector<unsigned char> png, rgbm;
+    unsigned w = 0, h = 0, error = lodepng::load_file(png, path);
+    lodepng::State state;
+    if (!error) {
+        TRACE_SCOPE("lodepng::decode");
+        error = lodepng::decode(rgbm, w, h, state, png);
+    }
+    if (error || (int)w != atlasSize || (int)h != atlasSize) return false;
+    unsigned long long fileHash = 0;
+    for (size_t i = 0; i < state.info_png.text_num; ++i)
+        if (std::string(state.info_png.text_keys[i]) == HASH_KEY)
+            fileHash = std::strtoull(state.info_png.text_strings[i], nullptr, 16);
+    if (fileHash != hash) {
+        printf("[LIGHTMAP] %s was baked from another scene or sample count\n", path.c_str());
+        return false;
+    }
+    texels.resize((size_t)w * h);
+    for (size_t i = 0; i < texels.size(); ++i) {
+        const unsigned char* c = &rgbm[i * 4];
+        texels[i] = glm::vec3(c[0], c[1], c[2]) / 255.0f * (c[3] / 255.0f * RGBM_RANGE);
+    }
+    printf("[LIGHTMAP] loaded %s\n", path.c_str());
+    upload();
+    return true;
+}
+
+bool Lightmap::save(const std::string& path, unsigned long long hash) const {
+    std::vector<unsigned char> rgbm(texels.size() * 4);
+    for (size_t i = 0; i < texels.size(); ++i) {
+        glm::vec3 c = glm::max(texels[i], glm::vec3(0.0f));
+        float m = std::max(std::max(c.r, c.g), c.b) / RGBM_RANGE;
+        m = std::ceil(glm::clamp(m, 1.0f / 255.0f, 1.0f) * 255.0f) / 255.0f;
+        glm::vec3 q = glm::clamp(c / (m * RGBM_RANGE), 0.0f, 1.0f);
+        rgbm[i * 4 + 0] = (unsigned char)std::lround(q.r * 255.0f);
+        rgbm[i * 4 + 1] = (unsigned char)std::lround(q.g * 255.0f);
+        rgbm[i * 4 + 2] = (unsigned char)std::lround(q.b * 255.0f);
+        rgbm[i * 4 + 3] = (unsigned char)std::lround(m * 255.0f);
+    }
+    char hashText[17];
+    snprintf(hashText, sizeof(hashText), "%016llx", hash);
+    lodepng::State state;
+    std::vector<unsigned char> png;
+    unsigned error = lodepng_add_text(&state.info_png, HASH_KEY, hashText);
+    if (!error) error = lodepng::encode(png, rgbm, atlasSize, atlasSize, state);
+    if (!error) error = lodepng::save_file(png, path);
+    if (error) {
+        fprintf(stderr, "[LIGHTMAP] cannot write %s: %s\n", path.c_str(), lodepng_error_text(error));
+        return false;
+    }
+    printf("[LIGHTMAP] saved %s\n", path.c_str());
+    return true;
+}
+
+void Lightmap::upload() {
+    if (!textureID) glGenTextures(1, &textureID);
+    glState.bindTexture(UNIT, GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, atlasSize, atlasSize, 0, GL_RGB, GL_FLOAT, texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "bvh.h"
+#include "light_clusters.h"
+
+// Baked diffuse lighting of the static room.
+//
+// unwrap() charts the static batch: triangles of one object that are
+// connected and face the same signed axis form a chart, projected flat
+// along that axis and shelf-packed into one size x size atlas with a
+// gutter around every chart. Vertices on chart seams are split.
+//
+// bake() then lights every covered texel on the CPU: direct light from each
+// point light with ray-traced visibility (shadowed lights only, as at run
+// time) plus one bounce of indirect light gathered with cosine-weighted
+// rays. Rays run through a TriangleBvh in packets of four, texels are
+// spread over all hardware threads. The light model is the one of
+// f_textures.glsl without the specular term, so baked and real-time
+// surfaces match.
+//
+// The result is stored as an RGBM encoded PNG and uploaded as RGB16F. The
+// PNG carries the hash of everything the bake read in a text chunk, so a
+// saved lightmap is only used while the room, the lights and the sample
+// count are the ones it was baked with.
+class Lightmap {
+public:
+    explicit Lightmap(int size = 512);
+    ~Lightmap();
+
+    // group[t]: object of triangle t, charts never span two objects.
+    // Splits vertices along chart seams: indices are rewritten and remap[i]
+    // is the source vertex of new vertex i. An atlas the charts do not fit
+    // is doubled up to MAX_SIZE; false, with indices untouched, if even
+    // that is too small
+    bool unwrap(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+        const std::vector<int>& group, std::vector<unsigned int>& indices, std::vector<unsigned int>& remap);
+    // atlas coordinates of the new vertices, 0..1
+    const std::vector<glm::vec2>& coords() const { return uv; }
+
+    // diffuse color of every triangle, for the bounce
+    void setAlbedo(const std::vector<glm::vec3>& perTriangle) { albedo = perTriangle; }
+    void bake(const std::vector<PointLight>& lights, int samples);
+
+    // of the unwrapped geometry, the albedo, the lights, the sample count
+    // and the atlas size: what bake() would produce
+    unsigned long long bakeHash(const std::vector<PointLight>& lights, int samples) const;
+    // false when the file is missing or its hash is not the given one
+    bool load(const std::string& path, unsigned long long hash);
+    bool save(const std::string& path, unsigned long long hash) const;
+
+    GLuint texture() const { return textureID; }
+    int size() const { return atlasSize; }
+    static const int MAX_SIZE = 4096;
+
+    // texture unit the lit shader reads the lightmap from
+    static const int UNIT = 11;
+
+private:
+    int atlasSize;
+    int padding = 2;
+    std::vector<glm::vec3> positions, normals; // per split vertex
+    std::vector<glm::vec2> uv;
+    std::vector<unsigned int> triangleIndices; // after the split
+    std::vector<glm::vec3> albedo;
+    std::vector<glm::vec3> texels; // lighting, size x size
+    GLuint textureID = 0;
+
+    void upload();
+};
@@ -11,21 +11,60 @@
 #include <vector>
 #include <array>
 #include <string>
+#include <algorithm>
 #include "constants.h"
 #include "lodepng.h"
 #include "shaderprogram.h"
 #include "model.h"
+#include "shadow_quality.h"
+#include "shadow_atlas.h"
+#include "static_batch.h"
+#include "render_queue.h"
+#include "gl_state.h"
+#include "transform_store.h"
+#include "transform_kernels.h"
+#include "light_clusters.h"
+#include "overdraw_counter.h"
+#include "shadow_mask.h"
+#include "gpu_culling.h"
+#include "hiz_buffer.h"
+#include "portal_cells.h"
+#include "impostor.h"
+#include "lightmap.h"
+#include "soft_raster.h"
+#include "bench.h"
+#include "input_log.h"
+#include "gpu_profiler.h"
+#include "trace.h"
 
-// Shadow‐map size and globals
-const unsigned int SHADOW_WIDTH = 2048, SHADOW_HEIGHT = 2048;
-unsigned int depthCubemap[2], depthMapFBO[2];
+// Shadow atlas and globals
+size_t shadowBudgetMB = 32;
+int shadowDepthBits = 16;
+ShadowAtlas* shadowAtlas;
 ShaderProgram* depthShader;
+// the same program for the static room when it is lightmapped, it marks
+// its texels as static casters in the atlas mask
+ShaderProgram* staticDepthShader = nullptr;
+ShadowQuality shadowQuality;
+
+// Point lights: the two desk lamps cast shadows and reach as far as their
+// attenuation does, so the falloff window leaves them as they always were;
+// --extra-lights adds more
+std::vector<PointLight> lights = {
+    { glm::vec3(2.3f, 0.75f, -1.52f),  glm::vec3(1.0f, 1.0f, 0.9f), lightRange(glm::vec3(1.0f)), true },
+    { glm::vec3(0.21f, 0.75f, -1.52f), glm::vec3(1.0f, 1.0f, 0.9f), lightRange(glm::vec3(1.0f)), true }
+};
+std::vector<int> shadowedLights; // lights with a shadow atlas slot
+int extraLights = 0;
+LightClusters* lightClusters;
+bool printLightStats = false; // --light-stats
 
 // near/far for point‐light projection
 const float near_plane = 1.0f, far_plane = 25.0f;
 
 // Camera & timing
 float aspectRatio = 1.0f;
+const float cameraFovY = 50.0f;
 glm::vec3 cameraPos = { 1.0f, 0.5f, -0.4f };
 glm::vec3 cameraFront = { 0,0,-1 };
 glm::vec3 cameraUp = { 0,1,0 };
@@ -38,12 +77,14 @@ float deltaTime = 0.0f, lastFrame = 0.0f;
 float yaw = -90.0f, pitch = 0.0f;
 float lastX = 250, lastY = 250;
 bool  firstMouse = true;
+float mouseDeltaX = 0.0f, mouseDeltaY = 0.0f; // cursor offsets since the last frame
 
 // Drinkable state
 struct Drinkable {
     Model* model;
     glm::vec3 position;
     glm::vec3 scale;
+    TransformStore::Handle transform = -1;
 };
 std::vector<Drinkable> drinkables;
 int   heldDrinkableIndex = -1;
@@ -67,12 +108,130 @@ std::vector<AABB> sceneColliders;
 
 // Shaders & models
 ShaderProgram* spModel;
+int vertexFormatOverride = -1; // --vertex-format, -1 keeps per-model choice
+
+// World and normal matrices of every object, rebuilt once per frame
+TransformStore transforms;
+
+// Static room geometry with fixed transforms, merged into one batch
+struct StaticObject {
+    Model* model;
+    TransformStore::Handle transform;
+};
+std::vector<StaticObject> staticObjects;
+std::vector<TransformStore::Handle> shelfBottles; // 3x5 grid of bottlesModel
+StaticBatch* staticBatch;
+bool useStaticBatch = true; // --no-batch draws the objects one by one
 Model* bottlesModel, * modelDesk, * modelDoor,
 * modelFloor, * modelShelfs, * modelWalls,
 * modelCeiling, * modelLamp;
 
+// Draw submission: the scene is collected into sorted queues each frame
+RenderQueue shadowQueue, sceneQueue;
+bool printQueueStats = false; // --queue-stats
+bool printStateStats = false; // --state-stats
+
+// Optional depth-only pre-pass over the position streams; the lit pass then
+// runs with GL_LEQUAL and no depth writes so only visible fragments shade
+bool useDepthPrepass = false; // --depth-prepass
+ShaderProgram* prepassShader;
+RenderQueue prepassQueue;
+OverdrawCounter* overdraw = nullptr; // only with --overdraw-stats
+bool printOverdrawStats = false; // --overdraw-stats
+
+// Level of detail for the bottles and drinkables, picked per instance and
+// pass so the simplification error stays under lodPixelError on screen
+// (or in the shadow map)
+int lodLevels = 4;            // --lod-levels N (1 = full detail only)
+float lodPixelError = 1.0f;   // --lod-error px
+bool printLodStats = false;   // --lod-stats
+// per pass: triangles of the chosen levels / at full detail, and level use
+long long lodTriangles[3][2] = {};
+int lodHistogram[3][4] = {};
+
+// Meshlet culling of the heavy models in the camera passes: meshlets
+// outside the frustum or facing away are dropped, the rest are drawn as
+// merged index ranges
+bool useMeshletCulling = true;   // --no-meshlet-cull
+bool printMeshletStats = false;  // --meshlet-stats
+MeshletCullStats meshletStats;
+glm::mat4 cameraViewProj;        // P * V of the frame, set by drawScene
+std::vector<glm::uvec2> meshletRanges;
+
+// GPU-driven culling of the bottles and drinkables: a compute shader culls
+// and picks levels, every model is then one indirect multi-draw per pass
+bool useGpuCulling = false;     // --gpu-cull
+bool printGpuCullStats = false; // --gpu-cull-stats
+GpuCulling* gpuCulling = nullptr;
+
+// Hierarchical-Z occlusion: the static room is drawn depth-only into a small
+// pyramid each frame, instances hidden behind it skip the camera passes
+bool useHzb = false;            // --hzb
+bool printHzbStats = false;     // --hzb-stats
+HiZBuffer* hzb = nullptr;
+RenderQueue occluderQueue;
+
+// Cell-and-portal visibility: rooms are cells joined by doorways. Objects in
+// rooms not seen through a doorway skip the camera passes, lights that reach
+// no visible room skip their shadow maps
+bool usePortals = false;        // --portals
+bool printPortalStats = false;  // --portal-stats
+PortalCells portalCells;
+int portalCulledDraws = 0, shadowLightsRendered = 0;
+
+// Octahedral impostors of the shelf bottles: in the camera passes, bottles
+// farther than impostorDistance are one instanced billboard each
+float impostorDistance = 0.0f;   // --impostors m, 0 keeps the meshes
+Impostor* bottleImpostor = nullptr;
+ShaderProgram* impostorShader = nullptr;
+std::vector<bool> bottleIsImpostor; // per shelfBottles entry, this frame
+
+// Baked lighting of the static room: the batch reads direct light, shadows
+// and one bounce from a lightmap; drinkables and bottles stay real-time lit
+// and are then the only shadow casters, their shadows are taken out of the
+// baked direct light
+bool useLightmap = false;       // --lightmap, loads lightmapPath or bakes it
+bool rebakeLightmap = false;    // --bake-lightmap, bake even if the file exists
+int lightmapSize = 512;         // --lightmap-size N
+int lightmapSamples = 64;       // --lightmap-samples N, bounce rays per texel
+const char* lightmapPath = "models/lightmap.png";
+Lightmap* lightmap = nullptr;
+
+// Screen-space shadow mask built from the pre-pass depth (implies the pre-pass)
+int shadowMaskScale = 0; // --shadow-mask full|half
+ShadowMask* shadowMask = nullptr;
+
+// Software rendering (soft_raster.h): one frame on the CPU, no window
+const char* softRenderPath = nullptr; // --soft-render out.png
+int softWidth = 800, softHeight = 600; // --soft-size WxH
+int softThreads = 0;                   // --soft-threads N, 0 = all hardware threads
+int softShadowSize = 512;              // --soft-shadow-size N, texels per cube face
+
+// Benchmark (bench.h): scripted camera and actions on a hidden window (a
+// display is still required, Xvfb will do) at a fixed time step, frame
+// timings written to JSON
+const char* benchScriptPath = nullptr;     // --bench script.txt
+const char* benchOutPath = "bench.json";   // --bench-out path
+int benchFrames = 0;                       // --bench-frames N, 0: as long as the script
+int benchWarmup = 30;                      // --bench-warmup N, not in the statistics
+float benchDeltaTime = 1.0f / 60.0f;       // --bench-dt seconds
+int benchContextApi = GLFW_NATIVE_CONTEXT_API; // --bench-context native|egl|osmesa
+
+// Input recording and replay (input_log.h); a replay is timed like --bench
+const char* inputRecordPath = nullptr; // --record log.bin
+const char* inputReplayPath = nullptr; // --replay log.bin
+InputLog inputRecording, inputReplay;
+
+// GPU time per pass and light (gpu_profiler.h); P prints the averages
+bool profileGpu = false;               // --gpu-profile
+const char* gpuProfileCsv = nullptr;   // --gpu-profile-csv out.csv, every frame
+GpuProfiler* gpuProfiler = nullptr;
+
+// CPU trace of loading and frames (trace.h), Chrome trace JSON
+const char* tracePath = nullptr;       // --trace out.json
+
 // forward declarations
-void renderSceneDepth(ShaderProgram*);
+void submitScene(RenderQueue&, ShaderProgram*, RenderQueue::Pass);
 void RenderDepthCubemaps(GLFWwindow*);
 
 // Error callback
@@ -104,22 +263,48 @@ void updateCameraDirection() {
     dir.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
     cameraFront = glm::normalize(dir);
 }
-void processInput(GLFWwindow* w) {
+glm::mat4 cameraView() {
+    return glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+}
+glm::mat4 cameraProjection() {
+    return glm::perspective(glm::radians(cameraFovY), aspectRatio, 0.01f, 50.0f);
+}
+// This frame's keys and mouse movement as the input log stores them
+InputLog::Frame liveInput(GLFWwindow* w) {
+    static const int keys[InputLog::KEY_COUNT] = { GLFW_KEY_W, GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_E, GLFW_KEY_F };
+    InputLog::Frame in;
+    in.deltaTime = deltaTime;
+    for (int k = 0; k < InputLog::KEY_COUNT; ++k)
+        if (glfwGetKey(w, keys[k]) == GLFW_PRESS) in.keys |= 1 << k;
+    in.mouseX = mouseDeltaX;
+    in.mouseY = mouseDeltaY;
+    mouseDeltaX = mouseDeltaY = 0.0f;
+    return in;
+}
+void processInput(const InputLog::Frame& in) {
+    TRACE_FUNCTION();
+    // mouse look
+    if (in.mouseX != 0.0f || in.mouseY != 0.0f) {
+        const float S = 0.05f;
+        yaw += in.mouseX * S; pitch += in.mouseY * S;
+        if (pitch > 89.0f)pitch = 89.0f; if (pitch < -89.0f)pitch = -89.0f;
+        updateCameraDirection();
+    }
     float speed = deltaTime;
     glm::vec3 flat = glm::normalize(glm::vec3(cameraFront.x, 0, cameraFront.z));
     glm::vec3 right = glm::normalize(glm::cross(flat, cameraUp));
     glm::vec3 prop = cameraPos;
-    if (glfwGetKey(w, GLFW_KEY_W) == GLFW_PRESS) prop += flat * speed;
-    if (glfwGetKey(w, GLFW_KEY_S) == GLFW_PRESS) prop -= flat * speed;
-    if (glfwGetKey(w, GLFW_KEY_A) == GLFW_PRESS) prop -= right * speed;
-    if (glfwGetKey(w, GLFW_KEY_D) == GLFW_PRESS) prop += right * speed;
+    if (in.down(InputLog::W)) prop += flat * speed;
+    if (in.down(InputLog::S)) prop -= flat * speed;
+    if (in.down(InputLog::A)) prop -= right * speed;
+    if (in.down(InputLog::D)) prop += right * speed;
     glm::vec3 feet = prop - glm::vec3(0, 0.4f, 0);
     bool collide = false;
     for (auto& b : sceneColliders)
         if (b.contains(feet)) { collide = true; break; }
     if (!collide) cameraPos = prop;
     // E pick/drop
-    static bool eL = false; bool eN = (glfwGetKey(w, GLFW_KEY_E) == GLFW_PRESS);
+    static bool eL = false; bool eN = in.down(InputLog::E);
     if (eN && !eL && !isDrinking) {
         if (heldDrinkableIndex < 0) {
             int idx = getDrinkableInFocus();
@@ -129,7 +314,7 @@ void processInput(GLFWwindow* w) {
     }
     eL = eN;
     // F drink
-    static bool fL = false; bool fN = (glfwGetKey(w, GLFW_KEY_F) == GLFW_PRESS);
+    static bool fL = false; bool fN = in.down(InputLog::F);
     if (fN && !fL && heldDrinkableIndex >= 0 && !isDrinking) {
         isDrinking = true;
         drinkingTimer = DRINK_DURATION;
@@ -140,22 +325,19 @@ void mouse_callback(GLFWwindow*, double xpos, double ypos) {
     if (firstMouse) { lastX = (float)xpos; lastY = (float)ypos; firstMouse = false; }
     float xoff = (float)xpos - lastX, yoff = lastY - (float)ypos;
     lastX = (float)xpos; lastY = (float)ypos;
-    const float S = 0.05f; xoff *= S; yoff *= S;
-    yaw += xoff; pitch += yoff;
-    if (pitch > 89.0f)pitch = 89.0f; if (pitch < -89.0f)pitch = -89.0f;
-    updateCameraDirection();
+    // turned in processInput, once per frame, so a replay turns the same way
+    mouseDeltaX += xoff; mouseDeltaY += yoff;
 }
 void windowResizeCallback(GLFWwindow*, int w, int h) {
     if (h == 0) return;
     aspectRatio = (float)w / (float)h;
-    glViewport(0, 0, w, h);
+    glState.viewport(0, 0, w, h);
 }
 
 // Build point‐light transforms
 std::vector<glm::mat4> buildPointLightTransforms(const glm::vec3& lp) {
-    float aspect = float(SHADOW_WIDTH) / float(SHADOW_HEIGHT);
     glm::mat4 P = glm::perspective(glm::radians(90.0f),
-        aspect, near_plane, far_plane);
+        1.0f, near_plane, far_plane);
     std::vector<glm::mat4> M(6);
     M[0] = P * glm::lookAt(lp, lp + glm::vec3(1, 0, 0), glm::vec3(0, -1, 0));
     M[1] = P * glm::lookAt(lp, lp + glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0));
@@ -166,158 +348,431 @@ std::vector<glm::mat4> buildPointLightTransforms(const glm::vec3& lp) {
     return M;
 }
 
-// Render geometry for depth‐pass
-void renderSceneDepth(ShaderProgram* sh) {
-    auto setM = [&](const glm::mat4& M) {
-        glUniformMatrix4fv(sh->u("model"), 1, GL_FALSE, glm::value_ptr(M));
-        };
-    // desk
-    glm::mat4 Mdesk = glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, 0))
-        * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 0.64f, 1.0f));
-    setM(Mdesk); modelDesk->Draw(sh);
-    // door/floor/shelfs/walls
-    setM(glm::mat4(1.0f)); modelDoor->Draw(sh);
-    setM(glm::mat4(1.0f)); modelFloor->Draw(sh);
-    setM(glm::mat4(1.0f)); modelShelfs->Draw(sh);
-    setM(glm::mat4(1.0f)); modelWalls->Draw(sh);
-    // ceiling
-    setM(glm::translate(glm::mat4(1.0f), glm::vec3(0, 1.1f, 0)));
-    modelCeiling->Draw(sh);
-    // lamps
-    glm::mat4 L1 = glm::translate(glm::mat4(1.0f), glm::vec3(2.47f, 0.6f, -1.5f))
-        * glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0, 1, 0))
-        * glm::scale(glm::mat4(1.0f), glm::vec3(1.25f));
-    setM(L1); modelLamp->Draw(sh);
-    glm::mat4 L2 = glm::translate(glm::mat4(1.0f), glm::vec3(0.04f, 0.6f, -1.5f))
-        * glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0, 1, 0))
-        * glm::scale(glm::mat4(1.0f), glm::vec3(1.25f));
-    setM(L2); modelLamp->Draw(sh);
-    // shelf bottles
-    int rows = 3, cols = 5;
-    for (int r = 0; r < rows; ++r)for (int c = 0; c < cols; ++c) {
-        glm::vec3 pos = { 0.2f + c * 0.4f,0.24f + r * 0.235f,-2.25f };
-        glm::mat4 Mb = glm::translate(glm::mat4(1.0f), pos)
-            * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
-        setM(Mb); bottlesModel->Draw(sh);
-    }
-    // drinkables
+// Drinkable poses for this frame: hovering and spinning, or held in front
+// of the camera; then rebuild every dirty matrix
+void updateTransforms() {
+    TRACE_FUNCTION();
+    const glm::vec3 Y(0, 1, 0), X(1, 0, 0);
     for (size_t i = 0; i < drinkables.size(); ++i) {
         auto& d = drinkables[i];
-        float hover = sin((totalTime + i * 5.0f) * 2.0f) * 0.02f;
-        float ang = totalTime * 60.0f;
-        glm::mat4 M(1.0f);
         if ((int)i == heldDrinkableIndex) {
             glm::vec3 hp = cameraPos
                 + cameraFront * (isDrinking ? 0.25f : 0.3f)
                 + cameraUp * (isDrinking ? 0.05f : -0.15f);
-            M = glm::translate(glm::mat4(1.0f), hp);
             float a = atan2(cameraFront.x, cameraFront.z);
-            M = glm::rotate(M, a + glm::radians(180.0f), glm::vec3(0, 1, 0));
+            glm::quat q = glm::angleAxis(a + glm::radians(180.0f), Y);
             if (isDrinking)
-                M = glm::rotate(M, glm::radians(120.0f), glm::vec3(1, 0, 0));
-            M = glm::scale(M, d.scale);
+                q = q * glm::angleAxis(glm::radians(120.0f), X);
+            transforms.set(d.transform, hp, q, d.scale);
         }
         else {
-            M = glm::translate(glm::mat4(1.0f), d.position + glm::vec3(0, hover, 0))
-                * glm::rotate(glm::mat4(1.0f), glm::radians(ang), glm::vec3(0, 1, 0))
-                * glm::scale(glm::mat4(1.0f), d.scale);
+            float hover = sin((totalTime + i * 5.0f) * 2.0f) * 0.02f;
+            float ang = totalTime * 60.0f;
+            transforms.set(d.transform, d.position + glm::vec3(0, hover, 0),
+                glm::angleAxis(glm::radians(ang), Y), d.scale);
         }
-        setM(M); d.model->Draw(sh);
     }
+    transforms.update();
 }
 
+// Queue every object in the scene for one pass; opaque draws carry their
+// view depth so equal-state draws go front to back
+void submitScene(RenderQueue& queue, ShaderProgram* sh, RenderQueue::Pass pass) {
+    bool depthOnly = pass != RenderQueue::PassOpaque;
+    auto viewDepth = [&](TransformStore::Handle h) {
+        if (pass == RenderQueue::PassShadow) return 0.0f;
+        return glm::dot(transforms.boundsCenter(h) - cameraPos, cameraFront);
+    };
+    // shadow maps are seen from every shadowed light (90 degree faces),
+    // the other passes from the camera
+    std::vector<LodView> views;
+    if (pass == RenderQueue::PassShadow) {
+        for (int slot = 0; slot < (int)shadowedLights.size() && slot < shadowAtlas->lightCount(); ++slot)
+            views.push_back({ lights[shadowedLights[slot]].position, shadowAtlas->faceSize(slot) * 0.5f });
+    }
+    else {
+        int fbW, fbH;
+        glfwGetFramebufferSize(glfwGetCurrentContext(), &fbW, &fbH);
+        views.push_back({ cameraPos, fbH * 0.5f / tanf(glm::radians(cameraFovY) * 0.5f) });
+    }
+    lodTriangles[pass][0] = lodTriangles[pass][1] = 0;
+    if (pass != RenderQueue::PassShadow) {
+        meshletStats = MeshletCullStats();
+        portalCulledDraws = 0;
+        if (hzb) hzb->resetStats();
+    }
+    for (int& n : lodHistogram[pass]) n = 0;
 
+    auto add = [&](const Model* m, TransformStore::Handle h) {
+        const glm::mat4& M = transforms.world(h);
+        const glm::vec3 &lo = transforms.boundsMin(h), &hi = transforms.boundsMax(h);
+        // in a room no doorway shows
+        if (usePortals && pass != RenderQueue::PassShadow && !portalCells.visible(lo, hi)) {
+            portalCulledDraws++;
+            return;
+        }
+        // hidden behind the room in the camera passes
+        if (hzb && pass != RenderQueue::PassShadow && hzb->occluded(lo, hi))
+            return;
+        // finest level any view needs
+        int lod = m->lodCount() - 1;
+        glm::vec3 center = transforms.boundsCenter(h);
+        float scale = transforms.maxScale(h);
+        for (const auto& v : views) lod = std::min(lod, m->selectLod(center, scale, v, lodPixelError));
+        lod = std::max(lod, 0);
+        lodTriangles[pass][0] += m->lodTriangles(0);
+        lodTriangles[pass][1] += m->lodTriangles(lod);
+        lodHistogram[pass][std::min(lod, 3)]++;
+        DrawItem item = m->drawItem(sh, M, transforms.normal(h), depthOnly, lod);
 
-// Render both point‐light depth cubemaps
-void RenderDepthCubemaps(GLFWwindow* window) {
-    std::array<glm::vec3, 2> LP = {
-        glm::vec3(2.3f,0.75f,-1.52f),
-        glm::vec3(0.21f,0.75f,-1.52f)
-    };
-    for (int i = 0; i < 2; ++i) {
-        auto mats = buildPointLightTransforms(LP[i]);
-        depthShader->use();
-        for (int f = 0; f < 6; ++f) {
-            std::string name = "shadowMatrices[" + std::to_string(f) + "]";
-            glUniformMatrix4fv(depthShader->u(name.c_str()),
-                1, GL_FALSE, glm::value_ptr(mats[f]));
+        if (useMeshletCulling && pass != RenderQueue::PassShadow && !m->getMeshlets(lod).empty()) {
+            meshletRanges.clear();
+            // the normal matrix is the transposed inverse of M's 3x3
+            glm::vec3 eye = glm::transpose(transforms.normal(h)) * (cameraPos - glm::vec3(M[3]));
+            cullMeshlets(m->getMeshlets(lod), cameraViewProj * M, eye, meshletRanges, meshletStats);
+            if (meshletRanges.empty()) return;
+            item.firstRange = queue.addRanges(meshletRanges.data(), (int)meshletRanges.size());
+            item.rangeCount = (int)meshletRanges.size();
         }
-        glUniform3fv(depthShader->u("lightPos"), 1, glm::value_ptr(LP[i]));
-        glUniform1f(depthShader->u("far_plane"), far_plane);
+        queue.submit(item, pass, viewDepth(h), far_plane);
+    };
 
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO[i]);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        renderSceneDepth(depthShader);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // static room; with a lightmap it casts into the atlas as a static caster
+    if (useStaticBatch)
+        queue.submit(staticBatch->drawItem(
+            pass == RenderQueue::PassShadow && staticDepthShader ? staticDepthShader : sh, depthOnly), pass);
+    else
+        for (auto& o : staticObjects) add(o.model, o.transform);
+    if (gpuCulling) {
+        gpuCulling->submit(queue, sh, pass,
+            pass == RenderQueue::PassShadow ? GpuCulling::TargetShadow : GpuCulling::TargetCamera);
+        return;
     }
+    // shelf bottles (3×5), the far ones are impostors outside the shadow pass
+    for (size_t i = 0; i < shelfBottles.size(); ++i)
+        if (pass == RenderQueue::PassShadow || i >= bottleIsImpostor.size() || !bottleIsImpostor[i])
+            add(bottlesModel, shelfBottles[i]);
+    // levitating & held drinkables
+    for (auto& d : drinkables) add(d.model, d.transform);
+}
+
+
+// Far shelf bottles switch to the impostor for this frame's camera passes;
+// the visible ones become its instances
+void selectImpostors() {
+    bottleIsImpostor.assign(shelfBottles.size(), false);
+    if (!bottleImpostor || gpuCulling) return;
+    bottleImpostor->clear();
+    glm::vec4 planes[6];
+    frustumPlanes(cameraViewProj, planes);
+    for (size_t i = 0; i < shelfBottles.size(); ++i) {
+        TransformStore::Handle h = shelfBottles[i];
+        // the impostor is centered on the bottle's box
+        glm::vec3 c = transforms.boundsCenter(h);
+        if (glm::length(c - cameraPos) < impostorDistance) continue;
+        bottleIsImpostor[i] = true;
+
+        float r = bottleImpostor->radius() * transforms.maxScale(h);
+        bool inside = true;
+        for (const auto& p : planes) inside &= glm::dot(glm::vec3(p), c) + p.w >= -r;
+        if (!inside) continue;
+        const glm::vec3 &lo = transforms.boundsMin(h), &hi = transforms.boundsMax(h);
+        if (usePortals && !portalCells.visible(lo, hi)) continue;
+        if (hzb && hzb->occluded(lo, hi)) continue;
+        bottleImpostor->add(transforms.world(h));
+    }
+    bottleImpostor->upload();
+}
+
+// All impostor instances in one draw, depth only for the pre-pass
+void drawImpostors(const glm::mat4& V, const glm::mat4& P, bool depthOnly) {
+    if (!bottleImpostor || bottleImpostor->instanceCount() == 0) return;
+    impostorShader->use();
+    impostorShader->setMat4("P", P);
+    impostorShader->setMat4("V", V);
+    impostorShader->setVec3("cameraPos", cameraPos);
+    impostorShader->setInt("depthOnly", depthOnly);
+    if (!depthOnly) {
+        lightClusters->bind(impostorShader, 4);
+        if (!shadowedLights.empty())
+            glUniform4fv(impostorShader->u("shadowRects"), 6 * (GLsizei)shadowedLights.size(),
+                glm::value_ptr(shadowAtlas->faceRects(0)[0]));
+        impostorShader->setFloat("far_plane", far_plane);
+    }
+    bottleImpostor->draw(impostorShader);
+}
+
+// Pick each light's cube face size from its screen coverage; a new layout
+// is only packed once it has been wanted for a quarter second
+void updateShadowResolution(int screenHeight) {
+    static std::vector<int> pending;
+    static float pendingTime = 0.0f;
+
+    std::vector<int> wanted;
+    for (int i : shadowedLights)
+        wanted.push_back(shadowFaceSizeFor(lights[i].position, lights[i].radius, cameraPos,
+            glm::radians(cameraFovY), screenHeight));
+
+    bool first = shadowAtlas->lightCount() == 0;
+    if (wanted != pending) {
+        pending = wanted;
+        pendingTime = 0.0f;
+        if (!first) return;
+    }
+    pendingTime += deltaTime;
+    if ((first || pendingTime > 0.25f) && shadowAtlas->pack(wanted))
+        shadowAtlas->printUsage();
+}
+
+// Render every point light's six cube faces into the shadow atlas
+void RenderDepthCubemaps(GLFWwindow* window) {
+    TRACE_FUNCTION();
     int w, h; glfwGetFramebufferSize(window, &w, &h);
-    glViewport(0, 0, w, h);
+    updateShadowResolution(h);
+
+    // the casters are the same for every light: queue and sort them once
+    if (gpuCulling) {
+        std::vector<glm::mat4> faces;
+        std::vector<LodView> views;
+        for (int slot = 0; slot < (int)shadowedLights.size() && slot < shadowAtlas->lightCount(); ++slot) {
+            const PointLight& L = lights[shadowedLights[slot]];
+            if (usePortals && !portalCells.lightVisible(L.position, L.radius)) continue;
+            glm::vec3 lp = L.position;
+            for (const auto& m : buildPointLightTransforms(lp)) {
+                faces.push_back(m);
+                views.push_back({ lp, shadowAtlas->faceSize(slot) * 0.5f });
+            }
+        }
+        GpuScope scope(gpuProfiler, "cull");
+        gpuCulling->cull(GpuCulling::TargetShadow, faces, views, lodPixelError);
+    }
+    shadowQueue.clear();
+    submitScene(shadowQueue, depthShader, RenderQueue::PassShadow);
+    shadowQueue.sort();
+
+    shadowAtlas->clear();
+    std::vector<ShaderProgram*> casterShaders = { depthShader };
+    if (staticDepthShader) casterShaders.push_back(staticDepthShader);
+    for (ShaderProgram* sh : casterShaders) {
+        sh->use();
+        glUniform1f(sh->u("far_plane"), far_plane);
+    }
+    shadowLightsRendered = 0;
+    for (int slot = 0; slot < (int)shadowedLights.size(); ++slot) {
+        const PointLight& L = lights[shadowedLights[slot]];
+        // lights no visible room is lit by keep the cleared faces
+        if (usePortals && !portalCells.lightVisible(L.position, L.radius)) continue;
+        shadowLightsRendered++;
+        auto mats = buildPointLightTransforms(L.position);
+        for (ShaderProgram* sh : casterShaders) {
+            sh->use();
+            for (int f = 0; f < 6; ++f) {
+                std::string name = "shadowMatrices[" + std::to_string(f) + "]";
+                glUniformMatrix4fv(sh->u(name.c_str()), 1, GL_FALSE, glm::value_ptr(mats[f]));
+            }
+            glUniform3fv(sh->u("lightPos"), 1, glm::value_ptr(L.position));
+        }
+
+        GpuScope scope(gpuProfiler, "light", shadowedLights[slot]);
+        shadowAtlas->bindLight(slot);
+        shadowQueue.execute();
+    }
+    glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState.viewport(0, 0, w, h);
+}
+
+// Per-model vertex format unless overridden on the command line
+VertexFormat vertexFormat(VertexFormat preferred) {
+    return vertexFormatOverride < 0 ? preferred : (VertexFormat)vertexFormatOverride;
+}
+
+// Scene content shared by the GL renderer and the software renderer:
+// lights, models, the static room, shelf bottles, drinkables and colliders
+void loadScene() {
+    TRACE_FUNCTION();
+    // extra unshadowed lamps spread over the room, for testing light counts
+    srand(7);
+    auto frand = [](float a, float b) { return a + (b - a) * (rand() / (float)RAND_MAX); };
+    for (int i = 0; i < extraLights; ++i)
+        lights.push_back({ glm::vec3(frand(0.1f, 2.4f), frand(0.1f, 1.0f), frand(-2.2f, -0.1f)),
+            glm::vec3(frand(0.1f, 0.3f), frand(0.1f, 0.3f), frand(0.1f, 0.3f)), 0.8f, false });
+    shadowedLights = shadowCasters(lights);
+
+    // load all your scene models
+    // shelf bottles are dense and never seen up close: 12 B vertices
+    bottlesModel = new Model("models/bottles_for_shelf/bottles_for_shelf.obj", vertexFormat(VertexFormat::Packed12), lodLevels);
+    modelDesk = new Model("models/Desk/Desk.obj", vertexFormat(VertexFormat::Packed16));
+    modelDoor = new Model("models/Door/Door.obj", vertexFormat(VertexFormat::Packed16));
+    modelFloor = new Model("models/Floor/Floor.obj", vertexFormat(VertexFormat::Packed16));
+    modelShelfs = new Model("models/Shelfs/Shelfs.obj", vertexFormat(VertexFormat::Packed16));
+    modelWalls = new Model("models/Walls/Walls.obj", vertexFormat(VertexFormat::Packed16));
+    modelCeiling = new Model("models/Ceiling/Ceiling.obj", vertexFormat(VertexFormat::Packed16));
+    modelLamp = new Model("models/Lamp/Lamp.obj", vertexFormat(VertexFormat::Packed16));
+
+    // static room: desk, door, floor, shelfs, walls, ceiling and both lamps
+    const glm::quat noRotation(1, 0, 0, 0);
+    auto fixed = [&](glm::vec3 p, glm::vec3 s = glm::vec3(1.0f)) {
+        return transforms.create(p, noRotation, s, true);
+    };
+    auto lampAt = [&](glm::vec3 p, float ry) {
+        return transforms.create(p, glm::angleAxis(glm::radians(ry), glm::vec3(0, 1, 0)),
+            glm::vec3(1.25f), true);
+    };
+    staticObjects = {
+        { modelDesk,    fixed({ 0.0f, 0.0f, 0.0f }, { 1.0f, 0.64f, 1.0f }) },
+        { modelDoor,    fixed({ 0.0f, 0.0f, 0.0f }) },
+        { modelFloor,   fixed({ 0.0f, 0.0f, 0.0f }) },
+        { modelShelfs,  fixed({ 0.0f, 0.0f, 0.0f }) },
+        { modelWalls,   fixed({ 0.0f, 0.0f, 0.0f }) },
+        { modelCeiling, fixed({ 0.0f, 1.1f, 0.0f }) },
+        { modelLamp,    lampAt({ 2.47f, 0.6f, -1.5f }, -90.0f) },
+        { modelLamp,    lampAt({ 0.04f, 0.6f, -1.5f },  90.0f) }
+    };
+    shelfBottles.clear();
+    for (int r = 0; r < 3; ++r) for (int c = 0; c < 5; ++c)
+        shelfBottles.push_back(fixed({ 0.2f + c * 0.4f, 0.24f + r * 0.235f, -2.25f }, glm::vec3(0.5f)));
+    for (auto& o : staticObjects) transforms.setBounds(o.transform, o.model->getBoundsMin(), o.model->getBoundsMax());
+    for (auto h : shelfBottles) transforms.setBounds(h, bottlesModel->getBoundsMin(), bottlesModel->getBoundsMax());
+    transforms.update();
+
+    // push your drinkables
+    drinkables.clear();
+    drinkables.push_back({ new Model("models/Drinkable1/drinkable1.obj", vertexFormat(VertexFormat::Packed16), lodLevels), glm::vec3(0.4f,0.35f,-1.3f), glm::vec3(1.0f) });
+    drinkables.push_back({ new Model("models/Drinkable2/drinkable2.obj", vertexFormat(VertexFormat::Packed16), lodLevels), glm::vec3(0.8f,0.35f,-1.3f), glm::vec3(0.8f) });
+    drinkables.push_back({ new Model("models/Drinkable3/drinkable3.obj", vertexFormat(VertexFormat::Packed16), lodLevels), glm::vec3(1.2f,0.35f,-1.3f), glm::vec3(0.035f) });
+    drinkables.push_back({ new Model("models/Drinkable4/drinkable4.obj", vertexFormat(VertexFormat::Packed16), lodLevels), glm::vec3(1.6f,0.35f,-1.3f), glm::vec3(0.85f) });
+    for (auto& d : drinkables) {
+        d.transform = transforms.create(d.position, noRotation, d.scale);
+        transforms.setBounds(d.transform, d.model->getBoundsMin(), d.model->getBoundsMax());
+    }
+
+    // your scene colliders
+    sceneColliders.clear();
+    sceneColliders.push_back({ {0.03f,0.01f,-1.79f},{ 2.43f,0.31f,-1.13f} });
+    sceneColliders.push_back({ {0.07f,0.01f,-1.25f},{-0.03f,0.74f,-0.05f} });
+    sceneColliders.push_back({ {2.54f,0.04f,-1.72f},{ 2.38f,0.87f, 0.02f} });
+    sceneColliders.push_back({ {2.56f,-0.06f,-0.15f},{-0.07f,1.03f, 0.14f} });
+}
+
+// --soft-render: the start view rendered on the CPU and written to
+// softRenderPath; models stay on the CPU, no GL context is created
+int renderSoftware() {
+    Model::cpuOnly = true;
+    loadScene();
+    updateTransforms();
+    aspectRatio = (float)softWidth / (float)softHeight;
+
+    SoftwareRenderer renderer(softWidth, softHeight, softThreads);
+    for (auto& o : staticObjects) renderer.add(o.model, transforms.world(o.transform), transforms.normal(o.transform));
+    for (auto h : shelfBottles) renderer.add(bottlesModel, transforms.world(h), transforms.normal(h));
+    for (auto& d : drinkables) renderer.add(d.model, transforms.world(d.transform), transforms.normal(d.transform));
+    SoftwareRenderer::Shadows shadows = { softShadowSize, near_plane, far_plane, shadowQuality.taps() };
+    renderer.render(cameraView(), cameraProjection(), cameraPos, lights, shadows);
+    renderer.printStats();
+    return renderer.save(softRenderPath) ? 0 : 1;
+}
+
+// Scripted stand-in for E and F presses during --bench
+void applyBenchAction(const BenchScript::Action& a) {
+    if (isDrinking) return;
+    if (a.type == BenchScript::Action::Pick && heldDrinkableIndex < 0)
+        heldDrinkableIndex = a.drinkable >= 0 && a.drinkable < (int)drinkables.size()
+            ? a.drinkable : getDrinkableInFocus();
+    else if (a.type == BenchScript::Action::Drop)
+        heldDrinkableIndex = -1;
+    else if (a.type == BenchScript::Action::Drink && heldDrinkableIndex >= 0) {
+        isDrinking = true;
+        drinkingTimer = DRINK_DURATION;
+    }
 }
 
 // Initialize everything
 void initOpenGLProgram(GLFWwindow* window) {
+    TRACE_FUNCTION();
     glClearColor(0, 0, 0, 1);
-    glEnable(GL_DEPTH_TEST);
+    glState.enable(GL_DEPTH_TEST);
     glfwSetWindowSizeCallback(window, windowResizeCallback);
 
     // load your main textured shader
     spModel = new ShaderProgram("v_textures.glsl", nullptr, "f_textures.glsl");
 
+    // camera depth pre-pass, position streams only
+    prepassShader = new ShaderProgram("prepass.vs", nullptr, "prepass.fs");
+    if (printOverdrawStats) overdraw = new OverdrawCounter();
+    if (shadowMaskScale) shadowMask = new ShadowMask(shadowMaskScale);
+    if (useHzb) hzb = new HiZBuffer();
+    glStencilFunc(GL_EQUAL, 0, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+
     // load the depth‐only shader (VS, GS, FS) for point‐light shadows
     depthShader = new ShaderProgram("depth_shader.vs",
         "depth_shader.gs",
         "depth_shader.fs");
+    if (useLightmap) {
+        staticDepthShader = new ShaderProgram("depth_shader.vs", "depth_shader.gs", "depth_shader.fs");
+        staticDepthShader->use();
+        staticDepthShader->setInt("staticCaster", 1);
+        staticDepthShader->setInt("instanceTransforms", GpuCulling::TRANSFORM_UNIT);
+    }
 
-    // create two FBOs + 2 cubemap textures for your two point lights
-    glGenFramebuffers(2, depthMapFBO);
-    glGenTextures(2, depthCubemap);
-    for (int i = 0; i < 2; ++i) {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap[i]);
-        for (unsigned f = 0; f < 6; ++f) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f,
-                0, GL_DEPTH_COMPONENT,
-                SHADOW_WIDTH, SHADOW_HEIGHT,
-                0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-        }
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    lightClusters = new LightClusters();
+
+    // one depth atlas shared by the cube faces of all point lights
+    shadowAtlas = new ShadowAtlas(shadowBudgetMB * 1024 * 1024, shadowDepthBits, useLightmap);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO[i]);
-        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-            depthCubemap[i], 0);
-        // no color
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
+    loadScene();
+    if (impostorDistance > 0.0f) {
+        bottleImpostor = new Impostor(bottlesModel);
+        impostorShader = new ShaderProgram("impostor.vs", nullptr, "impostor.fs");
+        impostorShader->use();
+        impostorShader->setInt("impostorAlbedo", 0);
+        impostorShader->setInt("impostorNormalDepth", 2);
+        impostorShader->setInt("shadowAtlas", 3);
+        // every sampler on its own unit before the first (depth-only) draw
+        lightClusters->bind(impostorShader, 4);
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    // load all your scene models
-    bottlesModel = new Model("models/bottles_for_shelf/bottles_for_shelf.obj");
-    modelDesk = new Model("models/Desk/Desk.obj");
-    modelDoor = new Model("models/Door/Door.obj");
-    modelFloor = new Model("models/Floor/Floor.obj");
-    modelShelfs = new Model("models/Shelfs/Shelfs.obj");
-    modelWalls = new Model("models/Walls/Walls.obj");
-    modelCeiling = new Model("models/Ceiling/Ceiling.obj");
-    modelLamp = new Model("models/Lamp/Lamp.obj");
+    staticBatch = new StaticBatch();
+    for (auto& o : staticObjects) staticBatch->add(o.model, transforms.world(o.transform));
+    if (useLightmap) lightmap = new Lightmap(lightmapSize);
+    if (!staticBatch->build(lightmap)) {
+        fprintf(stderr, "[LIGHTMAP] the room does not unwrap, lighting it in real time\n");
+        delete lightmap;
+        lightmap = nullptr;
+    }
+    // the lights are static too: a saved lightmap stays valid until they,
+    // the room or the sample count change
+    if (lightmap) {
+        unsigned long long hash = lightmap->bakeHash(lights, lightmapSamples);
+        if (rebakeLightmap || !lightmap->load(lightmapPath, hash)) {
+            lightmap->bake(lights, lightmapSamples);
+            lightmap->save(lightmapPath, hash);
+        }
+    }
 
-    // push your drinkables
-    drinkables.clear();
-    drinkables.push_back({ new Model("models/Drinkable1/drinkable1.obj"), glm::vec3(0.4f,0.35f,-1.3f), glm::vec3(1.0f) });
-    drinkables.push_back({ new Model("models/Drinkable2/drinkable2.obj"), glm::vec3(0.8f,0.35f,-1.3f), glm::vec3(0.8f) });
-    drinkables.push_back({ new Model("models/Drinkable3/drinkable3.obj"), glm::vec3(1.2f,0.35f,-1.3f), glm::vec3(0.035f) });
-    drinkables.push_back({ new Model("models/Drinkable4/drinkable4.obj"), glm::vec3(1.6f,0.35f,-1.3f), glm::vec3(0.85f) });
+    if (useGpuCulling && !GpuCulling::supported())
+        fprintf(stderr, "[GPUCULL] needs GL 4.3 compute shaders and indirect draws, submitting from the CPU\n");
+    else if (useGpuCulling) {
+        gpuCulling = new GpuCulling();
+        for (auto h : shelfBottles) gpuCulling->add(bottlesModel, h);
+        for (auto& d : drinkables) gpuCulling->add(d.model, d.transform);
+        gpuCulling->build(transforms.size());
+    }
+    for (ShaderProgram* sh : { spModel, prepassShader, depthShader }) {
+        sh->use();
+        sh->setInt("instanceTransforms", GpuCulling::TRANSFORM_UNIT);
+    }
+    spModel->use();
+    spModel->setInt("lightmap", Lightmap::UNIT);
+    spModel->setInt("casterMask", ShadowAtlas::MASK_UNIT);
 
-    // your scene colliders
-    sceneColliders.clear();
-    sceneColliders.push_back({ {0.03f,0.01f,-1.79f},{ 2.43f,0.31f,-1.13f} });
-    sceneColliders.push_back({ {0.07f,0.01f,-1.25f},{-0.03f,0.74f,-0.05f} });
-    sceneColliders.push_back({ {2.54f,0.04f,-1.72f},{ 2.38f,0.87f, 0.02f} });
-    sceneColliders.push_back({ {2.56f,-0.06f,-0.15f},{-0.07f,1.03f, 0.14f} });
+    // gallery layout: the room, and the hall behind the door in its z = 0 wall
+    if (usePortals) {
+        int room = portalCells.addCell({ 0.0f, 0.0f, -2.54f }, { 2.54f, 1.13f, 0.0f });
+        int hall = portalCells.addCell({ 0.0f, 0.0f, 0.0f }, { 2.54f, 1.13f, 2.54f });
+        portalCells.addPortal(room, hall, { { 0.92f, 0.0f, 0.0f }, { 1.42f, 0.0f, 0.0f },
+                                            { 1.42f, 0.79f, 0.0f }, { 0.92f, 0.79f, 0.0f } });
+    }
 
     // capture the mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -326,9 +781,19 @@ void initOpenGLProgram(GLFWwindow* window) {
 
 // Cleanup
 void freeOpenGLProgram(GLFWwindow*) {
-    glDeleteFramebuffers(2, depthMapFBO);
-    glDeleteTextures(2, depthCubemap);
+    delete shadowAtlas;
+    delete lightClusters;
+    delete staticBatch;
+    delete lightmap;
     delete depthShader;
+    delete staticDepthShader;
+    delete prepassShader;
+    delete overdraw;
+    delete shadowMask;
+    delete gpuCulling;
+    delete hzb;
+    delete bottleImpostor;
+    delete impostorShader;
     delete spModel;
     delete bottlesModel;
     delete modelDesk;
@@ -343,126 +808,377 @@ void freeOpenGLProgram(GLFWwindow*) {
 
 // Draw the scene after you've already called RenderDepthCubemaps
 void drawScene(GLFWwindow* window, float angle_x, float angle_y) {
-    // Clear
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    TRACE_FUNCTION();
+    int fbW, fbH; glfwGetFramebufferSize(window, &fbW, &fbH);
 
     // Build camera matrices
-    glm::mat4 V = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-    glm::mat4 P = glm::perspective(glm::radians(50.0f),
-                                   aspectRatio, 0.01f, 50.0f);
-    // Light positions + colors
-    glm::vec3 lightPos1   = glm::vec3(2.3f,  0.75f, -1.52f);
-    glm::vec3 lightColor1 = glm::vec3(1.0f,  1.0f,   0.9f);
-    glm::vec3 lightPos2   = glm::vec3(0.21f, 0.75f, -1.52f);
-    glm::vec3 lightColor2 = glm::vec3(1.0f,  1.0f,   0.9f);
-
-    // Bind your main shader & pass all uniforms
-    spModel->use();
-    spModel->setMat4 ("P",          P);
-    spModel->setMat4 ("V",          V);
-    spModel->setVec3 ("cameraPos",  cameraPos);
-
-    spModel->setInt("isEmissive", 0);
-  
-    spModel->setVec3("lightPos[0]", lightPos1);
-    spModel->setVec3("lightColor[0]", lightColor1);
-    spModel->setVec3("lightPos[1]", lightPos2);
-    spModel->setVec3("lightColor[1]", lightColor2);
-
-    spModel->setInt("depthMap[0]", 3);
-    spModel->setInt("depthMap[1]", 4);
-    spModel->setFloat("far_plane", far_plane);
-
-    glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap[0]);
-    glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap[1]);
-    glActiveTexture(GL_TEXTURE0);
-
-    // drawAt helper
-    auto drawAt = [&](Model* Mdl, glm::vec3 pos, glm::vec3 s){
-        glm::mat4 M = glm::translate(glm::mat4(1.0f), pos)
-                    * glm::scale(glm::mat4(1.0f), s);
-        spModel->setMat4("M", M);
-        glm::mat3 nm = glm::transpose(glm::inverse(glm::mat3(M)));
-        spModel->setMat3("normalMatrix", nm);
-        Mdl->Draw(spModel);
-        glBindVertexArray(0);
-    };
+    glm::mat4 V = cameraView();
+    glm::mat4 P = cameraProjection();
+    cameraViewProj = P * V;
 
-    // draw static scene geometry
-    drawAt(modelDesk, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.64f, 1.0f));
-    drawAt(modelDoor, glm::vec3(0.0f), glm::vec3(1.0f));
-    drawAt(modelFloor, glm::vec3(0.0f), glm::vec3(1.0f));
-    drawAt(modelShelfs, glm::vec3(0.0f), glm::vec3(1.0f));
-    drawAt(modelWalls, glm::vec3(0.0f), glm::vec3(1.0f));
-    drawAt(modelCeiling, glm::vec3(0.0f, 1.1f, 0.0f), glm::vec3(1.0f));
-
-
-    // lamp helper
-    auto drawLamp = [&](glm::vec3 p, float ry){
-        glm::mat4 M = glm::translate(glm::mat4(1.0f), p) * glm::rotate (glm::mat4(1.0f), glm::radians(ry), glm::vec3(0,1,0)) * glm::scale (glm::mat4(1.0f), glm::vec3(1.25f));
-        spModel->setMat4("M", M);
-        glm::mat3 nm = glm::transpose(glm::inverse(glm::mat3(M)));
-        spModel->setMat3("normalMatrix", nm);
-        modelLamp->Draw(spModel);
-        glBindVertexArray(0);
-    };
-    drawLamp({2.47f,0.6f,-1.5f}, -90.0f);
-    drawLamp({0.04f,0.6f,-1.5f},  90.0f);
-
-    // levitating & held drinkables:
-    for(size_t i=0;i<drinkables.size();++i){
-      auto& d = drinkables[i];
-      float hover = sin((totalTime + i*5.0f)*2.0f)*0.02f;
-      float angle = totalTime * 60.0f;
-      glm::mat4 M(1.0f);
-      if ((int)i == heldDrinkableIndex) {
-        glm::vec3 hp = cameraPos + cameraFront * (isDrinking ? 0.25f : 0.3f) + cameraUp    * (isDrinking ? 0.05f : -0.15f);
-        M = glm::translate(glm::mat4(1.0f), hp);
-        float a = atan2(cameraFront.x, cameraFront.z);
-        M = glm::rotate(M, a + glm::radians(180.0f), glm::vec3(0,1,0));
-        if (isDrinking)
-          M = glm::rotate(M, glm::radians(120.0f), glm::vec3(1,0,0));
-        M = glm::scale(M, d.scale);
-      }
-      else {
-        M = glm::translate(glm::mat4(1.0f), d.position + glm::vec3(0,hover,0)) * glm::rotate (glm::mat4(1.0f), glm::radians(angle), glm::vec3(0,1,0)) * glm::scale  (glm::mat4(1.0f), d.scale);
-      }
-      spModel->setMat4("M", M);
-      glm::mat3 nm = glm::transpose(glm::inverse(glm::mat3(M)));
-      spModel->setMat3("normalMatrix", nm);
-      d.model->Draw(spModel);
-      glBindVertexArray(0);
-    }
-
-    // shelf bottles (3×5)
+    // occluder depth for the hierarchical-Z test: the static room only
+    if (hzb) {
+        GpuScope scope(gpuProfiler, "hzb");
+        hzb->fetch();
+        hzb->bindOccluders();
+        prepassShader->use();
+        prepassShader->setMat4("P", P);
+        prepassShader->setMat4("V", V);
+        occluderQueue.clear();
+        if (useStaticBatch)
+            occluderQueue.submit(staticBatch->drawItem(prepassShader, true), RenderQueue::PassDepth);
+        else
+            for (auto& o : staticObjects)
+                occluderQueue.submit(o.model->drawItem(prepassShader, transforms.world(o.transform),
+                    transforms.normal(o.transform), true), RenderQueue::PassDepth);
+        occluderQueue.execute();
+        hzb->build(cameraViewProj);
+        glState.viewport(0, 0, fbW, fbH);
+    }
+    selectImpostors();
+    if (gpuCulling) {
+        LodView camera = { cameraPos, fbH * 0.5f / tanf(glm::radians(cameraFovY) * 0.5f) };
+        GpuScope scope(gpuProfiler, "cull");
+        gpuCulling->cull(GpuCulling::TargetCamera, { cameraViewProj }, { camera }, lodPixelError, hzb);
+    }
+
+    if (shadowMask) {
+        shadowMask->resize(fbW, fbH);
+        shadowMask->bindScene();
+    }
+
+    // Clear
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | (useDepthPrepass ? GL_STENCIL_BUFFER_BIT : 0));
+
+    // depth pre-pass: lay down the final depth without shading anything
+    if (useDepthPrepass) {
+        GpuScope scope(gpuProfiler, "prepass");
+        prepassShader->use();
+        prepassShader->setMat4("P", P);
+        prepassShader->setMat4("V", V);
+        glState.colorMask(false);
+        prepassQueue.clear();
+        submitScene(prepassQueue, prepassShader, RenderQueue::PassDepth);
+        prepassQueue.sort();
+        prepassQueue.execute();
+        drawImpostors(V, P, true);
+        glState.colorMask(true);
+
+        // shadows of every shadowed light, once per pixel of the final depth
+        if (shadowMask) {
+            GpuScope maskScope(gpuProfiler, "shadow mask");
+            std::vector<glm::vec3> positions;
+            for (int i : shadowedLights) positions.push_back(lights[i].position);
+            shadowMask->build(V, P, cameraPos, positions, *shadowAtlas, far_plane, shadowQuality.taps());
+        }
+
+        glState.depthMask(false);
+        glState.depthFunc(GL_LEQUAL);
+        // coincident faces would all pass LEQUAL and the last one would win;
+        // the stencil lets only the first fragment per pixel through, as LESS did
+        glState.enable(GL_STENCIL_TEST);
+    }
+
+    // lit pass; its scopes close before the swap, which is timed on its own
     {
-      int rows=3, cols=5;
-      float bx=0.2f, by=0.24f, bz=-2.25f;
-      for(int r=0;r<rows;++r) for(int c=0;c<cols;++c){
-        glm::vec3 p = {bx + c*0.4f, by + r*0.235f, bz};
-        glm::mat4 M = glm::translate(glm::mat4(1.0f), p)
-                    * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
-        spModel->setMat4("M", M);
-        glm::mat3 nm = glm::transpose(glm::inverse(glm::mat3(M)));
-        spModel->setMat3("normalMatrix", nm);
-        bottlesModel->Draw(spModel);
-        glBindVertexArray(0);
-      }
+        GpuScope gpuScope(gpuProfiler, "lit");
+        TRACE_SCOPE("lit pass");
+
+        // Bind your main shader & pass all uniforms
+        spModel->use();
+        spModel->setMat4 ("P",          P);
+        spModel->setMat4 ("V",          V);
+        spModel->setVec3 ("cameraPos",  cameraPos);
+
+        spModel->setInt("isEmissive", 0);
+
+        // assign lights to clusters; the atlas rects of all shadow slots are contiguous
+        lightClusters->update(lights, V, glm::radians(cameraFovY), fbW, fbH, 0.1f, 50.0f);
+        lightClusters->bind(spModel, 4);
+        if (!shadowedLights.empty())
+            glUniform4fv(spModel->u("shadowRects"), 6 * (GLsizei)shadowedLights.size(),
+                glm::value_ptr(shadowAtlas->faceRects(0)[0]));
+
+        spModel->setInt("textureArray", 1);
+        spModel->setInt("useTextureArray", 0);
+        spModel->setInt("shadowAtlas", 3);
+        spModel->setFloat("far_plane", far_plane);
+        spModel->setInt("shadowTaps", shadowQuality.taps());
+
+        glState.bindTexture(3, GL_TEXTURE_2D, shadowAtlas->texture());
+        spModel->setInt("useLightmap", lightmap != nullptr);
+        if (lightmap) {
+            glState.bindTexture(Lightmap::UNIT, GL_TEXTURE_2D, lightmap->texture());
+            glState.bindTexture(ShadowAtlas::MASK_UNIT, GL_TEXTURE_2D, shadowAtlas->casterMask());
+        }
+        spModel->setInt("useShadowMask", shadowMask != nullptr);
+        if (shadowMask) shadowMask->bind(spModel, 7);
+
+        // static room, drinkables and shelf bottles in state order
+        sceneQueue.clear();
+        submitScene(sceneQueue, spModel, RenderQueue::PassOpaque);
+        sceneQueue.sort();
+        if (overdraw) overdraw->begin();
+        sceneQueue.execute();
+        drawImpostors(V, P, false);
+        if (overdraw) overdraw->end(fbW * fbH);
+
+        // depth writes back on for the next clear and the shadow pass
+        glState.depthMask(true);
+        glState.depthFunc(GL_LESS);
+        glState.disable(GL_STENCIL_TEST);
+
+        if (shadowMask) shadowMask->present();
     }
 
+    TRACE_SCOPE("glfwSwapBuffers");
     glfwSwapBuffers(window);
 }
 
-int main() {
+// --help
+void printUsage(const char* program) {
+    printf("usage: %s [options]\n"
+        "shadows:\n"
+        "  --shadow-tier N          PCF tier 0..3 (1, 4, 8, 20 taps)\n"
+        "  --shadow-adaptive        pick the tier from the frame time\n"
+        "  --shadow-sweep           cycle through all tiers and report each\n"
+        "  --shadow-sweep-frames N  frames per tier of the sweep\n"
+        "  --shadow-budget MB       depth atlas memory\n"
+        "  --shadow-depth 16|24     depth atlas bits\n"
+        "  --shadow-mask full|half  screen-space shadow mask\n"
+        "geometry and culling:\n"
+        "  --vertex-format float|packed16|packed12\n"
+        "  --no-batch --no-mesh-opt --no-meshlet-cull --depth-half\n"
+        "  --depth-prepass --lod-levels N --lod-error PX --impostors M\n"
+        "  --gpu-cull --hzb --portals --extra-lights N\n"
+        "lightmap:\n"
+        "  --lightmap --bake-lightmap --lightmap-size N --lightmap-samples N\n"
+        "statistics:\n"
+        "  --queue-stats --state-stats --light-stats --overdraw-stats --lod-stats\n"
+        "  --meshlet-stats --gpu-cull-stats --hzb-stats --portal-stats\n"
+        "  --gpu-profile, --gpu-profile-csv FILE, --trace FILE, --bench-kernels\n"
+        "software renderer (no GL, no display needed):\n"
+        "  --soft-render OUT.png --soft-size WxH --soft-threads N --soft-shadow-size N\n"
+        "benchmark:\n"
+        "  --bench SCRIPT --bench-out FILE --bench-frames N --bench-warmup N --bench-dt S\n"
+        "  --bench-context native|egl|osmesa\n"
+        "      the window is hidden but GLFW still needs a display: on a machine\n"
+        "      without one run the benchmark under Xvfb (or a remote desktop)\n"
+        "  --record FILE, --replay FILE\n", program);
+}
+
+int main(int argc, char** argv) {
+    // command line: shadow tier selection and memory budget
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if (arg == "--shadow-tier" && i + 1 < argc)
+            shadowQuality.setTier(atoi(argv[++i]));
+        else if (arg == "--shadow-adaptive")
+            shadowQuality.setMode(ShadowQuality::Adaptive);
+        else if (arg == "--shadow-sweep")
+            shadowQuality.setMode(ShadowQuality::Sweep);
+        else if (arg == "--shadow-sweep-frames" && i + 1 < argc)
+            shadowQuality.setSweepFrames(std::max(1, atoi(argv[++i])));
+        else if (arg == "--shadow-budget" && i + 1 < argc)
+            shadowBudgetMB = (size_t)atoi(argv[++i]);
+        else if (arg == "--shadow-depth" && i + 1 < argc)
+            shadowDepthBits = atoi(argv[++i]);
+        else if (arg == "--no-batch")
+            useStaticBatch = false;
+        else if (arg == "--queue-stats")
+            printQueueStats = true;
+        else if (arg == "--bench-kernels") {
+            benchmarkTransformKernels();
+            return 0;
+        }
+        else if (arg == "--extra-lights" && i + 1 < argc)
+            extraLights = atoi(argv[++i]);
+        else if (arg == "--light-stats")
+            printLightStats = true;
+        else if (arg == "--depth-prepass")
+            useDepthPrepass = true;
+        else if (arg == "--shadow-mask" && i + 1 < argc) {
+            std::string m = argv[++i];
+            shadowMaskScale = m == "full" ? 1 : m == "half" ? 2 : 0;
+            if (!shadowMaskScale) fprintf(stderr, "--shadow-mask expects full or half\n");
+        }
+        else if (arg == "--lod-levels" && i + 1 < argc)
+            lodLevels = std::max(1, atoi(argv[++i]));
+        else if (arg == "--lod-error" && i + 1 < argc)
+            lodPixelError = (float)atof(argv[++i]);
+        else if (arg == "--impostors" && i + 1 < argc)
+            impostorDistance = (float)atof(argv[++i]);
+        else if (arg == "--lod-stats")
+            printLodStats = Model::printLods = true;
+        else if (arg == "--overdraw-stats")
+            printOverdrawStats = true;
+        else if (arg == "--state-stats")
+            printStateStats = true;
+        else if (arg == "--no-meshlet-cull")
+            useMeshletCulling = false;
+        else if (arg == "--meshlet-stats")
+            printMeshletStats = true;
+        else if (arg == "--gpu-cull")
+            useGpuCulling = true;
+        else if (arg == "--gpu-cull-stats")
+            printGpuCullStats = true;
+        else if (arg == "--hzb")
+            useHzb = true;
+        else if (arg == "--hzb-stats")
+            printHzbStats = true;
+        else if (arg == "--portals")
+            usePortals = true;
+        else if (arg == "--portal-stats")
+            printPortalStats = true;
+        else if (arg == "--lightmap")
+            useLightmap = true;
+        else if (arg == "--bake-lightmap")
+            useLightmap = rebakeLightmap = true;
+        else if (arg == "--lightmap-size" && i + 1 < argc) {
+            int size = atoi(argv[++i]);
+            if (size >= 64 && size <= Lightmap::MAX_SIZE) lightmapSize = size;
+            else fprintf(stderr, "--lightmap-size expects 64 to %d, keeping %d\n", Lightmap::MAX_SIZE, lightmapSize);
+        }
+        else if (arg == "--lightmap-samples" && i + 1 < argc)
+            lightmapSamples = std::max(0, atoi(argv[++i]));
+        else if (arg == "--soft-render" && i + 1 < argc)
+            softRenderPath = argv[++i];
+        else if (arg == "--soft-size" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &softWidth, &softHeight) != 2 || softWidth < 1 || softHeight < 1) {
+                fprintf(stderr, "--soft-size expects WxH, keeping 800x600\n");
+                softWidth = 800;
+                softHeight = 600;
+            }
+        }
+        else if (arg == "--soft-threads" && i + 1 < argc)
+            softThreads = atoi(argv[++i]);
+        else if (arg == "--soft-shadow-size" && i + 1 < argc)
+            softShadowSize = std::max(2, atoi(argv[++i]));
+        else if (arg == "--bench" && i + 1 < argc)
+            benchScriptPath = argv[++i];
+        else if (arg == "--bench-out" && i + 1 < argc)
+            benchOutPath = argv[++i];
+        else if (arg == "--bench-frames" && i + 1 < argc)
+            benchFrames = std::max(0, atoi(argv[++i]));
+        else if (arg == "--bench-warmup" && i + 1 < argc)
+            benchWarmup = std::max(0, atoi(argv[++i]));
+        else if (arg == "--bench-dt" && i + 1 < argc)
+            benchDeltaTime = std::max(1e-4f, (float)atof(argv[++i]));
+        else if (arg == "--bench-context" && i + 1 < argc) {
+            std::string c = argv[++i];
+            benchContextApi = c == "egl" ? GLFW_EGL_CONTEXT_API
+                : c == "osmesa" ? GLFW_OSMESA_CONTEXT_API
+                : c == "native" ? GLFW_NATIVE_CONTEXT_API : 0;
+            if (!benchContextApi) {
+                fprintf(stderr, "--bench-context expects native, egl or osmesa\n");
+                benchContextApi = GLFW_NATIVE_CONTEXT_API;
+            }
+        }
+        else if (arg == "--record" && i + 1 < argc)
+            inputRecordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            inputReplayPath = argv[++i];
+        else if (arg == "--gpu-profile")
+            profileGpu = true;
+        else if (arg == "--gpu-profile-csv" && i + 1 < argc) {
+            profileGpu = true;
+            gpuProfileCsv = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (arg == "--no-mesh-opt")
+            Model::optimizeMeshes = false;
+        else if (arg == "--depth-half")
+            Model::halfDepthPositions = true;
+        else if (arg == "--vertex-format" && i + 1 < argc) {
+            std::string f = argv[++i];
+            int format = f == "float" ? (int)VertexFormat::Float32
+                : f == "packed16" ? (int)VertexFormat::Packed16
+                : f == "packed12" ? (int)VertexFormat::Packed12 : -1;
+            if (format < 0)
+                fprintf(stderr, "--vertex-format expects float, packed16 or packed12\n");
+            else
+                vertexFormatOverride = format;
+        }
+        else
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+    }
+    // a recording is of live input, and must not overwrite the log it replays
+    if (inputRecordPath && benchScriptPath) {
+        fprintf(stderr, "--record records live input, it cannot run with --bench\n");
+        return 1;
+    }
+    if (inputRecordPath && inputReplayPath && std::string(inputRecordPath) == inputReplayPath) {
+        fprintf(stderr, "--record and --replay name the same file %s\n", inputRecordPath);
+        return 1;
+    }
+    // the mask is built from the pre-pass depth
+    if (shadowMaskScale) useDepthPrepass = true;
+    // lightmap coordinates only exist in the merged batch
+    if (useLightmap && !useStaticBatch) {
+        fprintf(stderr, "--lightmap needs the static batch, ignoring --no-batch\n");
+        useStaticBatch = true;
+    }
+    // half float depth streams would not reproduce the lit pass depth exactly
+    if (useDepthPrepass && Model::halfDepthPositions) {
+        fprintf(stderr, "--depth-prepass needs full precision depth positions, ignoring --depth-half\n");
+        Model::halfDepthPositions = false;
+    }
+
+    if (tracePath) {
+        if (TRACE_ENABLED) Trace::start();
+        else fprintf(stderr, "--trace: built with TRACE_ENABLED 0, nothing is recorded\n");
+    }
+
+    if (softRenderPath) {
+        int result = renderSoftware();
+        if (tracePath && TRACE_ENABLED) Trace::write(tracePath);
+        return result;
+    }
+
+    BenchScript benchScript;
+    if (benchScriptPath) {
+        if (!benchScript.load(benchScriptPath)) return 1;
+        if (!benchFrames) benchFrames = std::max(1, (int)ceil(benchScript.duration() / benchDeltaTime));
+    }
+    else if (inputReplayPath) {
+        if (!inputReplay.replay(inputReplayPath)) return 1;
+        if (!inputReplay.frames()) {
+            fprintf(stderr, "[INPUT] %s holds no frames\n", inputReplayPath);
+            return 1;
+        }
+        if (!benchFrames || benchFrames > inputReplay.frames()) benchFrames = inputReplay.frames();
+    }
+    if (inputRecordPath && !inputRecording.record(inputRecordPath)) return 1;
+
     // GLFW error callback
     glfwSetErrorCallback(error_callback);
 
     // init window + OpenGL context
     if (!glfwInit()) {
         fprintf(stderr, "GLFW init failed\n");
+        if (benchScriptPath || inputReplayPath)
+            fprintf(stderr, "[BENCH] the benchmark needs a display, run it under Xvfb on a machine without one\n");
         return -1;
     }
+    // the benchmark never shows its window, but it is a GLFW window all the
+    // same and needs a display; the context comes from the platform unless
+    // --bench-context asks for EGL or OSMesa, whose libraries are not there
+    // everywhere (stock Windows has no libEGL)
+    if (benchScriptPath) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, benchContextApi);
+    }
     GLFWwindow* win = glfwCreateWindow(800, 600, "Galeria Alkoholi", nullptr, nullptr);
+    if (!win && benchScriptPath && benchContextApi != GLFW_NATIVE_CONTEXT_API) {
+        fprintf(stderr, "[BENCH] no context from the requested API, trying the native one\n");
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+        win = glfwCreateWindow(800, 600, "Galeria Alkoholi", nullptr, nullptr);
+    }
     if (!win) {
         fprintf(stderr, "Window creation failed\n");
         glfwTerminate();
@@ -474,13 +1190,62 @@ int main() {
     // build all shaders, FBOs, load models, etc.
     initOpenGLProgram(win);
 
+    if (profileGpu) {
+        gpuProfiler = new GpuProfiler();
+        if (gpuProfileCsv) gpuProfiler->openCsv(gpuProfileCsv);
+    }
+
+    BenchTimings* benchTimings = nullptr;
+    int benchFrame = 0;
+    if (benchScriptPath || inputReplayPath) {
+        // unthrottled, so the timings are not rounded up to the refresh rate
+        glfwSwapInterval(0);
+        benchTimings = new BenchTimings(benchFrames, benchWarmup);
+        if (benchScriptPath)
+            printf("[BENCH] %s: %d frames at %.4f s on %s\n", benchScriptPath, benchFrames, benchDeltaTime,
+                (const char*)glGetString(GL_RENDERER));
+        else
+            printf("[BENCH] replaying %d frames of %s on %s\n", benchFrames, inputReplayPath,
+                (const char*)glGetString(GL_RENDERER));
+    }
+
     // main loop
     while (!glfwWindowShouldClose(win)) {
-        // time management
+        TRACE_SCOPE("frame");
+        // time management and input: fixed steps for the benchmark script,
+        // recorded frames on replay, otherwise the clock and the devices
+        InputLog::Frame input;
+        if (benchTimings) benchTimings->beginFrame();
+        if (gpuProfiler) gpuProfiler->beginFrame();
+        // measured even under fixed steps, the shadow tiers are timed by it
         float now = (float)glfwGetTime();
-        deltaTime = now - lastFrame;
+        float frameSeconds = now - lastFrame;
         lastFrame = now;
+        if (benchScriptPath)
+            deltaTime = benchDeltaTime;
+        else if (inputReplayPath) {
+            inputReplay.next(input);
+            deltaTime = input.deltaTime;
+        }
+        else {
+            deltaTime = frameSeconds;
+            input = liveInput(win);
+        }
+        if (inputRecordPath) inputRecording.append(input);
         totalTime += deltaTime;
+        // the frame time is the measurement, a replay adapts to the recorded one
+        shadowQuality.update(frameSeconds, inputReplayPath ? deltaTime : 0.0f);
+
+        // scripted camera and actions, before the shake is added on top
+        if (benchScriptPath) {
+            BenchScript::Pose pose = benchScript.pose(totalTime);
+            cameraPos = pose.position;
+            yaw = pose.yaw;
+            pitch = pose.pitch;
+            updateCameraDirection();
+            for (const auto& a : benchScript.actionsBetween(totalTime - deltaTime, totalTime))
+                applyBenchAction(a);
+        }
 
         // intoxication timer & camera shake
         if (intoxicationTimer > 0.0f) {
@@ -510,19 +1275,129 @@ int main() {
             }
         }
 
-        // input & movement 
-        processInput(win);
+        // input & movement, the benchmark script replaces it
+        if (!benchScriptPath) processInput(input);
+
+        // matrices for this frame, shared by every pass
+        updateTransforms();
+        if (gpuCulling) gpuCulling->updateTransforms(transforms);
+        // rooms seen this frame, the shadow pass already needs them
+        if (usePortals) portalCells.update(cameraPos, cameraProjection() * cameraView());
+        if (benchTimings) benchTimings->endPass(BenchTimings::Update);
 
         // shadow pass
-        RenderDepthCubemaps(win);
+        {
+            GpuScope scope(gpuProfiler, "shadow");
+            RenderDepthCubemaps(win);
+        }
+        if (benchTimings) benchTimings->endPass(BenchTimings::Shadow);
 
         // ligtning pass
         drawScene(win, 0.0f, 0.0f);
+        glState.endFrame();
+        if (gpuProfiler) gpuProfiler->endFrame();
+        if (benchTimings) {
+            benchTimings->endPass(BenchTimings::Lit);
+            if (++benchFrame >= benchFrames) glfwSetWindowShouldClose(win, GLFW_TRUE);
+        }
+
+        static float statsTimer = 0.0f;
+        statsTimer += deltaTime;
+        if (statsTimer > 2.0f) {
+            if (printQueueStats) {
+                shadowQueue.printStats("shadow");
+                sceneQueue.printStats("scene");
+                printf("[TRANSFORM] %d of %d matrices rebuilt last frame, %d static\n",
+                    transforms.lastUpdateCount(), transforms.size(), transforms.staticCount());
+            }
+            if (printStateStats) glState.printStats();
+            if (printLightStats) lightClusters->printStats();
+            if (printLodStats) {
+                static const char* passNames[3] = { "shadow", "depth", "lit" };
+                for (int p = 0; p < 3; ++p) {
+                    if (!lodTriangles[p][0]) continue;
+                    printf("[LOD] %s: %lld of %lld triangles, instances per level %d/%d/%d/%d\n",
+                        passNames[p], lodTriangles[p][1], lodTriangles[p][0],
+                        lodHistogram[p][0], lodHistogram[p][1], lodHistogram[p][2], lodHistogram[p][3]);
+                }
+                if (bottleImpostor)
+                    printf("[LOD] %d of %zu shelf bottles beyond %.2f m are impostors, %d drawn\n",
+                        (int)std::count(bottleIsImpostor.begin(), bottleIsImpostor.end(), true),
+                        shelfBottles.size(), impostorDistance, bottleImpostor->instanceCount());
+            }
+            if (printMeshletStats)
+                printf("[MESHLET] lit pass: %d tested, %d outside frustum, %d back-facing, "
+                    "%lld of %lld triangles in %d ranges\n", meshletStats.tested, meshletStats.frustumCulled,
+                    meshletStats.backfaceCulled, meshletStats.trianglesKept, meshletStats.triangles,
+                    meshletStats.ranges);
+            if (printGpuCullStats && gpuCulling) gpuCulling->printStats();
+            if (printHzbStats && hzb)
+                printf("[HZB] lit pass: %d of %d tested draws occluded\n", hzb->occludedCount, hzb->tested);
+            if (printPortalStats && usePortals)
+                printf("[PORTAL] camera in cell %d, %d of %d cells visible, %d of %d portals passed, "
+                    "%d draws skipped, %d of %zu shadowed lights rendered\n", portalCells.cameraCell(),
+                    portalCells.visibleCells(), portalCells.cellCount(), portalCells.portalsPassed,
+                    portalCells.portalsTested, portalCulledDraws, shadowLightsRendered, shadowedLights.size());
+            if (overdraw) overdraw->printStats(useDepthPrepass ? "lit pass after pre-pass" : "lit pass");
+            statsTimer = 0.0f;
+        }
+
+        // P: GPU profile averages since the last press
+        static bool pL = false; bool pN = glfwGetKey(win, GLFW_KEY_P) == GLFW_PRESS;
+        if (pN && !pL && gpuProfiler) gpuProfiler->printAverages();
+        pL = pN;
 
         // Poll & swap
         glfwPollEvents();
     }
 
+    if (benchTimings) {
+        int fbW, fbH;
+        glfwGetFramebufferSize(win, &fbW, &fbH);
+        std::vector<std::pair<std::string, std::string>> info = {
+            { benchScriptPath ? "script" : "replay",
+                BenchTimings::jsonString(benchScriptPath ? benchScriptPath : inputReplayPath) },
+            { "renderer", BenchTimings::jsonString((const char*)glGetString(GL_RENDERER)) },
+            { "gl_version", BenchTimings::jsonString((const char*)glGetString(GL_VERSION)) },
+            { "width", std::to_string(fbW) },
+            { "height", std::to_string(fbH) },
+            { "delta_time", std::to_string(benchDeltaTime) },
+            { "shadow_taps", std::to_string(shadowQuality.taps()) } };
+        // --shadow-sweep: frame times of every tier the run went through
+        if (shadowQuality.mode() == ShadowQuality::Sweep) {
+            std::string tiers = "[";
+            for (const auto& s : shadowQuality.tierStats()) {
+                char row[160];
+                snprintf(row, sizeof(row), "%s\n    { \"taps\": %d, \"frames\": %d, \"mean_ms\": %.4f, "
+                    "\"p50_ms\": %.4f, \"p95_ms\": %.4f }", tiers.size() > 1 ? "," : "", s.taps, s.frames,
+                    s.meanMs, s.p50Ms, s.p95Ms);
+                tiers += row;
+            }
+            info.push_back({ "shadow_sweep", tiers + (tiers.size() > 1 ? "\n  ]" : "]") });
+        }
+        benchTimings->write(benchOutPath, info);
+        benchTimings->printSummary();
+        delete benchTimings;
+    }
+
+    inputRecording.close();
+    if (tracePath && TRACE_ENABLED) Trace::write(tracePath);
+    if (gpuProfiler) {
+        gpuProfiler->finish();
+        gpuProfiler->printAverages();
+        delete gpuProfiler;
+    }
+    if (shadowQuality.mode() != ShadowQuality::Fixed) shadowQuality.printReport();
+    if (printQueueStats) {
+        shadowQueue.printStats("shadow, last frame");
+        sceneQueue.printStats("scene, last frame");
+    }
+    if (printStateStats) glState.printStats();
+    if (overdraw) {
+        overdraw->collect(true);
+        overdraw->printStats(useDepthPrepass ? "lit pass after pre-pass" : "lit pass");
+    }
+
     // cleanup
     freeOpenGLProgram(win);
     glfwDestroyWindow(win);
@@ -0,0 +1,400 @@
+#include "mesh_lod.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+// ---------------------------------------------------------------- welding
+
+namespace {
+
+struct VertexKey {
+    const Vertex* v;
+    bool operator==(const VertexKey& o) const { return memcmp(v, o.v, sizeof(Vertex)) == 0; }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& k) const {
+        // FNV-1a over the raw bytes, equality is bitwise as well
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(k.v);
+        size_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(Vertex); ++i) h = (h ^ p[i]) * 1099511628211ull;
+        return h;
+    }
+};
+
+} // namespace
+
+size_t weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> unique;
+    unique.reserve(vertices.size());
+    {
+        std::unordered_map<VertexKey, unsigned int, VertexKeyHash> seen;
+        seen.reserve(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            auto it = seen.find({ &vertices[i] });
+            if (it != seen.end()) {
+                remap[i] = it->second;
+                continue;
+            }
+            remap[i] = (unsigned int)unique.size();
+            seen.insert({ { &vertices[i] }, remap[i] });
+            unique.push_back(vertices[i]);
+        }
+    }
+    for (auto& idx : indices) idx = remap[idx];
+    size_t removed = vertices.size() - unique.size();
+    vertices.swap(unique);
+    return removed;
+}
+
+// ------------------------------------------------------------ simplifying
+
+namespace {
+
+// symmetric 4x4 plane quadric: xx xy xz xd yy yz yd zz zd dd
+struct Quadric {
+    double q[10] = {};
+
+    void addPlane(const glm::dvec3& n, double d, double w) {
+        q[0] += w * n.x * n.x; q[1] += w * n.x * n.y; q[2] += w * n.x * n.z; q[3] += w * n.x * d;
+        q[4] += w * n.y * n.y; q[5] += w * n.y * n.z; q[6] += w * n.y * d;
+        q[7] += w * n.z * n.z; q[8] += w * n.z * d;
+        q[9] += w * d * d;
+    }
+    void add(const Quadric& o) {
+        for (int i = 0; i < 10; ++i) q[i] += o.q[i];
+    }
+    // squared plane distance of p, summed over all planes with their weights
+    double eval(const glm::dvec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+            + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+            + q[7] * z * z + 2 * q[8] * z + q[9];
+    }
+};
+
+struct PositionHash {
+    size_t operator()(const glm::vec3& p) const {
+        unsigned int b[3];
+        memcpy(b, &p, sizeof(b));
+        return ((size_t)b[0] * 73856093u) ^ ((size_t)b[1] * 19349663u) ^ ((size_t)b[2] * 83492791u);
+    }
+};
+
+struct Triangle {
+    unsigned int v[3]; // vertex per corner
+    int c[3];          // position class per corner
+    bool alive;
+};
+
+struct Collapse {
+    double cost;
+    int from, to;
+    unsigned int fromVersion, toVersion;
+    bool operator>(const Collapse& o) const { return cost > o.cost; }
+};
+
+// edges on a border or a seam are pulled towards their original line by
+// planes perpendicular to the face, weighted like this much surface
+const double BORDER_WEIGHT = 10.0;
+
+class Simplifier {
+public:
+    Simplifier(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+        : vertices(vertices) {
+        buildClasses();
+        buildTriangles(indices);
+        buildQuadrics();
+    }
+
+    std::vector<SimplifiedLevel> run(int levels, float ratio) {
+        std::vector<SimplifiedLevel> out;
+        for (int c = 0; c < (int)positions.size(); ++c) pushEdges(c);
+
+        double target = aliveTriangles;
+        double maxCost = 0.0;
+        for (int level = 0; level < levels; ++level) {
+            target *= ratio;
+            while (aliveTriangles > target && !heap.empty()) {
+                Collapse e = heap.top();
+                heap.pop();
+                if (dead[e.from] || dead[e.to] || version[e.from] != e.fromVersion
+                    || version[e.to] != e.toVersion)
+                    continue;
+                if (flips(e.from, e.to)) continue;
+                maxCost = std::max(maxCost, e.cost);
+                collapse(e.from, e.to);
+            }
+            if (aliveTriangles > target) break; // nothing left to collapse
+
+            SimplifiedLevel l;
+            for (const auto& t : triangles)
+                if (t.alive) l.indices.insert(l.indices.end(), t.v, t.v + 3);
+            l.error = (float)std::sqrt(maxCost);
+            out.push_back(std::move(l));
+        }
+        return out;
+    }
+
+private:
+    const std::vector<Vertex>& vertices;
+    std::vector<int> classOf;                     // per vertex
+    std::vector<glm::dvec3> positions;            // per class
+    std::vector<std::vector<unsigned int>> members;
+    std::vector<Quadric> quadrics;
+    std::vector<double> weights;
+    std::vector<std::vector<int>> classTriangles;
+    std::vector<unsigned int> version;
+    std::vector<char> dead;
+    std::vector<Triangle> triangles;
+    size_t aliveTriangles = 0;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+    // vertices at the same position share a class, so seams move together
+    void buildClasses() {
+        std::unordered_map<glm::vec3, int, PositionHash> seen;
+        classOf.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            auto ins = seen.insert({ vertices[i].Position, (int)positions.size() });
+            if (ins.second) {
+                positions.push_back(glm::dvec3(vertices[i].Position));
+                members.emplace_back();
+            }
+            classOf[i] = ins.first->second;
+            members[classOf[i]].push_back((unsigned int)i);
+        }
+        size_t n = positions.size();
+        quadrics.resize(n);
+        weights.assign(n, 0.0);
+        classTriangles.resize(n);
+        version.assign(n, 0);
+        dead.assign(n, 0);
+    }
+
+    void buildTriangles(const std::vector<unsigned int>& indices) {
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            Triangle t;
+            for (int k = 0; k < 3; ++k) {
+                t.v[k] = indices[i + k];
+                t.c[k] = classOf[t.v[k]];
+            }
+            t.alive = t.c[0] != t.c[1] && t.c[1] != t.c[2] && t.c[0] != t.c[2];
+            if (!t.alive) continue;
+            int id = (int)triangles.size();
+            triangles.push_back(t);
+            for (int k = 0; k < 3; ++k) classTriangles[t.c[k]].push_back(id);
+            aliveTriangles++;
+        }
+    }
+
+    void buildQuadrics() {
+        // per undirected class edge: triangle count and the vertex pair of the first
+        struct EdgeInfo { int count; unsigned int va, vb; int tri; };
+        std::unordered_map<unsigned long long, EdgeInfo> edges;
+        auto edgeKey = [](int a, int b) {
+            return ((unsigned long long)std::min(a, b) << 32) | (unsigned int)std::max(a, b);
+        };
+        std::vector<char> seam;
+        for (int id = 0; id < (int)triangles.size(); ++id) {
+            const Triangle& t = triangles[id];
+            glm::dvec3 p0 = positions[t.c[0]], p1 = positions[t.c[1]], p2 = positions[t.c[2]];
+            glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+            double len = glm::length(n);
+            if (len > 0.0) {
+                n /= len;
+                double area = 0.5 * len;
+                for (int k = 0; k < 3; ++k) {
+                    quadrics[t.c[k]].addPlane(n, -glm::dot(n, p0), area);
+                    weights[t.c[k]] += area;
+                }
+            }
+            for (int k = 0; k < 3; ++k) {
+                int a = t.c[k], b = t.c[(k + 1) % 3];
+                unsigned int va = t.v[k], vb = t.v[(k + 1) % 3];
+                auto ins = edges.insert({ edgeKey(a, b), { 1, va, vb, id } });
+                if (ins.second) continue;
+                EdgeInfo& e = ins.first->second;
+                // the other side walks the edge the other way round
+                bool sameVertices = e.va == vb && e.vb == va;
+                e.count = sameVertices && e.count == 1 ? 2 : 3; // 3: seam or non-manifold
+            }
+        }
+
+        for (const auto& kv : edges) {
+            const EdgeInfo& e = kv.second;
+            if (e.count == 2) continue;
+            const Triangle& t = triangles[e.tri];
+            glm::dvec3 p0 = positions[t.c[0]], p1 = positions[t.c[1]], p2 = positions[t.c[2]];
+            glm::dvec3 faceN = glm::cross(p1 - p0, p2 - p0);
+            int a = classOf[e.va], b = classOf[e.vb];
+            glm::dvec3 edge = positions[b] - positions[a];
+            glm::dvec3 n = glm::cross(edge, faceN);
+            double len = glm::length(n);
+            if (len <= 0.0) continue;
+            n /= len;
+            double w = BORDER_WEIGHT * glm::dot(edge, edge);
+            double d = -glm::dot(n, positions[a]);
+            quadrics[a].addPlane(n, d, w);
+            quadrics[b].addPlane(n, d, w);
+            weights[a] += w;
+            weights[b] += w;
+        }
+    }
+
+    double cost(int from, int to) const {
+        Quadric q = quadrics[from];
+        q.add(quadrics[to]);
+        double w = weights[from] + weights[to];
+        return std::max(0.0, q.eval(positions[to])) / (w > 0.0 ? w : 1.0);
+    }
+
+    void pushEdges(int c) {
+        for (int id : classTriangles[c]) {
+            const Triangle& t = triangles[id];
+            if (!t.alive) continue;
+            for (int k = 0; k < 3; ++k) {
+                int o = t.c[k];
+                if (o == c) continue;
+                heap.push({ cost(c, o), c, o, version[c], version[o] });
+                heap.push({ cost(o, c), o, c, version[o], version[c] });
+            }
+        }
+    }
+
+    // would moving `from` onto `to` turn any remaining triangle over?
+    bool flips(int from, int to) const {
+        for (int id : classTriangles[from]) {
+            const Triangle& t = triangles[id];
+            if (!t.alive || t.c[0] == to || t.c[1] == to || t.c[2] == to) continue;
+            glm::dvec3 p[3], q[3];
+            for (int k = 0; k < 3; ++k) {
+                p[k] = positions[t.c[k]];
+                q[k] = t.c[k] == from ? positions[to] : p[k];
+            }
+            glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::dvec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            double lb = glm::length(before), la = glm::length(after);
+            if (la <= 1e-12 * std::max(lb, 1e-30)) return true;
+            if (glm::dot(before, after) < 0.2 * lb * la) return true;
+        }
+        return false;
+    }
+
+    // member of `to` closest in normal and uv to vertex v, so the corner
+    // keeps its side of a seam
+    unsigned int closestMember(int to, unsigned int v) const {
+        const Vertex& a = vertices[v];
+        unsigned int best = members[to][0];
+        float bestD = 1e30f;
+        for (unsigned int m : members[to]) {
+            const Vertex& b = vertices[m];
+            glm::vec3 dn = a.Normal - b.Normal;
+            glm::vec2 dt = a.TexCoords - b.TexCoords;
+            float d = glm::dot(dn, dn) + glm::dot(dt, dt);
+            if (d < bestD) { bestD = d; best = m; }
+        }
+        return best;
+    }
+
+    void collapse(int from, int to) {
+        for (int id : classTriangles[from]) {
+            Triangle& t = triangles[id];
+            if (!t.alive) continue;
+            if (t.c[0] == to || t.c[1] == to || t.c[2] == to) {
+                t.alive = false;
+                aliveTriangles--;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k)
+                if (t.c[k] == from) {
+                    t.c[k] = to;
+                    t.v[k] = closestMember(to, t.v[k]);
+                }
+            classTriangles[to].push_back(id);
+        }
+        quadrics[to].add(quadrics[from]);
+        weights[to] += weights[from];
+        dead[from] = 1;
+        std::vector<int>().swap(classTriangles[from]);
+        version[to]++;
+
+        // drop triangles that died around `to`
+        auto& list = classTriangles[to];
+        list.erase(std::remove_if(list.begin(), list.end(),
+            [&](int id) { return !triangles[id].alive; }), list.end());
+        pushEdges(to);
+    }
+};
+
+} // namespace
+
+std::vector<SimplifiedLevel> simplifyLevels(const std::vector<Vertex>& vertices,
+    const std::vector<unsigned int>& indices, int levels, float ratio) {
+    if (levels <= 0 || indices.size() < 3) return {};
+    Simplifier s(vertices, indices);
+    return s.run(levels, ratio);
+}
+
+// ------------------------------------------------------------------ cache
+
+static const unsigned int LOD_CACHE_MAGIC = 0x31444f4c; // "LOD1"
+
+unsigned long long lodCacheHash(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+    int levels, float ratio) {
+    unsigned long long h = 14695981039346656037ull;
+    auto mix = [&h](const void* data, size_t bytes) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < bytes; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    };
+    mix(vertices.data(), vertices.size() * sizeof(Vertex));
+    mix(indices.data(), indices.size() * sizeof(unsigned int));
+    // everything else the result depends on
+    mix(&levels, sizeof(levels));
+    mix(&ratio, sizeof(ratio));
+    mix(&BORDER_WEIGHT, sizeof(BORDER_WEIGHT));
+    return h;
+}
+
+bool loadLodCache(const std::string& path, unsigned long long hash, std::vector<SimplifiedLevel>& levels) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    unsigned int magic = 0, count = 0;
+    unsigned long long fileHash = 0;
+    bool ok = fread(&magic, sizeof(magic), 1, f) == 1 && magic == LOD_CACHE_MAGIC
+        && fread(&fileHash, sizeof(fileHash), 1, f) == 1 && fileHash == hash
+        && fread(&count, sizeof(count), 1, f) == 1;
+    levels.clear();
+    for (unsigned int i = 0; ok && i < count; ++i) {
+        SimplifiedLevel l;
+        unsigned int n = 0;
+        ok = fread(&l.error, sizeof(l.error), 1, f) == 1 && fread(&n, sizeof(n), 1, f) == 1;
+        if (!ok) break;
+        l.indices.resize(n);
+        ok = n == 0 || fread(l.indices.data(), sizeof(unsigned int), n, f) == n;
+        levels.push_back(std::move(l));
+    }
+    fclose(f);
+    if (!ok) levels.clear();
+    return ok;
+}
+
+bool saveLodCache(const std::string& path, unsigned long long hash, const std::vector<SimplifiedLevel>& levels) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    unsigned int count = (unsigned int)levels.size();
+    bool ok = fwrite(&LOD_CACHE_MAGIC, sizeof(LOD_CACHE_MAGIC), 1, f) == 1
+        && fwrite(&hash, sizeof(hash), 1, f) == 1
+        && fwrite(&count, sizeof(count), 1, f) == 1;
+    for (const auto& l : levels) {
+        if (!ok) break;
+        unsigned int n = (unsigned int)l.indices.size();
+        ok = fwrite(&l.error, sizeof(l.error), 1, f) == 1 && fwrite(&n, sizeof(n), 1, f) == 1
+            && (n == 0 || fwrite(l.indices.data(), sizeof(unsigned int), n, f) == n);
+    }
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "vertex_layout.h"
+
+// Merge vertices that match in every attribute and rewrite the indices to
+// point at the survivors. The OBJ loader emits one vertex per face corner,
+// this turns that into a shared-vertex mesh. Returns the removed count.
+size_t weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// One simplified index list over the same vertices, with the object-space
+// distance it may deviate from the full mesh
+struct SimplifiedLevel {
+    std::vector<unsigned int> indices;
+    float error = 0.0f;
+};
+
+// Quadric error metric edge collapse (Garland & Heckbert). Vertices only
+// ever collapse onto existing positions, so normals and uvs are kept and
+// every level indexes the original vertex array. Borders and uv / normal
+// seams get extra constraint planes so silhouettes and seams hold. One run
+// records a level each time the triangle count falls below ratio^k of the
+// input; fewer levels are returned if the mesh cannot be reduced further.
+const float LOD_RATIO = 0.5f;
+std::vector<SimplifiedLevel> simplifyLevels(const std::vector<Vertex>& vertices,
+    const std::vector<unsigned int>& indices, int levels, float ratio = LOD_RATIO);
+
+// Simplified levels cached next to the source mesh, valid while the hash
+// of the mesh and of the simplifyLevels() arguments and constants matches.
+// load returns false on a missing or stale cache.
+unsigned long long lodCacheHash(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+    int levels, float ratio);
+bool loadLodCache(const std::string& path, unsigned long long hash, std::vector<SimplifiedLevel>& levels);
+bool saveLodCache(const std::string& path, unsigned long long hash, const std::vector<SimplifiedLevel>& levels);
@@ -0,0 +1,189 @@
+#include "mesh_optimize.h"
+#include <algorithm>
+
+CacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize) {
+    CacheStats stats;
+    if (indices.empty()) return stats;
+
+    // FIFO: a vertex stays cached until cacheSize more misses happened
+    std::vector<unsigned int> loadedAt(vertexCount, 0);
+    std::vector<char> referenced(vertexCount, 0);
+    unsigned int misses = 0;
+    size_t unique = 0;
+    for (unsigned int v : indices) {
+        if (!referenced[v]) { referenced[v] = 1; unique++; }
+        if (loadedAt[v] == 0 || misses - loadedAt[v] >= (unsigned int)cacheSize) {
+            misses++;
+            loadedAt[v] = misses; // +1 so 0 means never loaded
+        }
+    }
+    stats.acmr = misses / (float)(indices.size() / 3);
+    stats.atvr = misses / (float)unique;
+    return stats;
+}
+
+std::vector<unsigned int> optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+    int cacheSize) {
+    size_t triCount = indices.size() / 3;
+    std::vector<unsigned int> clusters;
+    if (triCount == 0) return clusters;
+
+    // vertex -> triangles
+    std::vector<unsigned int> offsets(vertexCount + 1, 0), live(vertexCount, 0);
+    for (unsigned int v : indices) live[v]++;
+    for (size_t v = 0; v < vertexCount; ++v) offsets[v + 1] = offsets[v] + live[v];
+    std::vector<unsigned int> adjacency(indices.size()), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0), deadEnd, candidates, out;
+    std::vector<char> emitted(triCount, 0);
+    out.reserve(indices.size());
+    deadEnd.reserve(indices.size());
+
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0;
+    // first vertex that still has triangles
+    auto nextLive = [&]() -> long long {
+        while (!deadEnd.empty()) {
+            unsigned int d = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[d] > 0) return d;
+        }
+        while (cursor < vertexCount) {
+            if (live[cursor] > 0) return (long long)cursor++;
+            cursor++;
+        }
+        return -1;
+    };
+
+    long long fan = nextLive();
+    clusters.push_back(0);
+    while (fan >= 0) {
+        candidates.clear();
+        for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+            unsigned int t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = indices[t * 3 + k];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > (unsigned int)cacheSize) cacheTime[v] = time++;
+            }
+        }
+
+        // the candidate that stays in cache longest after its remaining
+        // triangles are emitted, else fall back to the dead-end stack
+        long long best = -1;
+        int bestPriority = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) continue;
+            int priority = 0;
+            if ((int)(time - cacheTime[v]) + 2 * (int)live[v] <= cacheSize)
+                priority = (int)(time - cacheTime[v]);
+            if (priority > bestPriority) { bestPriority = priority; best = v; }
+        }
+        if (best < 0) {
+            best = nextLive();
+            if (best >= 0) clusters.push_back((unsigned int)(out.size() / 3));
+        }
+        fan = best;
+    }
+    indices.swap(out);
+    return clusters;
+}
+
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<unsigned int>& clusters,
+    const std::vector<Vertex>& vertices, int cacheSize, float threshold) {
+    size_t triCount = indices.size() / 3;
+    if (triCount == 0) return;
+    float meshAcmr = analyzeVertexCache(indices, vertices.size(), cacheSize).acmr;
+
+    // soft split of every hard cluster wherever its own running ACMR is
+    // already within threshold of the mesh
+    std::vector<unsigned int> starts;
+    std::vector<unsigned int> loadedAt(vertices.size(), 0);
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        unsigned int begin = clusters[c];
+        unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : (unsigned int)triCount;
+        unsigned int start = begin, misses = 0, clock = 0;
+        std::fill(loadedAt.begin(), loadedAt.end(), 0); // cold cache per hard cluster
+        starts.push_back(begin);
+        for (unsigned int t = begin; t < end; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = indices[t * 3 + k];
+                if (loadedAt[v] == 0 || clock - loadedAt[v] >= (unsigned int)cacheSize) {
+                    clock++;
+                    misses++;
+                    loadedAt[v] = clock;
+                }
+            }
+            unsigned int tris = t + 1 - start;
+            if (t + 1 < end && misses <= threshold * meshAcmr * tris) {
+                starts.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                clock += cacheSize; // and per soft one
+            }
+        }
+    }
+
+    // area weighted centroid and normal per cluster
+    struct Cluster { unsigned int begin, end; float sortKey; };
+    std::vector<Cluster> parts;
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> centers, normals;
+    for (size_t c = 0; c < starts.size(); ++c) {
+        unsigned int begin = starts[c];
+        unsigned int end = c + 1 < starts.size() ? starts[c + 1] : (unsigned int)triCount;
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (unsigned int t = begin; t < end; ++t) {
+            const glm::vec3& a = vertices[indices[t * 3]].Position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& d = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(b - a, d - a); // length = 2 * area
+            float w = glm::length(n);
+            center += (a + b + d) / 3.0f * w;
+            normal += n;
+            area += w;
+        }
+        meshCenter += center;
+        meshArea += area;
+        centers.push_back(area > 0.0f ? center / area : center);
+        normals.push_back(glm::length(normal) > 0.0f ? glm::normalize(normal) : normal);
+        parts.push_back({ begin, end, 0.0f });
+    }
+    if (meshArea > 0.0f) meshCenter /= meshArea;
+    for (size_t c = 0; c < parts.size(); ++c)
+        parts[c].sortKey = glm::dot(centers[c] - meshCenter, normals[c]);
+
+    // outward facing first
+    std::stable_sort(parts.begin(), parts.end(),
+        [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+    std::vector<unsigned int> out;
+    out.reserve(indices.size());
+    for (const auto& p : parts)
+        out.insert(out.end(), indices.begin() + p.begin * 3, indices.begin() + p.end * 3);
+    indices.swap(out);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<std::vector<unsigned int>*> indexLists) {
+    const unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    unsigned int next = 0;
+    for (auto* list : indexLists)
+        for (unsigned int v : *list)
+            if (remap[v] == UNUSED) remap[v] = next++;
+    for (auto& r : remap)
+        if (r == UNUSED) r = next++;
+
+    std::vector<Vertex> reordered(vertices.size());
+    for (size_t v = 0; v < vertices.size(); ++v) reordered[remap[v]] = vertices[v];
+    vertices.swap(reordered);
+    for (auto* list : indexLists)
+        for (auto& v : *list) v = remap[v];
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include "vertex_layout.h"
+
+// Post-transform cache statistics of an index list, simulated with a FIFO
+// of cacheSize entries: ACMR = vertices transformed per triangle (0.5 is
+// ideal for a large grid, 3 means no reuse), ATVR = vertices transformed
+// per vertex referenced (1 is ideal).
+struct CacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+CacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount,
+    int cacheSize = 16);
+
+// Tipsify (Sander, Nehab, Barczak 2007): reorders triangles for a
+// post-transform cache of cacheSize. Returns the first triangle of every
+// cluster, a new one starts wherever the walk hit a dead end.
+std::vector<unsigned int> optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+    int cacheSize = 16);
+
+// Splits the Tipsify clusters further where the cache is warm enough
+// (running ACMR within threshold of the whole mesh), then draws outward
+// facing clusters first so they occlude the rest. Keeps most of the
+// cache gain while cutting overdraw.
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<unsigned int>& clusters,
+    const std::vector<Vertex>& vertices, int cacheSize = 16, float threshold = 1.05f);
+
+// Renumbers vertices in order of first use so vertex fetch walks memory
+// linearly. The same remap is applied to every index list; vertices no
+// list uses go to the end.
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<std::vector<unsigned int>*> indexLists);
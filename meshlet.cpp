@@ -0,0 +1,142 @@
+#include "meshlet.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+static Meshlet meshletBounds(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+    unsigned int first, unsigned int count) {
+    Meshlet m;
+    m.firstIndex = first;
+    m.indexCount = count;
+
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (unsigned int i = first; i < first + count; ++i) {
+        lo = glm::min(lo, vertices[indices[i]].Position);
+        hi = glm::max(hi, vertices[indices[i]].Position);
+    }
+    m.center = (lo + hi) * 0.5f;
+    m.radius = 0.0f;
+    for (unsigned int i = first; i < first + count; ++i)
+        m.radius = std::max(m.radius, glm::length(vertices[indices[i]].Position - m.center));
+
+    // cone around the average face normal; the widest face decides the angle
+    std::vector<glm::vec3> normals;
+    glm::vec3 sum(0.0f);
+    for (unsigned int i = first; i + 2 < first + count; i += 3) {
+        const glm::vec3& a = vertices[indices[i]].Position;
+        glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+        float len = glm::length(n);
+        if (len <= 0.0f) continue;
+        normals.push_back(n / len);
+        sum += n / len;
+    }
+    m.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    m.coneCutoff = 2.0f;
+    float sumLen = glm::length(sum);
+    if (sumLen > 0.0f && !normals.empty()) {
+        m.coneAxis = sum / sumLen;
+        float minDot = 1.0f;
+        for (const auto& n : normals) minDot = std::min(minDot, glm::dot(n, m.coneAxis));
+        // a cone of 90 degrees or more always has a front-facing part
+        if (minDot > 0.0f) m.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+    return m;
+}
+
+// Every edge (by position, so uv / normal seams do not open it) is walked
+// as often in one direction as in the other. Only then are
+// back faces hidden by front faces, nothing culls them on the GL side.
+static bool isClosed(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
+    std::map<std::tuple<float, float, float>, unsigned int> classOf;
+    std::vector<unsigned int> cls(vertices.size());
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        const glm::vec3& p = vertices[v].Position;
+        cls[v] = classOf.emplace(std::make_tuple(p.x, p.y, p.z), (unsigned int)classOf.size()).first->second;
+    }
+    std::unordered_map<unsigned long long, int> edges; // +1 per a->b, -1 per b->a (a < b)
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        for (int k = 0; k < 3; ++k) {
+            unsigned int a = cls[indices[i + k]], b = cls[indices[i + (k + 1) % 3]];
+            if (a == b) continue;
+            int dir = a < b ? 1 : -1;
+            if (a > b) std::swap(a, b);
+            edges[(unsigned long long)a << 32 | b] += dir;
+        }
+    for (const auto& e : edges)
+        if (e.second != 0) return false;
+    return true;
+}
+
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex>& vertices,
+    const std::vector<unsigned int>& indices, int maxVertices, int maxTriangles) {
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned int> usedBy(vertices.size(), ~0u); // meshlet that last counted the vertex
+    unsigned int first = 0, uniqueCount = 0, id = 0;
+    for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+        int fresh = 0;
+        for (int k = 0; k < 3; ++k)
+            if (usedBy[indices[i + k]] != id) fresh++;
+        bool full = (i - first) / 3 + 1 > (unsigned int)maxTriangles
+            || uniqueCount + fresh > (unsigned int)maxVertices;
+        if (full && i > first) {
+            meshlets.push_back(meshletBounds(vertices, indices, first, i - first));
+            first = i;
+            uniqueCount = 0;
+            id++;
+        }
+        for (int k = 0; k < 3; ++k)
+            if (usedBy[indices[i + k]] != id) {
+                usedBy[indices[i + k]] = id;
+                uniqueCount++;
+            }
+    }
+    if (indices.size() / 3 * 3 > first)
+        meshlets.push_back(meshletBounds(vertices, indices, first, (unsigned int)(indices.size() / 3 * 3) - first));
+    if (!isClosed(vertices, indices))
+        for (auto& m : meshlets) m.coneCutoff = 2.0f;
+    return meshlets;
+}
+
+void frustumPlanes(const glm::mat4& clip, glm::vec4 planes[6]) {
+    glm::vec4 w(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+    for (int i = 0; i < 3; ++i) {
+        glm::vec4 row(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+        planes[2 * i] = w + row;
+        planes[2 * i + 1] = w - row;
+    }
+    for (int i = 0; i < 6; ++i) planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+void cullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& clip,
+    const glm::vec3& eye, std::vector<glm::uvec2>& ranges, MeshletCullStats& stats) {
+    // frustum planes in object space
+    glm::vec4 planes[6];
+    frustumPlanes(clip, planes);
+
+    size_t firstNew = ranges.size();
+    for (const Meshlet& m : meshlets) {
+        stats.tested++;
+        stats.triangles += m.indexCount / 3;
+
+        bool outside = false;
+        for (const auto& p : planes)
+            if (glm::dot(glm::vec3(p), m.center) + p.w < -m.radius) { outside = true; break; }
+        if (outside) { stats.frustumCulled++; continue; }
+
+        glm::vec3 toCenter = m.center - eye;
+        if (glm::dot(toCenter, m.coneAxis) >= m.coneCutoff * glm::length(toCenter) + m.radius) {
+            stats.backfaceCulled++;
+            continue;
+        }
+
+        stats.trianglesKept += m.indexCount / 3;
+        if (ranges.size() > firstNew && ranges.back().x + ranges.back().y == m.firstIndex)
+            ranges.back().y += m.indexCount;
+        else
+            ranges.push_back(glm::uvec2(m.firstIndex, m.indexCount));
+    }
+    stats.ranges += (int)(ranges.size() - firstNew);
+}
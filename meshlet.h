@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "vertex_layout.h"
+
+// A small piece of a mesh with the bounds needed to cull it on the CPU.
+// Meshlets are consecutive runs of the (cache-optimized) index list, so a
+// visible set is just a list of index ranges into the existing buffer.
+struct Meshlet {
+    unsigned int firstIndex, indexCount;
+    glm::vec3 center;   // bounding sphere
+    float radius;
+    glm::vec3 coneAxis; // average facing direction
+    float coneCutoff;   // sine of the normal cone half angle, > 1: never back-facing
+};
+
+// Greedy split of the triangle stream: a meshlet closes when the next
+// triangle would exceed maxVertices unique vertices or maxTriangles.
+// Cones are only kept for closed, consistently wound meshes: elsewhere a
+// back face can be what the camera sees.
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex>& vertices,
+    const std::vector<unsigned int>& indices, int maxVertices = 64, int maxTriangles = 124);
+
+// Frustum planes of clip = P * V (* M) as (normal, d), normalized, so a
+// sphere is outside when dot(normal, c) + d < -radius (Gribb / Hartmann)
+void frustumPlanes(const glm::mat4& clip, glm::vec4 planes[6]);
+
+struct MeshletCullStats {
+    int tested = 0, frustumCulled = 0, backfaceCulled = 0, ranges = 0;
+    long long triangles = 0, trianglesKept = 0;
+};
+
+// Appends the index ranges (first, count) of the meshlets that are inside
+// the frustum and not entirely back-facing; adjacent survivors are merged.
+// clipFromObject = P * V * M, eye is the camera position in object space.
+void cullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& clipFromObject,
+    const glm::vec3& eye, std::vector<glm::uvec2>& ranges, MeshletCullStats& stats);
@@ -3,26 +3,64 @@
 
 #include "model.h"
 #include "lodepng.h"
+#include "gl_state.h"
+#include "mesh_lod.h"
+#include "mesh_optimize.h"
+#include "trace.h"
 #include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
 
-Model::Model(const std::string& path) {
+bool Model::halfDepthPositions = false;
+bool Model::optimizeMeshes = true;
+int Model::meshletMinTriangles = 2048;
+bool Model::cpuOnly = false;
+bool Model::printLods = false;
+
+Model::Model(const std::string& path, VertexFormat format, int lodLevels)
+    : format(format), lodLevels(lodLevels), name(path) {
     loadModel(path);
+    processMesh();
     setupMesh();
 }
 
-void Model::Draw(ShaderProgram* shader) {
-    shader->use();
+DrawItem Model::drawItem(ShaderProgram* shader, const glm::mat4& M, const glm::mat3& normalMatrix,
+    bool depthOnly, int lod) const {
+    const LodLevel& level = lods[std::min(std::max(lod, 0), (int)lods.size() - 1)];
+    DrawItem item;
+    item.shader = shader;
+    item.vao = depthOnly ? depthVAO : VAO;
+    item.texture = depthOnly ? 0 : textureID;
+    item.firstIndex = level.firstIndex;
+    item.indexCount = level.indexCount;
+    item.model = M;
+    item.normalMatrix = normalMatrix;
+    item.posOffset = posOffset;
+    item.posScale = posScale;
+    return item;
+}
 
-    glActiveTexture(GL_TEXTURE0); // activate texture unit 0
-    glBindTexture(GL_TEXTURE_2D, textureID); // bind the texture
-    glUniform1i(shader->u("texture0"), 0); // tell the shader to use it
+void Model::enableInstanceTransforms(GLuint buffer) {
+    ::enableInstanceTransforms(VAO, buffer);
+    ::enableInstanceTransforms(depthVAO, buffer);
+}
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+int Model::selectLod(const glm::vec3& center, float scale, const LodView& view, float maxPixelError) const {
+    // bounding sphere around the world center of the box, error scaled by
+    // the largest axis scale
+    float radius = glm::length(boundsMax - boundsMin) * 0.5f * scale;
+    float distance = std::max(glm::length(center - view.eye) - radius, 1e-3f);
+
+    int lod = 0;
+    for (int i = 1; i < (int)lods.size(); ++i)
+        if (lods[i].error * scale * view.pixelsPerUnit / distance <= maxPixelError) lod = i;
+    return lod;
 }
 
 void Model::loadModel(const std::string& path) {
+    TRACE_SCOPE("Model::loadModel");
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -30,8 +68,12 @@ void Model::loadModel(const std::string& path) {
 
     std::string mtlBaseDir = path.substr(0, path.find_last_of("/\\") + 1);
 
-    bool ret = tinyobj::LoadObj(
-        &attrib, &shapes, &materials, &warn, &err, path.c_str(), mtlBaseDir.c_str(), true);
+    bool ret;
+    {
+        TRACE_SCOPE("tinyobj::LoadObj");
+        ret = tinyobj::LoadObj(
+            &attrib, &shapes, &materials, &warn, &err, path.c_str(), mtlBaseDir.c_str(), true);
+    }
 
     if (!warn.empty()) std::cout << "WARN: " << warn << std::endl;
     if (!err.empty()) std::cerr << "ERR: " << err << std::endl;
@@ -100,9 +142,14 @@ void Model::loadModel(const std::string& path) {
 }
 
 void Model::loadTexture(const std::string& filename) {
+    texturePath = filename;
+    if (cpuOnly) return;
     std::vector<unsigned char> image;
-    unsigned width, height;
-    unsigned error = lodepng::decode(image, width, height, filename);
+    unsigned width, height, error;
+    {
+        TRACE_SCOPE("lodepng::decode");
+        error = lodepng::decode(image, width, height, filename);
+    }
 
     if (error) {
         std::cerr << "Failed to load texture " << filename << ": " << lodepng_error_text(error) << "\n";
@@ -110,7 +157,7 @@ void Model::loadTexture(const std::string& filename) {
     }
 
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    glState.bindTexture(0, GL_TEXTURE_2D, textureID);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data());
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -119,26 +166,163 @@ void Model::loadTexture(const std::string& filename) {
     glGenerateMipmap(GL_TEXTURE_2D);
 }
 
-void Model::setupMesh() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    glBindVertexArray(VAO);
+// Quantize every vertex and report the worst error the packing introduced
+template <typename Packed>
+std::vector<Packed> Model::packVertices(const char* formatName) {
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (const auto& v : vertices) {
+        lo = glm::min(lo, v.Position);
+        hi = glm::max(hi, v.Position);
+    }
+    posOffset = lo;
+    posScale = glm::max(hi - lo, glm::vec3(1e-6f));
+    glm::vec3 invScale = 1.0f / posScale;
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    std::vector<Packed> packed;
+    packed.reserve(vertices.size());
+    float posErr = 0.0f, normalErr = 0.0f, uvErr = 0.0f;
+    for (const auto& v : vertices) {
+        Packed p = Packed::encode(v, posOffset, invScale);
+        Vertex d = p.decode(posOffset, posScale);
+        posErr = std::max(posErr, glm::length(d.Position - v.Position));
+        if (glm::dot(v.Normal, v.Normal) > 0.0f) {
+            float c = glm::dot(glm::normalize(d.Normal), glm::normalize(v.Normal));
+            normalErr = std::max(normalErr, glm::degrees(std::acos(glm::clamp(c, -1.0f, 1.0f))));
+        }
+        uvErr = std::max(uvErr, glm::length(d.TexCoords - v.TexCoords));
+        packed.push_back(p);
+    }
+
+    printf("[MODEL] %s: %s %zu B/vertex (float %zu B), max error pos %.3f mm, normal %.2f deg, uv %.5f\n",
+        name.c_str(), formatName, sizeof(Packed), sizeof(Vertex), posErr * 1000.0f, normalErr, uvErr);
+    return packed;
+}
 
+// Weld the per-corner vertices into a shared-vertex mesh, build the
+// simplified levels (or load them from the cache next to the OBJ) and
+// reorder everything for the vertex cache, overdraw and vertex fetch
+void Model::processMesh() {
+    size_t corners = vertices.size();
+    weldVertices(vertices, indices);
+
+    std::vector<SimplifiedLevel> levels;
+    bool cached = false;
+    if (lodLevels > 1 && !indices.empty()) {
+        std::string cachePath = name + ".lod";
+        unsigned long long hash = lodCacheHash(vertices, indices, lodLevels - 1, LOD_RATIO);
+        cached = loadLodCache(cachePath, hash, levels);
+        if (!cached) {
+            levels = simplifyLevels(vertices, indices, lodLevels - 1, LOD_RATIO);
+            if (!saveLodCache(cachePath, hash, levels))
+                fprintf(stderr, "[LOD] could not write %s\n", cachePath.c_str());
+        }
+    }
+
+    // triangle order for the post-transform cache and overdraw, then
+    // vertex order for fetch; the levels are reordered the same way
+    if (optimizeMeshes && !indices.empty()) {
+        CacheStats before = analyzeVertexCache(indices, vertices.size());
+        std::vector<unsigned int> original = indices;
+        std::vector<unsigned int> clusters = optimizeVertexCache(indices, vertices.size());
+        optimizeOverdraw(indices, clusters, vertices);
+        // small meshes that already came in a good order can lose
+        if (analyzeVertexCache(indices, vertices.size()).acmr > before.acmr) indices.swap(original);
+        std::vector<std::vector<unsigned int>*> lists = { &indices };
+        for (auto& l : levels) {
+            optimizeVertexCache(l.indices, vertices.size());
+            lists.push_back(&l.indices);
+        }
+        optimizeVertexFetch(vertices, lists);
+        CacheStats after = analyzeVertexCache(indices, vertices.size());
+        printf("[MESHOPT] %s: %zu triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name.c_str(),
+            indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+
+    lods.clear();
+    lodIndices.clear();
+    lods.push_back({ 0, (GLsizei)indices.size(), 0.0f });
+    for (const auto& l : levels) {
+        lods.push_back({ (GLuint)(indices.size() + lodIndices.size()), (GLsizei)l.indices.size(), l.error });
+        lodIndices.insert(lodIndices.end(), l.indices.begin(), l.indices.end());
+    }
+
+    // meshlets follow the final triangle order of every level
+    meshlets.assign(lods.size(), std::vector<Meshlet>());
+    if ((int)indices.size() / 3 >= meshletMinTriangles) {
+        meshlets[0] = buildMeshlets(vertices, indices);
+        for (size_t i = 1; i < lods.size(); ++i) {
+            meshlets[i] = buildMeshlets(vertices, levels[i - 1].indices);
+            for (auto& m : meshlets[i]) m.firstIndex += lods[i].firstIndex;
+        }
+        printf("[MESHLET] %s: meshlets per level", name.c_str());
+        for (const auto& level : meshlets) printf(" %zu", level.size());
+        printf(", %.1f triangles each at full detail\n", indices.size() / 3.0 / meshlets[0].size());
+    }
+    if (lodLevels > 1 && printLods) {
+        printf("[LOD] %s: %zu -> %zu vertices,%s triangles", name.c_str(), corners, vertices.size(),
+            cached ? " cached," : "");
+        for (const auto& l : lods) printf(" %d (%.2f mm)", l.indexCount / 3, l.error * 1000.0f);
+        printf("\n");
+    }
+}
+
+void Model::setupMesh() {
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+    for (const auto& v : vertices) {
+        boundsMin = glm::min(boundsMin, v.Position);
+        boundsMax = glm::max(boundsMax, v.Position);
+    }
+    if (vertices.empty()) boundsMin = boundsMax = glm::vec3(0.0f);
+    if (cpuOnly) return;
+
+    glGenBuffers(1, &EBO);
+    glState.bindVertexArray(0); // keep the element binding out of any live VAO
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    // full mesh first, the simplified levels follow in the same buffer
+    size_t total = indices.size() + lodIndices.size();
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, total * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data());
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+        lodIndices.size() * sizeof(unsigned int), lodIndices.data());
 
-    glEnableVertexAttribArray(0); // Position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // Lit pass stream and a position-only stream for shadow / depth passes,
+    // both sharing the index buffer. Packed formats reuse their quantized
+    // positions for depth, float models store 12 B floats or 8 B halves.
+    if (format == VertexFormat::Packed16) {
+        std::vector<PackedVertex16> packed = packVertices<PackedVertex16>("packed16");
+        createVertexStream<Packed16VertexLayout>(packed, EBO, VAO, VBO);
 
-    glEnableVertexAttribArray(1); // Normal
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        std::vector<glm::u16vec4> positions;
+        positions.reserve(packed.size());
+        for (const auto& p : packed) positions.push_back(p.Position);
+        createVertexStream<Unorm16PositionLayout>(positions, EBO, depthVAO, depthVBO);
+    }
+    else if (format == VertexFormat::Packed12) {
+        std::vector<PackedVertex12> packed = packVertices<PackedVertex12>("packed12");
+        createVertexStream<Packed12VertexLayout>(packed, EBO, VAO, VBO);
 
-    glEnableVertexAttribArray(2); // TexCoords
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        std::vector<glm::uint32> positions;
+        positions.reserve(packed.size());
+        for (const auto& p : packed) positions.push_back(p.Position);
+        createVertexStream<Unorm10PositionLayout>(positions, EBO, depthVAO, depthVBO);
+    }
+    else {
+        createVertexStream<FloatVertexLayout>(vertices, EBO, VAO, VBO);
 
-    glBindVertexArray(0);
+        if (halfDepthPositions) {
+            std::vector<glm::u16vec4> positions;
+            positions.reserve(vertices.size());
+            for (const auto& v : vertices)
+                positions.push_back(glm::u16vec4(glm::packHalf1x16(v.Position.x),
+                    glm::packHalf1x16(v.Position.y), glm::packHalf1x16(v.Position.z), 0));
+            createVertexStream<HalfPositionLayout>(positions, EBO, depthVAO, depthVBO);
+        }
+        else {
+            std::vector<glm::vec3> positions;
+            positions.reserve(vertices.size());
+            for (const auto& v : vertices) positions.push_back(v.Position);
+            createVertexStream<FloatPositionLayout>(positions, EBO, depthVAO, depthVBO);
+        }
+    }
 }
@@ -5,26 +5,87 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include "shaderprogram.h"
+#include "render_queue.h"
+#include "vertex_layout.h"
+#include "meshlet.h"
 
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
+// Where an instance is seen from when picking its level of detail:
+// projected error in pixels = world error * pixelsPerUnit / distance
+struct LodView {
+    glm::vec3 eye;
+    float pixelsPerUnit;
 };
 
 class Model {
 public:
-    Model(const std::string& path);
-    void Draw(ShaderProgram* shader);
+    // lodLevels > 1 builds that many levels in total (the full mesh is level 0)
+    Model(const std::string& path, VertexFormat format = VertexFormat::Float32, int lodLevels = 1);
+    // same draws as a render queue entry; depthOnly picks the position stream
+    DrawItem drawItem(ShaderProgram* shader, const glm::mat4& M, const glm::mat3& normalMatrix,
+        bool depthOnly, int lod = 0) const;
+
+    // coarsest level whose error stays under maxPixelError from the view,
+    // for an instance with its box center at center and the given largest
+    // axis scale
+    int selectLod(const glm::vec3& center, float scale, const LodView& view, float maxPixelError) const;
+    int lodCount() const { return (int)lods.size(); }
+    int lodTriangles(int lod) const { return lods[lod].indexCount / 3; }
+    float lodError(int lod) const { return lods[lod].error; }
+    // meshlets of one level (index ranges into the model's EBO), empty for light models
+    const std::vector<Meshlet>& getMeshlets(int lod) const { return meshlets[lod]; }
+
+    // feed the instance transform attribute of both streams from buffer
+    void enableInstanceTransforms(GLuint buffer);
+
+    // CPU-side mesh, kept for load-time processing such as static batching
+    const std::vector<Vertex>& getVertices() const { return vertices; }
+    const std::vector<unsigned int>& getIndices() const { return indices; }
+    const std::string& getTexturePath() const { return texturePath; }
+    // object-space bounding box
+    const glm::vec3& getBoundsMin() const { return boundsMin; }
+    const glm::vec3& getBoundsMax() const { return boundsMax; }
+
+    // store depth-pass positions as half floats (set before loading models)
+    static bool halfDepthPositions;
+    // reorder triangles and vertices at load time (see mesh_optimize.h)
+    static bool optimizeMeshes;
+    // models with at least this many triangles are split into meshlets
+    static int meshletMinTriangles;
+    // keep meshes on the CPU only, no GL context needed (software renderer);
+    // the texture is left to the consumer, see getTexturePath()
+    static bool cpuOnly;
+    // print every model's simplified levels as it loads (--lod-stats)
+    static bool printLods;
 
 private:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
-    GLuint textureID;
+    GLuint textureID = 0;
+    std::string texturePath;
+    VertexFormat format;
+    // dequantization for packed positions: p = posOffset + q * posScale
+    glm::vec3 posOffset = glm::vec3(0.0f), posScale = glm::vec3(1.0f);
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
     GLuint VAO, VBO, EBO;
+    GLuint depthVAO, depthVBO; // tightly packed positions only
+
+    // index ranges in the EBO: the full mesh, then each simplified level
+    struct LodLevel {
+        GLuint firstIndex;
+        GLsizei indexCount;
+        float error; // object-space distance
+    };
+    std::vector<LodLevel> lods;
+    std::vector<unsigned int> lodIndices; // levels 1.. appended after indices
+    int lodLevels;
+    std::vector<std::vector<Meshlet>> meshlets; // per level
 
     void loadModel(const std::string& path);
     void processMesh();
     void loadTexture(const std::string& filename);
     void setupMesh();
+    template <typename Packed>
+    std::vector<Packed> packVertices(const char* formatName);
+
+    std::string name;
 };
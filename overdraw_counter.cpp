@@ -0,0 +1,49 @@
+#include "overdraw_counter.h"
+#include <cstdio>
+
+OverdrawCounter::OverdrawCounter() {
+    glGenQueries(RING, queries);
+}
+
+OverdrawCounter::~OverdrawCounter() {
+    glDeleteQueries(RING, queries);
+}
+
+void OverdrawCounter::begin() {
+    collect(false);
+    // the slot about to be reused must be read even if the GPU is behind
+    if (pending[frame % RING]) collect(true);
+    glBeginQuery(GL_SAMPLES_PASSED, queries[frame % RING]);
+}
+
+void OverdrawCounter::collect(bool wait) {
+    // oldest first, so lastRatio() always belongs to the newest result read
+    for (int i = 0; i < RING; ++i) {
+        int slot = (frame + i) % RING;
+        if (!pending[slot]) continue;
+        GLuint available = GL_TRUE;
+        if (!wait) glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        GLuint64 fragments = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &fragments);
+        lastFragments = fragments;
+        lastPixels = pixels[slot];
+        ratioSum += lastRatio();
+        frames++;
+        pending[slot] = false;
+    }
+}
+
+void OverdrawCounter::end(int targetPixels) {
+    int slot = frame % RING;
+    glEndQuery(GL_SAMPLES_PASSED);
+    pixels[slot] = targetPixels;
+    pending[slot] = true;
+    frame++;
+}
+
+void OverdrawCounter::printStats(const char* label) const {
+    printf("[OVERDRAW] %s: %llu fragments shaded for %d pixels, %.2f per pixel (average %.2f over %d frames)\n",
+        label, (unsigned long long)lastFragments, lastPixels, lastRatio(),
+        frames ? ratioSum / frames : 0.0, frames);
+}
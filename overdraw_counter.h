@@ -0,0 +1,34 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Counts the fragments that pass the depth test during a pass with
+// GL_SAMPLES_PASSED queries. Results are read a few frames late from a
+// small ring so the CPU never waits on the GPU.
+class OverdrawCounter {
+public:
+    OverdrawCounter();
+    ~OverdrawCounter();
+
+    void begin();
+    // pixels: size of the render target, for the per-pixel ratio
+    void end(int pixels);
+    // read back finished queries, or all of them when wait is set
+    void collect(bool wait);
+
+    // shaded fragments per pixel of the latest finished frame
+    double lastRatio() const { return lastFragments / (double)(lastPixels ? lastPixels : 1); }
+    void printStats(const char* label) const;
+
+private:
+    static const int RING = 3;
+    GLuint queries[RING] = {};
+    int pixels[RING] = {};
+    bool pending[RING] = {};
+    int frame = 0;
+
+    GLuint64 lastFragments = 0;
+    int lastPixels = 0;
+    double ratioSum = 0.0;
+    int frames = 0;
+};
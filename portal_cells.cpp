@@ -0,0 +1,125 @@
+#include "portal_cells.h"
+#include <algorithm>
+#include <cfloat>
+
+// in front of this w a point counts as behind the camera
+static const float MIN_W = 1e-4f;
+
+int PortalCells::addCell(const glm::vec3& lo, const glm::vec3& hi) {
+    cells.push_back({ glm::min(lo, hi), glm::max(lo, hi), {} });
+    return (int)cells.size() - 1;
+}
+
+int PortalCells::addPortal(int cellA, int cellB, const std::vector<glm::vec3>& corners) {
+    int id = (int)portals.size();
+    portals.push_back({ { cellA, cellB }, corners });
+    cells[cellA].portals.push_back(id);
+    cells[cellB].portals.push_back(id);
+    return id;
+}
+
+int PortalCells::cellAt(const glm::vec3& p) const {
+    for (size_t c = 0; c < cells.size(); ++c)
+        if (glm::all(glm::greaterThanEqual(p, cells[c].lo)) && glm::all(glm::lessThanEqual(p, cells[c].hi)))
+            return (int)c;
+    return -1;
+}
+
+void PortalCells::update(const glm::vec3& eye, const glm::mat4& vp) {
+    viewProj = vp;
+    portalsTested = portalsPassed = 0;
+    rects.assign(cells.size(), { glm::vec2(FLT_MAX), glm::vec2(-FLT_MAX) });
+    onPath.assign(cells.size(), false);
+    eyeCell = cellAt(eye);
+    if (eyeCell >= 0) flood(eyeCell, { glm::vec2(-1.0f), glm::vec2(1.0f) }, 0);
+}
+
+void PortalCells::flood(int cell, const Rect& rect, int depth) {
+    // seen along several chains: keep the bounds of all of them
+    rects[cell].lo = glm::min(rects[cell].lo, rect.lo);
+    rects[cell].hi = glm::max(rects[cell].hi, rect.hi);
+    if (depth == MAX_DEPTH) return;
+
+    onPath[cell] = true;
+    glm::vec4 clip[8];
+    for (int p : cells[cell].portals) {
+        const Portal& portal = portals[p];
+        int next = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+        if (onPath[next]) continue;
+        portalsTested++;
+
+        int count = std::min((int)portal.corners.size(), 8);
+        for (int i = 0; i < count; ++i) clip[i] = viewProj * glm::vec4(portal.corners[i], 1.0f);
+        Rect r;
+        if (!project(clip, count, r)) continue;
+        // the narrowed frustum: what of the doorway shows through the current one
+        r.lo = glm::max(r.lo, rect.lo);
+        r.hi = glm::min(r.hi, rect.hi);
+        if (r.empty()) continue;
+        portalsPassed++;
+        flood(next, r, depth + 1);
+    }
+    onPath[cell] = false;
+}
+
+bool PortalCells::project(const glm::vec4* clip, int count, Rect& r) const {
+    r = { glm::vec2(FLT_MAX), glm::vec2(-FLT_MAX) };
+    auto addPoint = [&](const glm::vec4& q) {
+        glm::vec2 ndc = glm::vec2(q) / q.w;
+        r.lo = glm::min(r.lo, ndc);
+        r.hi = glm::max(r.hi, ndc);
+    };
+    // clip the polygon against w = MIN_W; a doorway the camera stands in
+    // then spreads over the whole screen instead of flipping around
+    bool any = false;
+    for (int i = 0; i < count; ++i) {
+        const glm::vec4& a = clip[i];
+        const glm::vec4& b = clip[(i + 1) % count];
+        bool aIn = a.w > MIN_W, bIn = b.w > MIN_W;
+        if (aIn) { addPoint(a); any = true; }
+        if (aIn != bIn) {
+            float t = (MIN_W - a.w) / (b.w - a.w);
+            addPoint(a + (b - a) * t);
+            any = true;
+        }
+    }
+    return any;
+}
+
+bool PortalCells::cellVisible(int cell) const {
+    return eyeCell < 0 || cell < 0 || !rects[cell].empty();
+}
+
+bool PortalCells::visible(const glm::vec3& lo, const glm::vec3& hi) const {
+    if (eyeCell < 0) return true;
+    int cell = cellAt((lo + hi) * 0.5f);
+    if (cell < 0) return true;
+    const Rect& seen = rects[cell];
+    if (seen.empty()) return false;
+
+    const glm::mat4& clip = viewProj;
+    Rect r = { glm::vec2(FLT_MAX), glm::vec2(-FLT_MAX) };
+    for (int c = 0; c < 8; ++c) {
+        glm::vec4 q = clip * glm::vec4(c & 1 ? hi.x : lo.x, c & 2 ? hi.y : lo.y, c & 4 ? hi.z : lo.z, 1.0f);
+        if (q.w <= MIN_W) return true; // reaches behind the camera
+        r.lo = glm::min(r.lo, glm::vec2(q) / q.w);
+        r.hi = glm::max(r.hi, glm::vec2(q) / q.w);
+    }
+    return r.lo.x <= seen.hi.x && r.hi.x >= seen.lo.x && r.lo.y <= seen.hi.y && r.hi.y >= seen.lo.y;
+}
+
+bool PortalCells::lightVisible(const glm::vec3& position, float radius) const {
+    if (eyeCell < 0) return true;
+    for (size_t c = 0; c < cells.size(); ++c) {
+        if (rects[c].empty()) continue;
+        glm::vec3 d = position - glm::clamp(position, cells[c].lo, cells[c].hi);
+        if (glm::dot(d, d) <= radius * radius) return true;
+    }
+    return false;
+}
+
+int PortalCells::visibleCells() const {
+    int n = 0;
+    for (int c = 0; c < cellCount(); ++c) n += cellVisible(c);
+    return n;
+}
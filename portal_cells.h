@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Cell-and-portal visibility. Rooms are cells (axis-aligned boxes), doorways
+// are portals: convex polygons joining two cells. Every frame the camera's
+// screen rectangle is narrowed through the portals it can see, recursively,
+// starting in the camera's cell: a room is only visible through the chain of
+// doorways leading to it, and only where those doorways overlap on screen.
+// Objects are tested against the rectangle of the cell they stand in, lights
+// count as visible when their range reaches into a visible cell.
+// Anything outside every cell, the camera included, is always visible.
+class PortalCells {
+public:
+    int addCell(const glm::vec3& lo, const glm::vec3& hi);
+    // corners in order around the doorway, in world space
+    int addPortal(int cellA, int cellB, const std::vector<glm::vec3>& corners);
+
+    // cell containing p, -1 if none
+    int cellAt(const glm::vec3& p) const;
+
+    // flood the cells seen from eye through viewProj
+    void update(const glm::vec3& eye, const glm::mat4& viewProj);
+
+    bool cellVisible(int cell) const;
+    // world-space box, in the cell of its center
+    bool visible(const glm::vec3& lo, const glm::vec3& hi) const;
+    // a light whose range overlaps a visible cell
+    bool lightVisible(const glm::vec3& position, float radius) const;
+
+    int cellCount() const { return (int)cells.size(); }
+    int cameraCell() const { return eyeCell; }
+    int visibleCells() const;
+    // portals projected / passed by the last update()
+    int portalsTested = 0, portalsPassed = 0;
+
+private:
+    // NDC rectangle, empty when lo > hi
+    struct Rect {
+        glm::vec2 lo, hi;
+        bool empty() const { return lo.x >= hi.x || lo.y >= hi.y; }
+    };
+    struct Cell {
+        glm::vec3 lo, hi;
+        std::vector<int> portals;
+    };
+    struct Portal {
+        int cells[2];
+        std::vector<glm::vec3> corners;
+    };
+
+    static const int MAX_DEPTH = 16;
+
+    std::vector<Cell> cells;
+    std::vector<Portal> portals;
+
+    glm::mat4 viewProj = glm::mat4(1.0f);
+    int eyeCell = -1;
+    std::vector<Rect> rects;     // per cell: bounds of the rectangles it is seen through
+    std::vector<bool> onPath;    // cells of the portal chain being walked
+
+    void flood(int cell, const Rect& rect, int depth);
+    // screen bounds of the part of a polygon in front of the near plane
+    bool project(const glm::vec4* clip, int count, Rect& r) const;
+};
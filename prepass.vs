@@ -0,0 +1,25 @@
+#version 330 core
+
+layout(location = 0) in vec3 vertex;
+layout(location = 4) in uint instanceTransform;
+uniform mat4 M;
+uniform mat4 V;
+uniform mat4 P;
+uniform vec3 posOffset;   // dequantization of packed positions
+uniform vec3 posScale;
+uniform bool gpuDriven;   // M from instanceTransforms, as in v_textures.glsl
+uniform samplerBuffer instanceTransforms;
+
+// must produce bit-identical depth to v_textures.glsl for the GL_LEQUAL lit pass
+invariant gl_Position;
+
+void main() {
+    mat4 model = M;
+    if (gpuDriven) {
+        int t = int(instanceTransform) * 7;
+        model = mat4(texelFetch(instanceTransforms, t), texelFetch(instanceTransforms, t + 1),
+                     texelFetch(instanceTransforms, t + 2), texelFetch(instanceTransforms, t + 3));
+    }
+    vec4 worldPosition = model * vec4(posOffset + vertex * posScale, 1.0);
+    gl_Position = P * V * worldPosition;
+}
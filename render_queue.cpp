@@ -0,0 +1,188 @@
+#include "render_queue.h"
+#include "gl_state.h"
+#include "trace.h"
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/type_ptr.hpp>
+
+void RenderQueue::submit(const DrawItem& item, Pass pass, float viewDepth, float farPlane) {
+    uint64_t depth = (uint64_t)(glm::clamp(viewDepth / farPlane, 0.0f, 1.0f) * 0xFFFFFF);
+    uint64_t key = ((uint64_t)pass & 0xF) << 60
+        | ((uint64_t)item.shader->id() & 0xFF) << 52
+        | ((uint64_t)item.texture & 0xFFFF) << 36
+        | ((uint64_t)item.vao & 0xFFF) << 24
+        | depth;
+    items.push_back(item);
+    keys.push_back(key);
+}
+
+int RenderQueue::addRanges(const glm::uvec2* ranges, int count) {
+    int first = (int)rangeCounts.size();
+    for (int i = 0; i < count; ++i) {
+        rangeCounts.push_back((GLsizei)ranges[i].y);
+        rangeOffsets.push_back((const void*)(sizeof(unsigned int) * ranges[i].x));
+    }
+    return first;
+}
+
+void radixSortKeys(const std::vector<uint64_t>& keys, std::vector<uint32_t>& order,
+    std::vector<uint32_t>& scratch) {
+    size_t n = keys.size();
+    order.resize(n);
+    scratch.resize(n);
+    for (size_t i = 0; i < n; ++i) order[i] = (uint32_t)i;
+    if (n < 2) return;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t count[256] = {};
+        for (size_t i = 0; i < n; ++i) ++count[(keys[i] >> shift) & 0xFF];
+        if (count[(keys[0] >> shift) & 0xFF] == n) continue; // digit identical everywhere
+
+        size_t offset = 0;
+        for (int d = 0; d < 256; ++d) {
+            size_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t idx = order[i];
+            scratch[count[(keys[idx] >> shift) & 0xFF]++] = idx;
+        }
+        order.swap(scratch);
+    }
+}
+
+void RenderQueue::sort() {
+    radixSortKeys(keys, order, scratch);
+}
+
+const RenderQueue::Locations& RenderQueue::locationsFor(ShaderProgram* shader) {
+    auto it = locations.find(shader);
+    if (it != locations.end()) return it->second;
+    Locations l;
+    l.model = shader->u("M");
+    l.normalMatrix = shader->u("normalMatrix");
+    l.posOffset = shader->u("posOffset");
+    l.posScale = shader->u("posScale");
+    l.texture0 = shader->u("texture0");
+    l.useTextureArray = shader->u("useTextureArray");
+    l.gpuDriven = shader->u("gpuDriven");
+    return locations.insert({ shader, l }).first->second;
+}
+
+void RenderQueue::execute() {
+    TRACE_SCOPE("RenderQueue::execute");
+    if (order.size() != items.size()) sort();
+
+    // binds are filtered by glState, uniforms here; uniform values are
+    // unknown on entry, so the first item of each program sets them
+    ShaderProgram* curShader = nullptr;
+    const Locations* loc = nullptr;
+    int curUseArray = -1, curDriven = -1;
+    GLuint curIndirect = 0;
+    glm::vec3 curOffset(NAN), curScale(NAN);
+
+    for (uint32_t idx : order) {
+        const DrawItem& it = items[idx];
+
+        if (it.shader != curShader) {
+            if (glState.useProgram(it.shader->id())) issued.programBinds++;
+            curShader = it.shader;
+            loc = &locationsFor(it.shader);
+            // sampler units are fixed: 2D on unit 0, arrays on unit 1
+            if (loc->texture0 >= 0) { glUniform1i(loc->texture0, 0); issued.uniformUploads++; }
+            curUseArray = curDriven = -1;
+            curOffset = curScale = glm::vec3(NAN);
+        }
+        bool textured = loc->texture0 >= 0;
+
+        // what drawing every object on its own would issue: VAO bind + unbind
+        // and every per-draw uniform, plus program, texture and sampler
+        // uniform for lit draws; an indirect draw stands for all its objects
+        int objects = it.indirectCount > 0 ? it.indirectCount : 1;
+        naive.draws += objects;
+        naive.vaoBinds += 2 * objects;
+        naive.uniformUploads += (loc->normalMatrix >= 0 ? 4 : 3) * objects;
+        if (textured) {
+            naive.programBinds += objects;
+            naive.textureBinds += objects;
+            naive.uniformUploads += objects;
+        }
+
+        if (textured) {
+            int slot = it.textureTarget == GL_TEXTURE_2D_ARRAY ? 1 : 0;
+            if (glState.bindTexture(slot, it.textureTarget, it.texture)) issued.textureBinds++;
+            if (loc->useTextureArray >= 0 && slot != curUseArray) {
+                glUniform1i(loc->useTextureArray, slot);
+                curUseArray = slot;
+                issued.uniformUploads++;
+            }
+        }
+
+        if (glState.bindVertexArray(it.vao)) issued.vaoBinds++;
+
+        int driven = it.indirectCount > 0;
+        if (loc->gpuDriven >= 0 && driven != curDriven) {
+            glUniform1i(loc->gpuDriven, driven);
+            curDriven = driven;
+            issued.uniformUploads++;
+        }
+        {
+            TRACE_SCOPE("per-draw uniforms");
+            if (!driven) {
+                glUniformMatrix4fv(loc->model, 1, GL_FALSE, glm::value_ptr(it.model));
+                issued.uniformUploads++;
+                if (loc->normalMatrix >= 0) {
+                    glUniformMatrix3fv(loc->normalMatrix, 1, GL_FALSE, glm::value_ptr(it.normalMatrix));
+                    issued.uniformUploads++;
+                }
+            }
+            if (it.posOffset != curOffset || it.posScale != curScale) {
+                glUniform3fv(loc->posOffset, 1, glm::value_ptr(it.posOffset));
+                glUniform3fv(loc->posScale, 1, glm::value_ptr(it.posScale));
+                curOffset = it.posOffset;
+                curScale = it.posScale;
+                issued.uniformUploads += 2;
+            }
+        }
+
+        if (driven) {
+            if (it.indirectBuffer != curIndirect) {
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, it.indirectBuffer);
+                curIndirect = it.indirectBuffer;
+            }
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)it.indirectOffset,
+                it.indirectCount, 0);
+            issued.commands += it.indirectCount;
+            glState.countDraw(0);
+        }
+        else if (it.rangeCount > 0) {
+            glMultiDrawElements(GL_TRIANGLES, &rangeCounts[it.firstRange], GL_UNSIGNED_INT,
+                &rangeOffsets[it.firstRange], it.rangeCount);
+            issued.ranges += it.rangeCount;
+            long long indices = 0;
+            for (int r = 0; r < it.rangeCount; ++r) indices += rangeCounts[it.firstRange + r];
+            glState.countDraw(indices / 3);
+        }
+        else {
+            glDrawElements(GL_TRIANGLES, it.indexCount, GL_UNSIGNED_INT,
+                (void*)(sizeof(unsigned int) * it.firstIndex));
+            glState.countDraw(it.indexCount / 3);
+        }
+        issued.draws++;
+    }
+}
+
+void RenderQueue::printStats(const char* label) const {
+    printf("[QUEUE] %s: draws %d | program binds %d -> %d | texture binds %d -> %d"
+        " | VAO binds %d -> %d | uniform uploads %d -> %d\n",
+        label, issued.draws,
+        naive.programBinds, issued.programBinds,
+        naive.textureBinds, issued.textureBinds,
+        naive.vaoBinds, issued.vaoBinds,
+        naive.uniformUploads, issued.uniformUploads);
+    if (issued.ranges > 0)
+        printf("[QUEUE] %s: %d index ranges in multi-draws\n", label, issued.ranges);
+    if (issued.commands > 0)
+        printf("[QUEUE] %s: %d indirect commands\n", label, issued.commands);
+}
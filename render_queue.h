@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "shaderprogram.h"
+
+// Everything needed to issue one indexed draw
+struct DrawItem {
+    ShaderProgram* shader = nullptr;
+    GLenum textureTarget = GL_TEXTURE_2D; // GL_TEXTURE_2D on unit 0 or
+    GLuint texture = 0;                   // GL_TEXTURE_2D_ARRAY on unit 1
+    GLuint vao = 0;
+    GLuint firstIndex = 0;
+    GLsizei indexCount = 0;
+    // > 0: draw these ranges of the queue (RenderQueue::addRanges) with one
+    // glMultiDrawElements instead of firstIndex / indexCount
+    int firstRange = 0, rangeCount = 0;
+    // > 0: glMultiDrawElementsIndirect of this many commands at
+    // indirectOffset of indirectBuffer; the shader fetches the matrices
+    // itself (gpuDriven, see gpu_culling.h) and model is ignored
+    GLuint indirectBuffer = 0;
+    GLintptr indirectOffset = 0;
+    GLsizei indirectCount = 0;
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat3 normalMatrix = glm::mat3(1.0f);
+    glm::vec3 posOffset = glm::vec3(0.0f), posScale = glm::vec3(1.0f);
+};
+
+// Passes submit DrawItems with a packed 64-bit key
+//   [63:60] pass  [59:52] shader  [51:36] texture  [35:24] VAO  [23:0] depth
+// execute() walks them in key order and only issues the state changes that
+// differ from the previous item.
+class RenderQueue {
+public:
+    enum Pass { PassShadow = 0, PassDepth = 1, PassOpaque = 2 };
+
+    struct Stats {
+        int draws = 0;
+        int ranges = 0; // index ranges of multi-draws
+        int commands = 0; // indirect commands of GPU-driven draws
+        int programBinds = 0;
+        int textureBinds = 0;
+        int vaoBinds = 0;
+        int uniformUploads = 0;
+    };
+
+    // start a new frame; also resets the stats
+    void clear() {
+        items.clear(); keys.clear(); order.clear(); rangeCounts.clear(); rangeOffsets.clear();
+        resetStats();
+    }
+    // viewDepth: distance along the view direction, sorted front to back
+    void submit(const DrawItem& item, Pass pass, float viewDepth = 0.0f, float farPlane = 1.0f);
+    // store index ranges (first index, count) for a DrawItem, returns its firstRange
+    int addRanges(const glm::uvec2* ranges, int count);
+    void sort();
+    void execute();
+
+    // calls the unsorted per-object path would have issued / calls issued,
+    // summed over every execute() since the last clear()
+    Stats naive, issued;
+    void resetStats() { naive = Stats(); issued = Stats(); }
+    void printStats(const char* label) const;
+
+private:
+    struct Locations {
+        GLint model, normalMatrix, posOffset, posScale, texture0, useTextureArray, gpuDriven;
+    };
+
+    std::vector<DrawItem> items;
+    std::vector<uint64_t> keys;      // key per item
+    std::vector<uint32_t> order;     // item indices in key order
+    std::vector<uint32_t> scratch;
+    std::vector<GLsizei> rangeCounts;
+    std::vector<const void*> rangeOffsets;
+    std::map<ShaderProgram*, Locations> locations;
+
+    const Locations& locationsFor(ShaderProgram* shader);
+};
+
+// LSD radix sort of indices by their 64-bit keys, 8 bits per pass; passes
+// where every key has the same digit are skipped
+void radixSortKeys(const std::vector<uint64_t>& keys, std::vector<uint32_t>& order,
+    std::vector<uint32_t>& scratch);
@@ -1,4 +1,5 @@
 ﻿#include "shaderprogram.h"
+#include "gl_state.h"
 #include <cstdio>
 #include <cstdlib>
 #include <glm/gtc/type_ptr.hpp>
@@ -22,17 +23,52 @@ char* ShaderProgram::readFile(const char* fileName) {
     return buffer;
 }
 
+// Shaders share code (lighting.glsl) through #include "file" lines, one
+// level deep, paths as for the shader files. The pasted file is source
+// string 1 in compile logs, #line puts the rest back at its own numbers.
+std::string ShaderProgram::expandIncludes(const char* fileName, const char* src) {
+    std::string out;
+    int line = 1;
+    for (const char* p = src; *p; ++line) {
+        const char* end = p;
+        while (*end && *end != '\n') ++end;
+        std::string text(p, end);
+        p = *end ? end + 1 : end;
+
+        size_t open = text.find("#include \"");
+        size_t close = open == 0 ? text.find('"', 10) : std::string::npos;
+        if (close == std::string::npos) {
+            out += text + "\n";
+            continue;
+        }
+        std::string path = text.substr(10, close - 10);
+        char* included = readFile(path.c_str());
+        if (!included) {
+            fprintf(stderr, "Failed to load shader include %s in %s\n", path.c_str(), fileName);
+            out += "\n";
+            continue;
+        }
+        out += "#line 1 1\n";
+        out += included;
+        out += "\n#line " + std::to_string(line + 1) + " 0\n";
+        delete[] included;
+    }
+    return out;
+}
+
 // Compile a single shader stage, return its GLuint
 GLuint ShaderProgram::loadShader(GLenum shaderType, const char* fileName) {
     GLuint shader = glCreateShader(shaderType);
-    const char* src = readFile(fileName);
-    if (!src) {
+    char* file = readFile(fileName);
+    if (!file) {
         fprintf(stderr, "Failed to load shader file: %s\n", fileName);
         return 0;
     }
+    std::string source = expandIncludes(fileName, file);
+    delete[] file;
+    const char* src = source.c_str();
     glShaderSource(shader, 1, &src, nullptr);
     glCompileShader(shader);
-    delete[] src;
 
     // Check compile log
     GLint logLen = 0;
@@ -71,6 +107,21 @@ ShaderProgram::ShaderProgram(const char* vertexShaderFile,
     glAttachShader(shaderProgram, vertexShader);
     if (geometryShader) glAttachShader(shaderProgram, geometryShader);
     glAttachShader(shaderProgram, fragmentShader);
+    link();
+}
+
+// Build a program from a single compute shader
+ShaderProgram::ShaderProgram(const char* computeShaderFile)
+    : vertexShader(0), geometryShader(0), fragmentShader(0) {
+    printf("Loading compute shader: %s\n", computeShaderFile);
+    computeShader = loadShader(GL_COMPUTE_SHADER, computeShaderFile);
+
+    shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, computeShader);
+    link();
+}
+
+void ShaderProgram::link() {
     glLinkProgram(shaderProgram);
 
     // Check link log
@@ -88,20 +139,19 @@ ShaderProgram::ShaderProgram(const char* vertexShaderFile,
 
 // Destructor: detach & delete shaders, delete program
 ShaderProgram::~ShaderProgram() {
-    glDetachShader(shaderProgram, vertexShader);
-    if (geometryShader) glDetachShader(shaderProgram, geometryShader);
-    glDetachShader(shaderProgram, fragmentShader);
-
-    glDeleteShader(vertexShader);
-    if (geometryShader) glDeleteShader(geometryShader);
-    glDeleteShader(fragmentShader);
+    GLuint stages[4] = { vertexShader, geometryShader, fragmentShader, computeShader };
+    for (GLuint stage : stages) {
+        if (!stage) continue;
+        glDetachShader(shaderProgram, stage);
+        glDeleteShader(stage);
+    }
 
     glDeleteProgram(shaderProgram);
 }
 
 // Activate this shader program
 void ShaderProgram::use() {
-    glUseProgram(shaderProgram);
+    glState.useProgram(shaderProgram);
 }
 
 // Get uniform/attribute locations
@@ -1,6 +1,7 @@
 ﻿#ifndef SHADERPROGRAM_H
 #define SHADERPROGRAM_H
 
+#include <string>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
@@ -10,21 +11,30 @@ private:
     GLuint vertexShader;    // vertex shader handle
     GLuint geometryShader;  // geometry shader handle
     GLuint fragmentShader;  // fragment shader handle
+    GLuint computeShader = 0; // compute shader handle, alone in its program
 
     // load text file into null-terminated char*
     char* readFile(const char* fileName);
+    // paste the file of every #include "file" line in its place
+    std::string expandIncludes(const char* fileName, const char* src);
     // compile one shader stage and return its handle
     GLuint loadShader(GLenum shaderType, const char* fileName);
+    // link the attached stages and print the log
+    void link();
 
 public:
     // build from VS, optional GS, and FS
     ShaderProgram(const char* vertexShaderFile,
         const char* geometryShaderFile,
         const char* fragmentShaderFile);
+    // build a compute program (GL 4.3)
+    explicit ShaderProgram(const char* computeShaderFile);
     ~ShaderProgram();
 
     // use this shader program
     void use();
+    // program handle, used to sort draws by shader
+    GLuint id() const { return shaderProgram; }
 
     // get locations
     GLuint u(const char* variableName); // uniform
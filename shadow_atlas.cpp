@@ -0,0 +1,152 @@
+#include "shadow_atlas.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// spread the even / odd bits of a Morton index into x / y
+static glm::ivec2 mortonDecode(unsigned int m) {
+    glm::ivec2 p(0);
+    for (int bit = 0; bit < 16; ++bit) {
+        p.x |= ((m >> (2 * bit)) & 1u) << bit;
+        p.y |= ((m >> (2 * bit + 1)) & 1u) << bit;
+    }
+    return p;
+}
+
+static int bytesPerTexel(int depthBits) {
+    return depthBits <= 16 ? 2 : 4; // 24-bit depth is stored padded to 32
+}
+
+ShadowAtlas::ShadowAtlas(size_t budgetBytes, int bits, bool casterMask) : depthBits(bits <= 16 ? 16 : 24) {
+    atlasSize = 256;
+    while ((size_t)(atlasSize * 2) * (atlasSize * 2) * bytesPerTexel(depthBits) <= budgetBytes
+        && atlasSize < 16384)
+        atlasSize *= 2;
+
+    GLenum internalFormat = depthBits == 16 ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT24;
+    GLenum type = depthBits == 16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    glGenTextures(1, &depthTexture);
+    glState.bindTexture(0, GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, atlasSize, atlasSize, 0,
+        GL_DEPTH_COMPONENT, type, nullptr);
+    // hardware depth compare, LINEAR gives a free 2x2 PCF per tap
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    glGenFramebuffers(1, &framebuffer);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+    if (casterMask) {
+        glGenTextures(1, &maskTexture);
+        glState.bindTexture(0, GL_TEXTURE_2D, maskTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasSize, atlasSize, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, maskTexture, 0);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    }
+    else
+        glDrawBuffer(GL_NONE); // no color
+    glReadBuffer(GL_NONE);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowAtlas::~ShadowAtlas() {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &maskTexture);
+}
+
+bool ShadowAtlas::pack(std::vector<int> faceSizes) {
+    // shrink the biggest lights until all faces fit
+    for (;;) {
+        size_t area = 0;
+        for (int s : faceSizes) area += (size_t)6 * s * s;
+        if (area <= (size_t)atlasSize * atlasSize) break;
+        auto biggest = std::max_element(faceSizes.begin(), faceSizes.end());
+        if (*biggest <= 16) break;
+        *biggest /= 2;
+    }
+    for (int& s : faceSizes) s = std::min(s, atlasSize);
+
+    if (faceSizes == lightFaceSize) return false;
+    lightFaceSize = faceSizes;
+
+    // power-of-two squares placed largest first at their running Morton
+    // offset never overlap and leave no holes
+    std::vector<int> order(faceSizes.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(),
+        [&](int a, int b) { return faceSizes[a] > faceSizes[b]; });
+
+    rects.assign(faceSizes.size() * 6, glm::vec4(0.0f));
+    origins.assign(faceSizes.size() * 6, glm::ivec2(0));
+    size_t offset = 0; // in texels
+    for (int light : order) {
+        int s = faceSizes[light];
+        for (int f = 0; f < 6; ++f) {
+            glm::ivec2 o = mortonDecode((unsigned int)(offset / ((size_t)s * s))) * s;
+            origins[light * 6 + f] = o;
+            rects[light * 6 + f] = glm::vec4(glm::vec2(o), glm::vec2((float)s)) / (float)atlasSize;
+            offset += (size_t)s * s;
+        }
+    }
+    return true;
+}
+
+void ShadowAtlas::bindLight(int light) {
+    glState.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    int s = lightFaceSize[light];
+    for (int f = 0; f < 6; ++f) {
+        glm::ivec2 o = origins[light * 6 + f];
+        glState.viewportIndexed(f, (float)o.x, (float)o.y, (float)s, (float)s);
+    }
+}
+
+void ShadowAtlas::clear() {
+    // glClear ignores the viewport, no need to widen it to the whole atlas
+    glState.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    // no caster anywhere yet; glClearBuffer leaves the clear color alone
+    if (maskTexture) {
+        const GLfloat none[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, none);
+    }
+}
+
+size_t ShadowAtlas::bytes() const {
+    return (size_t)atlasSize * atlasSize * (bytesPerTexel(depthBits) + (maskTexture ? 1 : 0));
+}
+
+void ShadowAtlas::printUsage() const {
+    size_t used = 0;
+    for (int s : lightFaceSize) used += (size_t)6 * s * s;
+    printf("[SHADOW] atlas %dx%d DEPTH%d%s: %.1f MB VRAM, %.0f%% in use\n",
+        atlasSize, atlasSize, depthBits, maskTexture ? " + R8 caster mask" : "", bytes() / (1024.0 * 1024.0),
+        100.0 * used / ((double)atlasSize * atlasSize));
+    for (size_t i = 0; i < lightFaceSize.size(); ++i)
+        printf("[SHADOW]   light %zu: 6 x %d^2\n", i, lightFaceSize[i]);
+}
+
+int shadowFaceSizeFor(const glm::vec3& lightPos, float lightRadius,
+    const glm::vec3& cameraPos, float fovY, int screenHeight,
+    int minSize, int maxSize) {
+    float dist = glm::length(lightPos - cameraPos);
+    if (dist <= lightRadius) return maxSize; // camera inside the lit volume
+
+    // fraction of the screen height covered by the light's sphere of influence
+    float coverage = lightRadius / (dist * std::tan(fovY * 0.5f));
+    float wanted = coverage * (float)screenHeight;
+
+    int size = minSize;
+    while (size < maxSize && (float)size < wanted) size *= 2;
+    return size;
+}
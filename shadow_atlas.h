@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// One depth texture holding the six cube faces of every shadowed point
+// light. Faces are power-of-two squares sized per light and packed in
+// Morton order, the atlas size itself comes from a VRAM budget.
+//
+// With a caster mask an R8 color target rides along: the depth shader
+// writes 1 where the nearest caster moves and 0 where it is part of the
+// static room, so lightmapped surfaces can tell the shadows they already
+// have baked from the ones they must still darken. It comes on top of the
+// depth budget, so a lightmap does not cost shadow resolution.
+class ShadowAtlas {
+public:
+    // depthBits is 16 or 24, the atlas is the largest power-of-two square
+    // that fits budgetBytes
+    ShadowAtlas(size_t budgetBytes, int depthBits, bool casterMask = false);
+    ~ShadowAtlas();
+
+    // assign a face size to every light and repack; lights are halved,
+    // largest first, until all faces fit. Returns true if the layout changed.
+    bool pack(std::vector<int> faceSizes);
+
+    int lightCount() const { return (int)lightFaceSize.size(); }
+    int faceSize(int light) const { return lightFaceSize[light]; }
+    // per face: xy = uv offset, zw = uv scale inside the atlas
+    const glm::vec4* faceRects(int light) const { return &rects[light * 6]; }
+
+    // bind the atlas framebuffer and set viewports 0..5 to the light's faces
+    void bindLight(int light);
+    void clear();
+
+    GLuint texture() const { return depthTexture; }
+    GLuint casterMask() const { return maskTexture; } // 0 without a mask
+    // texture unit the lit shader reads the caster mask from
+    static const int MASK_UNIT = 12;
+    int size() const { return atlasSize; }
+    size_t bytes() const;
+    void printUsage() const;
+
+private:
+    GLuint depthTexture = 0, maskTexture = 0, framebuffer = 0;
+    int atlasSize = 0;
+    int depthBits = 16;
+    std::vector<int> lightFaceSize;
+    std::vector<glm::vec4> rects;
+    std::vector<glm::ivec2> origins;
+};
+
+// Face resolution that keeps a shadow texel close to a screen pixel for a
+// light of the given radius seen from cameraPos, rounded to a power of two.
+int shadowFaceSizeFor(const glm::vec3& lightPos, float lightRadius,
+    const glm::vec3& cameraPos, float fovY, int screenHeight,
+    int minSize = 128, int maxSize = 2048);
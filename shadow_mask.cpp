@@ -0,0 +1,126 @@
+#include "shadow_mask.h"
+#include "shadow_atlas.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <cstdio>
+#include <glm/gtc/type_ptr.hpp>
+
+ShadowMask::ShadowMask(int scale) : maskScale(scale < 2 ? 1 : 2) {
+    shader = new ShaderProgram("shadow_mask.vs", nullptr, "shadow_mask.fs");
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+ShadowMask::~ShadowMask() {
+    release();
+    glDeleteVertexArrays(1, &emptyVAO);
+    delete shader;
+}
+
+void ShadowMask::release() {
+    glDeleteFramebuffers(1, &sceneFramebuffer);
+    glDeleteFramebuffers(1, &maskFramebuffer);
+    GLuint textures[4] = { sceneColor, sceneDepth, mask, maskDepth };
+    glDeleteTextures(4, textures);
+    sceneColor = sceneDepth = sceneFramebuffer = mask = maskDepth = maskFramebuffer = 0;
+    // deleted names may still be cached as bound
+    glState.invalidate();
+}
+
+static GLuint createTarget(GLenum internalFormat, GLenum format, GLenum type, int w, int h) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glState.bindTexture(0, GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, type, nullptr);
+    // only ever read with texelFetch
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return tex;
+}
+
+void ShadowMask::resize(int w, int h) {
+    if (w == width && h == height) return;
+    release();
+    width = w;
+    height = h;
+    maskWidth = (w + maskScale - 1) / maskScale;
+    maskHeight = (h + maskScale - 1) / maskScale;
+
+    // scene target; stencil for the pre-pass first-fragment test
+    sceneColor = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h);
+    sceneDepth = createTarget(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, w, h);
+    glGenFramebuffers(1, &sceneFramebuffer);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sceneColor, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, sceneDepth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "Shadow mask scene framebuffer incomplete\n");
+
+    // mask: one channel per shadow slot plus the view depth it was taken at
+    mask = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, maskWidth, maskHeight);
+    maskDepth = createTarget(GL_R32F, GL_RED, GL_FLOAT, maskWidth, maskHeight);
+    glGenFramebuffers(1, &maskFramebuffer);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, maskFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mask, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, maskDepth, 0);
+    static const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, buffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "Shadow mask framebuffer incomplete\n");
+
+    glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+    printf("Shadow mask: %dx%d scene, %dx%d mask\n", w, h, maskWidth, maskHeight);
+}
+
+void ShadowMask::bindScene() {
+    glState.bindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    glState.viewport(0, 0, width, height);
+}
+
+void ShadowMask::build(const glm::mat4& V, const glm::mat4& P, const glm::vec3& cameraPos,
+    const std::vector<glm::vec3>& lightPositions, const ShadowAtlas& atlas, float farPlane, int taps) {
+    glState.bindFramebuffer(GL_FRAMEBUFFER, maskFramebuffer);
+    // no depth or stencil attachment, every mask texel is written
+    glState.viewport(0, 0, maskWidth, maskHeight);
+
+    shader->use();
+    glState.bindTexture(3, GL_TEXTURE_2D, atlas.texture());
+    glState.bindTexture(7, GL_TEXTURE_2D, sceneDepth);
+    shader->setInt("shadowAtlas", 3);
+    shader->setInt("sceneDepth", 7);
+    shader->setInt("maskScale", maskScale);
+    shader->setMat4("invViewProj", glm::inverse(P * V));
+    shader->setMat4("V", V);
+    glUniform2f(shader->u("viewportSize"), (float)width, (float)height);
+    shader->setVec3("cameraPos", cameraPos);
+    shader->setFloat("far_plane", farPlane);
+    shader->setInt("shadowTaps", taps);
+
+    int count = (int)std::min<size_t>(lightPositions.size(), 4);
+    shader->setInt("shadowLightCount", count);
+    if (count > 0) {
+        glUniform3fv(shader->u("shadowLightPos"), count, glm::value_ptr(lightPositions[0]));
+        glUniform4fv(shader->u("shadowRects"), 6 * count, glm::value_ptr(atlas.faceRects(0)[0]));
+    }
+
+    glState.bindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glState.countDraw(1);
+    bindScene();
+}
+
+void ShadowMask::bind(ShaderProgram* lit, int firstUnit) {
+    glState.bindTexture(firstUnit, GL_TEXTURE_2D, mask);
+    glState.bindTexture(firstUnit + 1, GL_TEXTURE_2D, maskDepth);
+    lit->setInt("shadowMask", firstUnit);
+    lit->setInt("shadowMaskDepth", firstUnit + 1);
+    lit->setInt("shadowMaskScale", maskScale);
+}
+
+void ShadowMask::present() {
+    glState.bindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+    glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,40 @@
+#version 330 core
+
+// Screen-space shadow mask: one shadow evaluation per pixel and shadowed
+// light, from the pre-pass depth. The lit pass (f_textures.glsl) reads the
+// result instead of filtering the atlas per fragment.
+
+#include "lighting.glsl"
+
+layout(location = 0) out vec4 outShadow;   // shadow of slot 0..3
+layout(location = 1) out float outDepth;   // view depth, for the upsample
+
+uniform sampler2D  sceneDepth;
+uniform int        maskScale;        // scene pixels per mask texel, 1 or 2
+uniform mat4       invViewProj;
+uniform vec2       viewportSize;     // scene size in pixels
+
+uniform vec3       shadowLightPos[4];
+uniform int        shadowLightCount;
+
+void main() {
+    // the mask texel stands for the bottom left scene pixel of its block
+    // (window space starts at the bottom left)
+    ivec2 pixel = ivec2(gl_FragCoord.xy) * maskScale;
+    float depth = texelFetch(sceneDepth, pixel, 0).r;
+    if(depth >= 1.0) {
+        outShadow = vec4(0.0);
+        outDepth  = 1e30;
+        return;
+    }
+
+    vec4 ndc = vec4((vec2(pixel) + 0.5) / viewportSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = invViewProj * ndc;
+    vec3 fragPos = world.xyz / world.w;
+
+    vec4 shadow = vec4(0.0);
+    for(int i = 0; i < shadowLightCount; ++i)
+        shadow[i] = ShadowCalculation(i, fragPos, shadowLightPos[i]);
+    outShadow = shadow;
+    outDepth  = -(V * vec4(fragPos, 1.0)).z;
+}
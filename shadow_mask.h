@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "shaderprogram.h"
+
+class ShadowAtlas;
+
+// Deferred shadows: the scene is drawn into an offscreen target whose
+// depth, after the pre-pass, is used to evaluate the shadow of every
+// shadowed light once per pixel into a mask at full or half resolution.
+// The lit pass then reads the mask instead of filtering the atlas for
+// each overdrawn fragment.
+class ShadowMask {
+public:
+    // scale: scene pixels per mask texel, 1 (full) or 2 (half resolution)
+    explicit ShadowMask(int scale);
+    ~ShadowMask();
+
+    // (re)allocate the targets for the framebuffer size
+    void resize(int width, int height);
+    // bind the offscreen scene target, the pre-pass and lit pass draw here
+    void bindScene();
+
+    // evaluate the mask from the scene depth; one light position per
+    // atlas slot, at most MAX_SHADOWED_LIGHTS
+    void build(const glm::mat4& V, const glm::mat4& P, const glm::vec3& cameraPos,
+        const std::vector<glm::vec3>& lightPositions, const ShadowAtlas& atlas,
+        float farPlane, int taps);
+
+    // bind mask and mask depth on two units and point the lit shader at them
+    void bind(ShaderProgram* shader, int firstUnit);
+
+    // copy the finished scene to the default framebuffer
+    void present();
+
+    int scale() const { return maskScale; }
+
+private:
+    int maskScale;
+    int width = 0, height = 0, maskWidth = 0, maskHeight = 0;
+    GLuint sceneColor = 0, sceneDepth = 0, sceneFramebuffer = 0;
+    GLuint mask = 0, maskDepth = 0, maskFramebuffer = 0;
+    GLuint emptyVAO = 0;
+    ShaderProgram* shader;
+
+    void release();
+};
@@ -0,0 +1,7 @@
+#version 330 core
+
+// one triangle covering the screen, no vertex buffer
+void main() {
+    vec2 p = vec2((gl_VertexID & 1) * 4.0 - 1.0, (gl_VertexID & 2) * 2.0 - 1.0);
+    gl_Position = vec4(p, 0.0, 1.0);
+}
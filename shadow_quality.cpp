@@ -0,0 +1,83 @@
+#include "shadow_quality.h"
+#include <algorithm>
+#include <cstdio>
+
+// frames ignored right after a tier switch (pipeline and caches settle)
+static const int WARMUP_FRAMES = 10;
+// seconds to wait after a switch before the adaptive mode may switch again
+static const float ADAPT_COOLDOWN = 2.0f;
+
+ShadowQuality::ShadowQuality(int tier, Mode mode)
+    : currentTier(0), currentMode(mode) {
+    setTier(tier);
+}
+
+void ShadowQuality::setTier(int tier) {
+    currentTier = std::max(0, std::min(SHADOW_TIER_COUNT - 1, tier));
+    framesOnTier = 0;
+    cooldown = ADAPT_COOLDOWN;
+}
+
+void ShadowQuality::setMode(Mode mode) {
+    currentMode = mode;
+    if (mode == Sweep) setTier(0);
+}
+
+void ShadowQuality::update(float frameSeconds, float paceSeconds) {
+    if (frameSeconds <= 0.0f) return;
+
+    ++framesOnTier;
+    // a fixed tier has nothing to compare against
+    if (currentMode != Fixed && framesOnTier > WARMUP_FRAMES)
+        samples[currentTier].push_back(frameSeconds);
+
+    if (currentMode == Sweep) {
+        if (framesOnTier >= sweepFrames + WARMUP_FRAMES)
+            setTier((currentTier + 1) % SHADOW_TIER_COUNT);
+        return;
+    }
+    if (currentMode != Adaptive) return;
+    float pace = paceSeconds > 0.0f ? paceSeconds : frameSeconds;
+
+    // exponential moving average over roughly the last 30 frames
+    if (smoothedFrameTime <= 0.0f) smoothedFrameTime = pace;
+    smoothedFrameTime += (pace - smoothedFrameTime) * (1.0f / 30.0f);
+
+    cooldown -= pace;
+    if (cooldown > 0.0f) return;
+
+    // wide hysteresis band so a tier that just fits does not oscillate
+    if (smoothedFrameTime > targetFrameTime * 1.15f && currentTier > 0) {
+        setTier(currentTier - 1);
+        printf("[SHADOW] frame %.2f ms over budget, tier -> %d taps\n",
+            smoothedFrameTime * 1000.0f, taps());
+    }
+    else if (smoothedFrameTime < targetFrameTime * 0.7f && currentTier < SHADOW_TIER_COUNT - 1) {
+        setTier(currentTier + 1);
+        printf("[SHADOW] frame %.2f ms under budget, tier -> %d taps\n",
+            smoothedFrameTime * 1000.0f, taps());
+    }
+}
+
+std::vector<ShadowQuality::TierStats> ShadowQuality::tierStats() const {
+    std::vector<TierStats> stats;
+    for (int t = 0; t < SHADOW_TIER_COUNT; ++t) {
+        if (samples[t].empty()) continue;
+        std::vector<float> s = samples[t];
+        std::sort(s.begin(), s.end());
+        double sum = 0.0;
+        for (float v : s) sum += v;
+        float mean = (float)(sum / s.size());
+        float p50 = s[s.size() / 2];
+        float p95 = s[std::min(s.size() - 1, s.size() * 95 / 100)];
+        stats.push_back({ SHADOW_TIER_TAPS[t], (int)s.size(), mean * 1000.0f, p50 * 1000.0f, p95 * 1000.0f });
+    }
+    return stats;
+}
+
+void ShadowQuality::printReport() const {
+    printf("[SHADOW] per-tier frame times\n");
+    printf("  taps  frames   mean ms    p50 ms    p95 ms\n");
+    for (const TierStats& s : tierStats())
+        printf("  %4d  %6d  %8.3f  %8.3f  %8.3f\n", s.taps, s.frames, s.meanMs, s.p50Ms, s.p95Ms);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+// PCF tap counts per shadow tier, lowest to highest
+const int SHADOW_TIER_COUNT = 4;
+const int SHADOW_TIER_TAPS[SHADOW_TIER_COUNT] = { 1, 4, 8, 20 };
+
+// Picks the shadow filtering tier, either fixed at startup, adaptively from
+// frame time, or cycling through all tiers to measure each one.
+class ShadowQuality {
+public:
+    enum Mode { Fixed, Adaptive, Sweep };
+
+    ShadowQuality(int tier = SHADOW_TIER_COUNT - 1, Mode mode = Fixed);
+
+    int tier() const { return currentTier; }
+    int taps() const { return SHADOW_TIER_TAPS[currentTier]; }
+    Mode mode() const { return currentMode; }
+
+    void setTier(int tier);
+    void setMode(Mode mode);
+    // frame budget the adaptive mode tries to stay under
+    void setTargetFrameTime(float seconds) { targetFrameTime = seconds; }
+    // frames spent on every tier before the sweep moves on
+    void setSweepFrames(int frames) { sweepFrames = frames; }
+
+    // record the last frame's duration and retune the tier if needed;
+    // paceSeconds > 0 is what the adaptive mode decides on instead (the
+    // recorded frame time on --replay, so a replay switches tiers on the
+    // same frames as the session it replays)
+    void update(float frameSeconds, float paceSeconds = 0.0f);
+
+    struct TierStats {
+        int taps;
+        int frames;
+        float meanMs, p50Ms, p95Ms;
+    };
+    // frame times of every tier that has some, lowest tier first; frames
+    // are only recorded in the adaptive and sweep modes
+    std::vector<TierStats> tierStats() const;
+    // the same as a table on stdout
+    void printReport() const;
+
+private:
+    int currentTier;
+    Mode currentMode;
+
+    float targetFrameTime = 1.0f / 60.0f;
+    float smoothedFrameTime = 0.0f;
+    float cooldown = 0.0f;
+    int framesOnTier = 0;
+    int sweepFrames = 300;
+
+    std::vector<float> samples[SHADOW_TIER_COUNT];
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Four float (F4) or int (I4) lanes, SSE2 on x86 and plain arrays elsewhere.
+// Comparisons return masks with all bits of a true lane set; bits() packs
+// the lane signs into the low four bits of an int.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD4_SSE 1
+#include <emmintrin.h>
+#endif
+
+#ifdef SIMD4_SSE
+// SSE2 is part of every x86-64 target, no per-function flags needed
+struct F4 {
+    __m128 v;
+    F4() {}
+    F4(__m128 x) : v(x) {}
+    explicit F4(float f) : v(_mm_set1_ps(f)) {}
+    F4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+    static F4 load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+static inline F4 operator+(F4 a, F4 b) { return _mm_add_ps(a.v, b.v); }
+static inline F4 operator-(F4 a, F4 b) { return _mm_sub_ps(a.v, b.v); }
+static inline F4 operator*(F4 a, F4 b) { return _mm_mul_ps(a.v, b.v); }
+static inline F4 operator/(F4 a, F4 b) { return _mm_div_ps(a.v, b.v); }
+static inline F4 min4(F4 a, F4 b) { return _mm_min_ps(a.v, b.v); }
+static inline F4 max4(F4 a, F4 b) { return _mm_max_ps(a.v, b.v); }
+static inline F4 operator<(F4 a, F4 b) { return _mm_cmplt_ps(a.v, b.v); }
+static inline F4 operator<=(F4 a, F4 b) { return _mm_cmple_ps(a.v, b.v); }
+static inline F4 operator&(F4 a, F4 b) { return _mm_and_ps(a.v, b.v); }
+static inline F4 abs4(F4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+static inline int bits(F4 m) { return _mm_movemask_ps(m.v); }
+static inline F4 select(F4 m, F4 a, F4 b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+
+struct I4 {
+    __m128i v;
+    I4() {}
+    I4(__m128i x) : v(x) {}
+    explicit I4(int i) : v(_mm_set1_epi32(i)) {}
+    I4(int a, int b, int c, int d) : v(_mm_setr_epi32(a, b, c, d)) {}
+    static I4 load(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+    void store(int* p) const { _mm_storeu_si128((__m128i*)p, v); }
+};
+static inline I4 operator+(I4 a, I4 b) { return _mm_add_epi32(a.v, b.v); }
+static inline I4 operator|(I4 a, I4 b) { return _mm_or_si128(a.v, b.v); }
+// lanes >= 0, i.e. sign bit clear
+static inline F4 nonNegative(I4 a) { return _mm_castsi128_ps(_mm_cmpgt_epi32(a.v, _mm_set1_epi32(-1))); }
+static inline I4 select(F4 m, I4 a, I4 b) {
+    __m128i mi = _mm_castps_si128(m.v);
+    return _mm_or_si128(_mm_and_si128(mi, a.v), _mm_andnot_si128(mi, b.v));
+}
+#else
+// masks keep SSE's convention: all bits of a lane set
+struct F4 {
+    float v[4];
+    F4() {}
+    explicit F4(float f) { for (float& x : v) x = f; }
+    F4(float a, float b, float c, float d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+    static F4 load(const float* p) { F4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    void store(float* p) const { memcpy(p, v, sizeof(v)); }
+};
+template <typename Op>
+static inline F4 lanes(F4 a, F4 b, Op op) { F4 r; for (int k = 0; k < 4; ++k) r.v[k] = op(a.v[k], b.v[k]); return r; }
+static inline float maskOf(bool b) { uint32_t u = b ? 0xFFFFFFFFu : 0u; float f; memcpy(&f, &u, 4); return f; }
+static inline uint32_t bitsOf(float f) { uint32_t u; memcpy(&u, &f, 4); return u; }
+static inline F4 operator+(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x + y; }); }
+static inline F4 operator-(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x - y; }); }
+static inline F4 operator*(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x * y; }); }
+static inline F4 operator/(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return x / y; }); }
+static inline F4 min4(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return y < x ? y : x; }); }
+static inline F4 max4(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return y > x ? y : x; }); }
+static inline F4 operator<(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return maskOf(x < y); }); }
+static inline F4 operator<=(F4 a, F4 b) { return lanes(a, b, [](float x, float y) { return maskOf(x <= y); }); }
+static inline F4 operator&(F4 a, F4 b) {
+    return lanes(a, b, [](float x, float y) { uint32_t u = bitsOf(x) & bitsOf(y); float f; memcpy(&f, &u, 4); return f; });
+}
+static inline F4 abs4(F4 a) { F4 r; for (int k = 0; k < 4; ++k) r.v[k] = std::fabs(a.v[k]); return r; }
+static inline int bits(F4 m) { int b = 0; for (int k = 0; k < 4; ++k) b |= (bitsOf(m.v[k]) >> 31) << k; return b; }
+static inline F4 select(F4 m, F4 a, F4 b) {
+    F4 r; for (int k = 0; k < 4; ++k) r.v[k] = bitsOf(m.v[k]) ? a.v[k] : b.v[k]; return r;
+}
+
+struct I4 {
+    int v[4];
+    I4() {}
+    explicit I4(int i) { for (int& x : v) x = i; }
+    I4(int a, int b, int c, int d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+    static I4 load(const int* p) { I4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    void store(int* p) const { memcpy(p, v, sizeof(v)); }
+};
+static inline I4 operator+(I4 a, I4 b) { I4 r; for (int k = 0; k < 4; ++k) r.v[k] = a.v[k] + b.v[k]; return r; }
+static inline I4 operator|(I4 a, I4 b) { I4 r; for (int k = 0; k < 4; ++k) r.v[k] = a.v[k] | b.v[k]; return r; }
+static inline F4 nonNegative(I4 a) { F4 r; for (int k = 0; k < 4; ++k) r.v[k] = maskOf(a.v[k] >= 0); return r; }
+static inline I4 select(F4 m, I4 a, I4 b) {
+    I4 r; for (int k = 0; k < 4; ++k) r.v[k] = bitsOf(m.v[k]) ? a.v[k] : b.v[k]; return r;
+}
+#endif
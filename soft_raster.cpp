@@ -0,0 +1,611 @@
+#include "soft_raster.h"
+#include "simd4.h"
+#include "lodepng.h"
+#include "trace.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+double msSince(Clock::time_point t) { return std::chrono::duration<double, std::milli>(Clock::now() - t).count(); }
+
+// same kernel as f_textures.glsl, every prefix of 4/8/20 points is well spread
+const int MAX_SAMPLES = 20;
+const glm::vec2 poissonDisk[MAX_SAMPLES] = {
+    { -0.855f, -0.519f }, {  0.808f,  0.583f }, {  0.534f, -0.820f }, { -0.546f,  0.819f },
+    { -0.014f, -0.018f }, {  0.974f, -0.202f }, { -0.234f, -0.971f }, { -0.924f,  0.180f },
+    {  0.178f,  0.968f }, {  0.505f,  0.121f }, { -0.309f, -0.448f }, { -0.424f,  0.314f },
+    {  0.108f,  0.468f }, {  0.345f, -0.351f }, { -0.586f, -0.100f }, {  0.102f, -0.702f },
+    {  0.905f,  0.202f }, {  0.820f, -0.560f }, { -0.152f,  0.775f }, { -0.577f, -0.785f }
+};
+
+float interleavedGradientNoise(float x, float y) {
+    float f = 0.06711056f * x + 0.00583715f * y;
+    f -= std::floor(f);
+    f *= 52.9829189f;
+    return f - std::floor(f);
+}
+
+// cube face of a direction, ties broken like cubeFaceUV() in the shader
+int cubeFace(const glm::vec3& d) {
+    glm::vec3 a = glm::abs(d);
+    if (a.x >= a.y && a.x >= a.z) return d.x > 0.0f ? 0 : 1;
+    if (a.y >= a.z) return d.y > 0.0f ? 2 : 3;
+    return d.z > 0.0f ? 4 : 5;
+}
+
+// clip space planes: near, left, right, bottom, top; inside when >= 0
+const int CLIP_PLANES = 5;
+float planeDistance(int plane, const glm::vec4& p) {
+    switch (plane) {
+    case 0: return p.z + p.w;
+    case 1: return p.w + p.x;
+    case 2: return p.w - p.x;
+    case 3: return p.w + p.y;
+    default: return p.w - p.y;
+    }
+}
+int outcode(const glm::vec4& p) {
+    int code = 0;
+    for (int k = 0; k < CLIP_PLANES; ++k)
+        if (planeDistance(k, p) < 0.0f) code |= 1 << k;
+    return code;
+}
+
+struct ClipVertex {
+    glm::vec4 p;
+    glm::vec3 bary;
+};
+const int MAX_CLIP_VERTICES = 3 + CLIP_PLANES;
+
+// Sutherland-Hodgman against the planes in mask, returns the vertex count
+int clipPolygon(ClipVertex* poly, int n, int mask) {
+    ClipVertex out[MAX_CLIP_VERTICES];
+    for (int k = 0; k < CLIP_PLANES && n >= 3; ++k) {
+        if (!(mask & (1 << k))) continue;
+        int m = 0;
+        for (int i = 0; i < n; ++i) {
+            const ClipVertex& a = poly[i];
+            const ClipVertex& b = poly[(i + 1) % n];
+            float da = planeDistance(k, a.p), db = planeDistance(k, b.p);
+            if (da >= 0.0f) out[m++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float t = da / (da - db);
+                out[m++] = { a.p + (b.p - a.p) * t, a.bary + (b.bary - a.bary) * t };
+            }
+        }
+        std::copy(out, out + m, poly);
+        n = m;
+    }
+    return n >= 3 ? n : 0;
+}
+
+// NDC depth, a few float steps at the far end of the range
+const float BACK_FACE_OFFSET = 1e-6f;
+
+int floorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+}
+
+// ------------------------------------------------------------- setup
+
+SoftwareRenderer::SoftwareRenderer(int width, int height, int threads)
+    : width(glm::clamp(width, 1, MAX_SIZE)), height(glm::clamp(height, 1, MAX_SIZE)), pool(threads) {
+    if (width != this->width || height != this->height)
+        fprintf(stderr, "[SOFTRAST] %dx%d is beyond %d pixels, rendering %dx%d\n", width, height, MAX_SIZE,
+            this->width, this->height);
+    scratch.resize(pool.workerCount());
+}
+
+const SoftwareRenderer::Texture* SoftwareRenderer::loadTexture(const std::string& path) {
+    if (path.empty()) return nullptr;
+    auto found = textures.find(path);
+    if (found != textures.end()) return found->second.levels.empty() ? nullptr : &found->second;
+
+    Texture& tex = textures[path];
+    Texture::Level base;
+    unsigned w, h, error;
+    {
+        TRACE_SCOPE("lodepng::decode");
+        error = lodepng::decode(base.rgba, w, h, path);
+    }
+    if (error) {
+        fprintf(stderr, "[SOFTRAST] failed to load texture %s: %s\n", path.c_str(), lodepng_error_text(error));
+        return nullptr;
+    }
+    base.width = (int)w;
+    base.height = (int)h;
+    tex.levels.push_back(std::move(base));
+    // box filtered chain like glGenerateMipmap, odd edges clamp
+    while (tex.levels.back().width > 1 || tex.levels.back().height > 1) {
+        const Texture::Level& src = tex.levels.back();
+        Texture::Level dst;
+        dst.width = std::max(1, src.width / 2);
+        dst.height = std::max(1, src.height / 2);
+        dst.rgba.resize((size_t)dst.width * dst.height * 4);
+        for (int y = 0; y < dst.height; ++y)
+            for (int x = 0; x < dst.width; ++x)
+                for (int c = 0; c < 4; ++c) {
+                    int sum = 0;
+                    for (int k = 0; k < 4; ++k) {
+                        int sx = std::min(2 * x + (k & 1), src.width - 1);
+                        int sy = std::min(2 * y + (k >> 1), src.height - 1);
+                        sum += src.rgba[((size_t)sy * src.width + sx) * 4 + c];
+                    }
+                    dst.rgba[((size_t)y * dst.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+        tex.levels.push_back(std::move(dst));
+    }
+    return &tex;
+}
+
+void SoftwareRenderer::add(const Model* model, const glm::mat4& M, const glm::mat3& normalMatrix) {
+    int instance = (int)instances.size();
+    const std::vector<Vertex>& vertices = model->getVertices();
+    int first = (int)worldPositions.size();
+    instances.push_back({ model, loadTexture(model->getTexturePath()), first });
+
+    // transformed once here, every pass of every frame shares them
+    worldPositions.resize(first + vertices.size());
+    worldNormals.resize(first + vertices.size());
+    texCoords.resize(first + vertices.size());
+    for (int b = 0; b < (int)vertices.size(); b += VERTEX_BLOCK)
+        vertexBlocks.push_back(glm::ivec3(instance, first + b, std::min(VERTEX_BLOCK, (int)vertices.size() - b)));
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        worldPositions[first + v] = glm::vec3(M * glm::vec4(vertices[v].Position, 1.0f));
+        worldNormals[first + v] = glm::normalize(normalMatrix * vertices[v].Normal);
+        texCoords[first + v] = vertices[v].TexCoords;
+    }
+
+    int triangles = (int)model->getIndices().size() / 3;
+    for (int t = 0; t < triangles; t += CHUNK)
+        triangleChunks.push_back(glm::ivec3(instance, t, std::min(CHUNK, triangles - t)));
+}
+
+void SoftwareRenderer::clear() {
+    instances.clear();
+    worldPositions.clear();
+    worldNormals.clear();
+    texCoords.clear();
+    vertexBlocks.clear();
+    triangleChunks.clear();
+}
+
+bool SoftwareRenderer::setupTriangle(const glm::vec4* clip, const glm::vec3* bary, const int* vertex, int instance,
+    int w, int h, Triangle& t) const {
+    int x[3], y[3];
+    double sx[3], sy[3], z[3]; // unsnapped, in pixels
+    for (int k = 0; k < 3; ++k) {
+        float invW = 1.0f / clip[k].w;
+        glm::vec3 ndc = glm::vec3(clip[k]) * invW;
+        sx[k] = (ndc.x * 0.5 + 0.5) * w;
+        sy[k] = (ndc.y * 0.5 + 0.5) * h;
+        x[k] = glm::clamp((int)std::lround(sx[k] * SUBPIXEL), 0, w * SUBPIXEL);
+        y[k] = glm::clamp((int)std::lround(sy[k] * SUBPIXEL), 0, h * SUBPIXEL);
+        z[k] = ndc.z;
+        t.invW[k] = invW;
+        t.bary[k] = bary[k];
+        t.vertex[k] = vertex[k];
+    }
+    long long area = (long long)(x[1] - x[0]) * (y[2] - y[0]) - (long long)(x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0) return false;
+    // both windings are drawn; make every triangle counter-clockwise
+    bool backFacing = area < 0;
+    if (backFacing) {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(sx[1], sx[2]);
+        std::swap(sy[1], sy[2]);
+        std::swap(z[1], z[2]);
+        std::swap(t.invW[1], t.invW[2]);
+        std::swap(t.bary[1], t.bary[2]);
+        std::swap(t.vertex[1], t.vertex[2]);
+        area = -area;
+    }
+
+    // pixels whose centre lies inside the snapped bounds
+    const int half = SUBPIXEL / 2;
+    t.x0 = std::max(0, floorDiv(*std::min_element(x, x + 3) - half + SUBPIXEL - 1, SUBPIXEL));
+    t.y0 = std::max(0, floorDiv(*std::min_element(y, y + 3) - half + SUBPIXEL - 1, SUBPIXEL));
+    t.x1 = std::min(w - 1, floorDiv(*std::max_element(x, x + 3) - half, SUBPIXEL));
+    t.y1 = std::min(h - 1, floorDiv(*std::max_element(y, y + 3) - half, SUBPIXEL));
+    if (t.x0 > t.x1 || t.y0 > t.y1) return false;
+
+    t.invArea = 1.0 / (double)area;
+    for (int i = 0; i < 3; ++i) {
+        int a = (i + 1) % 3, b = (i + 2) % 3;
+        t.A[i] = y[a] - y[b];
+        t.B[i] = x[b] - x[a];
+        t.C[i] = -(t.A[i] * x[a] + t.B[i] * y[a]);
+        // top-left rule: of two triangles sharing an edge exactly one owns
+        // the pixels on it, the other sees the edge reversed
+        bool owns = t.A[i] > 0 || (t.A[i] == 0 && t.B[i] > 0);
+        t.bias[i] = owns ? 0 : -1;
+    }
+
+    // Depth is affine in screen space. The plane goes through the unsnapped
+    // corners, snapping moves grazing surfaces by far more than the depth
+    // precision. Corners are taken in a fixed order so a face modelled twice
+    // with opposite windings gets exactly the same plane.
+    int o[3] = { 0, 1, 2 };
+    std::sort(o, o + 3, [&](int i, int j) { return sx[i] < sx[j] || (sx[i] == sx[j] && sy[i] < sy[j]); });
+    double ax = sx[o[1]] - sx[o[0]], ay = sy[o[1]] - sy[o[0]], bx = sx[o[2]] - sx[o[0]], by = sy[o[2]] - sy[o[0]];
+    double det = ax * by - bx * ay;
+    double zx, zy;
+    if (std::fabs(det) > 1e-9) {
+        zx = ((z[o[1]] - z[o[0]]) * by - (z[o[2]] - z[o[0]]) * ay) / det;
+        zy = ((z[o[2]] - z[o[0]]) * ax - (z[o[1]] - z[o[0]]) * bx) / det;
+    }
+    else {
+        // corners collapsed before snapping: z = sum of z_i * edge_i / area
+        zx = zy = 0.0;
+        for (int i = 0; i < 3; ++i) {
+            zx += z[i] * t.A[i] * SUBPIXEL * t.invArea;
+            zy += z[i] * t.B[i] * SUBPIXEL * t.invArea;
+        }
+    }
+    t.z0 = (float)(z[o[0]] + zx * (0.5 - sx[o[0]]) + zy * (0.5 - sy[o[0]]));
+    // the assets carry inner shells on the same plane as the outside: a
+    // polygon offset on back faces settles the tie for the outside
+    if (backFacing) t.z0 += BACK_FACE_OFFSET;
+    t.zx = (float)zx;
+    t.zy = (float)zy;
+    t.instance = instance;
+    return true;
+}
+
+void SoftwareRenderer::setupChunk(int chunk, int w, int h, int tilesX, int tilesY) {
+    std::vector<Triangle>& out = chunkTriangles[chunk];
+    std::vector<std::vector<int>>& bins = chunkBins[chunk];
+    out.clear();
+    bins.resize(tilesX * tilesY);
+    for (auto& b : bins) b.clear();
+
+    const glm::ivec3& range = triangleChunks[chunk];
+    const Instance& inst = instances[range.x];
+    const std::vector<unsigned int>& indices = inst.model->getIndices();
+    const glm::vec3 corner[3] = { glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) };
+
+    auto emit = [&](const glm::vec4* clip, const glm::vec3* bary, const int* vertex) {
+        Triangle t;
+        if (!setupTriangle(clip, bary, vertex, range.x, w, h, t)) return;
+        int id = (int)out.size();
+        out.push_back(t);
+        for (int ty = t.y0 / TILE; ty <= t.y1 / TILE; ++ty)
+            for (int tx = t.x0 / TILE; tx <= t.x1 / TILE; ++tx)
+                bins[ty * tilesX + tx].push_back(id);
+    };
+
+    for (int tri = range.y; tri < range.y + range.z; ++tri) {
+        int vertex[3];
+        glm::vec4 clip[3];
+        for (int k = 0; k < 3; ++k) {
+            vertex[k] = inst.firstVertex + (int)indices[tri * 3 + k];
+            clip[k] = clipPositions[vertex[k]];
+        }
+        int c0 = outcode(clip[0]), c1 = outcode(clip[1]), c2 = outcode(clip[2]);
+        if (c0 & c1 & c2) continue; // all corners outside one plane
+        if (!(c0 | c1 | c2)) {
+            emit(clip, corner, vertex);
+            continue;
+        }
+        ClipVertex poly[MAX_CLIP_VERTICES];
+        for (int k = 0; k < 3; ++k) poly[k] = { clip[k], corner[k] };
+        int n = clipPolygon(poly, 3, c0 | c1 | c2);
+        for (int k = 1; k + 1 < n; ++k) {
+            glm::vec4 fanClip[3] = { poly[0].p, poly[k].p, poly[k + 1].p };
+            glm::vec3 fanBary[3] = { poly[0].bary, poly[k].bary, poly[k + 1].bary };
+            emit(fanClip, fanBary, vertex);
+        }
+    }
+}
+
+// ------------------------------------------------------------- raster
+
+void SoftwareRenderer::rasterizeTriangle(const Triangle& t, int id, int tileX, int tileY, Tile& tile) {
+    int x0 = std::max(t.x0, tileX), x1 = std::min(t.x1, tileX + TILE - 1);
+    int y0 = std::max(t.y0, tileY), y1 = std::min(t.y1, tileY + TILE - 1);
+    if (x0 > x1 || y0 > y1) return;
+    x0 = tileX + ((x0 - tileX) & ~3); // whole groups of four, tiles are aligned to them
+
+    const int half = SUBPIXEL / 2;
+    I4 step[3], rowStep[3];
+    for (int i = 0; i < 3; ++i) {
+        int a = t.A[i] * SUBPIXEL;
+        step[i] = I4(4 * a);
+        rowStep[i] = I4(0, a, 2 * a, 3 * a);
+    }
+    // depth straight from the plane at every group, stepping it would let the
+    // rounding drift apart on coplanar triangles and flip whole spans
+    const F4 zx(t.zx), lanes(0.0f, 1.0f, 2.0f, 3.0f);
+    const I4 id4(id);
+
+    for (int y = y0; y <= y1; ++y) {
+        int py = y * SUBPIXEL + half, px = x0 * SUBPIXEL + half;
+        I4 e0 = I4(t.A[0] * px + t.B[0] * py + t.C[0] + t.bias[0]) + rowStep[0];
+        I4 e1 = I4(t.A[1] * px + t.B[1] * py + t.C[1] + t.bias[1]) + rowStep[1];
+        I4 e2 = I4(t.A[2] * px + t.B[2] * py + t.C[2] + t.bias[2]) + rowStep[2];
+        F4 zRow(t.z0 + t.zy * y);
+        float* depth = tile.depth + (y - tileY) * TILE + (x0 - tileX);
+        int* ids = tile.id + (y - tileY) * TILE + (x0 - tileX);
+        for (int x = x0; x <= x1; x += 4, depth += 4, ids += 4) {
+            F4 inside = nonNegative(e0 | e1 | e2);
+            if (bits(inside)) {
+                F4 z = zRow + zx * (F4((float)x) + lanes);
+                F4 old = F4::load(depth);
+                F4 pass = inside & (z < old);
+                if (bits(pass)) {
+                    select(pass, z, old).store(depth);
+                    select(pass, id4, I4::load(ids)).store(ids);
+                }
+            }
+            e0 = e0 + step[0];
+            e1 = e1 + step[1];
+            e2 = e2 + step[2];
+        }
+    }
+}
+
+void SoftwareRenderer::rasterize(const glm::mat4& viewProj, int w, int h, const Resolve& resolve) {
+    TRACE_SCOPE("SoftwareRenderer::rasterize");
+    clipPositions.resize(worldPositions.size());
+    pool.run((int)vertexBlocks.size(), [&](int b, int) {
+        const glm::ivec3& block = vertexBlocks[b];
+        for (int v = block.y; v < block.y + block.z; ++v)
+            clipPositions[v] = viewProj * glm::vec4(worldPositions[v], 1.0f);
+    });
+
+    int tilesX = (w + TILE - 1) / TILE, tilesY = (h + TILE - 1) / TILE;
+    chunkTriangles.resize(triangleChunks.size());
+    chunkBins.resize(triangleChunks.size());
+    pool.run((int)triangleChunks.size(), [&](int c, int) { setupChunk(c, w, h, tilesX, tilesY); });
+
+    pool.run(tilesX * tilesY, [&](int t, int worker) {
+        Tile& tile = scratch[worker];
+        std::fill(tile.depth, tile.depth + TILE * TILE, FLT_MAX);
+        std::fill(tile.id, tile.id + TILE * TILE, -1);
+        int tileX = (t % tilesX) * TILE, tileY = (t / tilesX) * TILE;
+        for (size_t c = 0; c < chunkBins.size(); ++c)
+            for (int i : chunkBins[c][t])
+                rasterizeTriangle(chunkTriangles[c][i], (int)c << 16 | i, tileX, tileY, tile);
+        resolve(tile, tileX, tileY, std::min(tileX + TILE, w), std::min(tileY + TILE, h));
+    });
+
+    passes++;
+    setupTriangles = 0;
+    binnedTriangles = 0;
+    for (size_t c = 0; c < chunkTriangles.size(); ++c) {
+        setupTriangles += chunkTriangles[c].size();
+        for (const auto& bin : chunkBins[c]) binnedTriangles += bin.size();
+    }
+}
+
+// ------------------------------------------------------------- shading
+
+glm::vec4 SoftwareRenderer::Texture::sample(const glm::vec2& uv, float lod) const {
+    auto bilinear = [&](const Level& l) {
+        float fx = uv.x * l.width - 0.5f, fy = uv.y * l.height - 0.5f;
+        float bx = std::floor(fx), by = std::floor(fy);
+        fx -= bx;
+        fy -= by;
+        glm::vec4 c(0.0f);
+        for (int k = 0; k < 4; ++k) {
+            // GL_REPEAT
+            int x = ((int)bx + (k & 1)) % l.width, y = ((int)by + (k >> 1)) % l.height;
+            if (x < 0) x += l.width;
+            if (y < 0) y += l.height;
+            const unsigned char* p = &l.rgba[((size_t)y * l.width + x) * 4];
+            float weight = ((k & 1) ? fx : 1.0f - fx) * ((k >> 1) ? fy : 1.0f - fy);
+            c += weight * glm::vec4(p[0], p[1], p[2], p[3]);
+        }
+        return c / 255.0f;
+    };
+    // GL_LINEAR_MIPMAP_LINEAR
+    lod = glm::clamp(lod, 0.0f, (float)(levels.size() - 1));
+    int level = (int)lod;
+    float f = lod - level;
+    glm::vec4 c = bilinear(levels[level]);
+    if (f > 0.0f && level + 1 < (int)levels.size())
+        c = glm::mix(c, bilinear(levels[level + 1]), f);
+    return c;
+}
+
+glm::vec3 SoftwareRenderer::sourceBary(const Triangle& t, double x, double y) const {
+    double px = x * SUBPIXEL, py = y * SUBPIXEL;
+    double q[3], sum = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        q[i] = (t.A[i] * px + t.B[i] * py + t.C[i]) * t.invArea * t.invW[i];
+        sum += q[i];
+    }
+    glm::vec3 b(0.0f);
+    for (int i = 0; i < 3; ++i) b += (float)(q[i] / sum) * t.bary[i];
+    return b;
+}
+
+float SoftwareRenderer::shadowTap(const ShadowMap& map, const glm::vec3& dir, float refDepth, int size) const {
+    int face = cubeFace(dir);
+    glm::vec4 c = map.faces[face] * glm::vec4(map.light + dir, 1.0f);
+    glm::vec2 uv = glm::vec2(c) / c.w * 0.5f + 0.5f;
+    // half a texel inside the face, as the shader keeps off its neighbours
+    float halfTexel = 0.5f / size;
+    uv = glm::clamp(uv, glm::vec2(halfTexel), glm::vec2(1.0f - halfTexel));
+    float fx = uv.x * size - 0.5f, fy = uv.y * size - 0.5f;
+    int x = std::min((int)fx, size - 2), y = std::min((int)fy, size - 2);
+    fx -= x;
+    fy -= y;
+    // compare, then filter: the lit fraction of the 2x2 footprint
+    const float* d = &map.depth[face][(size_t)y * size + x];
+    float lit00 = refDepth <= d[0] ? 1.0f : 0.0f, lit10 = refDepth <= d[1] ? 1.0f : 0.0f;
+    float lit01 = refDepth <= d[size] ? 1.0f : 0.0f, lit11 = refDepth <= d[size + 1] ? 1.0f : 0.0f;
+    return (lit00 * (1.0f - fx) + lit10 * fx) * (1.0f - fy) + (lit01 * (1.0f - fx) + lit11 * fx) * fy;
+}
+
+float SoftwareRenderer::shadowAmount(const ShadowMap& map, const glm::vec3& fragPos, const glm::vec3& cameraPos,
+    int x, int y, const Shadows& shadows) const {
+    glm::vec3 fragToLight = fragPos - map.light;
+    float currentDepth = glm::length(fragToLight);
+    float bias = 0.05f;
+    float refDepth = (currentDepth - bias) / shadows.farPlane;
+    int size = shadows.faceSize;
+
+    if (shadows.taps <= 1) return 1.0f - shadowTap(map, fragToLight, refDepth, size);
+
+    float viewDist = glm::length(cameraPos - fragPos);
+    float diskRadius = (1.0f + viewDist / shadows.farPlane) / 25.0f * 1.5f;
+
+    glm::vec3 dir = fragToLight / currentDepth;
+    glm::vec3 up = std::fabs(dir.y) < 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+    glm::vec3 T = glm::normalize(glm::cross(up, dir));
+    glm::vec3 B = glm::cross(dir, T);
+    float ang = 6.2831853f * interleavedGradientNoise(x + 0.5f, y + 0.5f);
+    T = (T * std::cos(ang) + B * std::sin(ang)) * diskRadius;
+    B = glm::cross(dir, T);
+
+    float lit = 0.0f;
+    for (int i = 0; i < 4; ++i)
+        lit += shadowTap(map, fragToLight + T * poissonDisk[i].x + B * poissonDisk[i].y, refDepth, size);
+    if (shadows.taps <= 4 || lit < 0.001f || lit > 3.999f) return 1.0f - lit * 0.25f;
+
+    int taps = std::min(shadows.taps, MAX_SAMPLES);
+    for (int i = 4; i < taps; ++i)
+        lit += shadowTap(map, fragToLight + T * poissonDisk[i].x + B * poissonDisk[i].y, refDepth, size);
+    return 1.0f - lit / taps;
+}
+
+glm::vec3 SoftwareRenderer::shade(const Triangle& t, int x, int y, const glm::vec3& cameraPos,
+    const std::vector<PointLight>& lights, const std::vector<int>& slots, const Shadows& shadows) const {
+    const Instance& inst = instances[t.instance];
+    auto at = [&](const std::vector<glm::vec2>& a, const glm::vec3& b) {
+        return a[t.vertex[0]] * b.x + a[t.vertex[1]] * b.y + a[t.vertex[2]] * b.z;
+    };
+    glm::vec3 b = sourceBary(t, x + 0.5, y + 0.5);
+    glm::vec2 uv = at(texCoords, b);
+
+    glm::vec4 texColor(0.0f, 0.0f, 0.0f, 1.0f);
+    if (inst.texture) {
+        // level of detail from the uv step to the neighbouring pixels
+        const Texture::Level& base = inst.texture->levels[0];
+        glm::vec2 size((float)base.width, (float)base.height);
+        glm::vec2 dx = (at(texCoords, sourceBary(t, x + 1.5, y + 0.5)) - uv) * size;
+        glm::vec2 dy = (at(texCoords, sourceBary(t, x + 0.5, y + 1.5)) - uv) * size;
+        float rho = std::max(glm::dot(dx, dx), glm::dot(dy, dy));
+        texColor = inst.texture->sample(uv, rho > 1.0f ? 0.5f * std::log2(rho) : 0.0f);
+    }
+
+    const glm::vec3& p0 = worldPositions[t.vertex[0]], & p1 = worldPositions[t.vertex[1]], & p2 = worldPositions[t.vertex[2]];
+    const glm::vec3& n0 = worldNormals[t.vertex[0]], & n1 = worldNormals[t.vertex[1]], & n2 = worldNormals[t.vertex[2]];
+    glm::vec3 fragPos = p0 * b.x + p1 * b.y + p2 * b.z;
+    glm::vec3 norm = n0 * b.x + n1 * b.y + n2 * b.z;
+    float len = glm::length(norm);
+    norm = len > 0.0f ? norm / len : norm;
+    glm::vec3 viewDir = glm::normalize(cameraPos - fragPos);
+
+    const float shininess = 64.0f, ambientStrength = 0.15f, specularStrength = 0.3f;
+    glm::vec3 result(0.0f);
+    for (size_t i = 0; i < lights.size(); ++i) {
+        const PointLight& light = lights[i];
+        glm::vec3 toLight = light.position - fragPos;
+        float dist = glm::length(toLight);
+        if (dist >= light.radius) continue; // outside every cluster the light is in
+
+        glm::vec3 L = toLight / dist;
+        float diff = std::max(glm::dot(norm, L), 0.0f);
+        glm::vec3 H = glm::normalize(L + viewDir);
+        float spec = std::pow(std::max(glm::dot(norm, H), 0.0f), shininess);
+
+        float atten = 1.25f / (1.0f + 0.35f * dist + 0.25f * dist * dist);
+        float fade = glm::clamp(1.0f - std::pow(dist / light.radius, 4.0f), 0.0f, 1.0f);
+        atten *= fade * fade;
+
+        float shadow = slots[i] < 0 ? 0.0f : shadowAmount(shadowMaps[slots[i]], fragPos, cameraPos, x, y, shadows);
+        result += atten * light.color * (ambientStrength + (1.0f - shadow) * (diff + specularStrength * spec));
+    }
+    return result * glm::vec3(texColor);
+}
+
+// ------------------------------------------------------------- frame
+
+void SoftwareRenderer::render(const glm::mat4& V, const glm::mat4& P, const glm::vec3& cameraPos,
+    const std::vector<PointLight>& lights, const Shadows& shadows) {
+    TRACE_SCOPE("SoftwareRenderer::render");
+    Clock::time_point start = Clock::now();
+    passes = 0;
+    sourceTriangles = 0;
+    for (const auto& c : triangleChunks) sourceTriangles += c.z;
+
+    // shadow slot of every light, in shadowCasters() order like the GL path
+    std::vector<int> slots(lights.size(), -1);
+    std::vector<int> casters = shadowCasters(lights);
+    shadowMaps.resize(casters.size());
+    int size = shadows.faceSize;
+    for (size_t s = 0; s < casters.size(); ++s) {
+        slots[casters[s]] = (int)s;
+        ShadowMap& map = shadowMaps[s];
+        const glm::vec3& lp = lights[casters[s]].position;
+        map.light = lp;
+        // the faces of the GL shadow pass (buildPointLightTransforms)
+        glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, shadows.nearPlane, shadows.farPlane);
+        map.faces[0] = proj * glm::lookAt(lp, lp + glm::vec3(1, 0, 0), glm::vec3(0, -1, 0));
+        map.faces[1] = proj * glm::lookAt(lp, lp + glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0));
+        map.faces[2] = proj * glm::lookAt(lp, lp + glm::vec3(0, 1, 0), glm::vec3(0, 0, 1));
+        map.faces[3] = proj * glm::lookAt(lp, lp + glm::vec3(0, -1, 0), glm::vec3(0, 0, -1));
+        map.faces[4] = proj * glm::lookAt(lp, lp + glm::vec3(0, 0, 1), glm::vec3(0, -1, 0));
+        map.faces[5] = proj * glm::lookAt(lp, lp + glm::vec3(0, 0, -1), glm::vec3(0, -1, 0));
+        for (int f = 0; f < 6; ++f) {
+            std::vector<float>& depth = map.depth[f];
+            depth.assign((size_t)size * size, 1.0f);
+            // distance to the light, as depth_shader.fs writes it
+            rasterize(map.faces[f], size, size, [&](const Tile& tile, int x0, int y0, int x1, int y1) {
+                for (int y = y0; y < y1; ++y)
+                    for (int x = x0; x < x1; ++x) {
+                        int id = tile.id[(y - y0) * TILE + (x - x0)];
+                        if (id < 0) continue;
+                        const Triangle& t = triangle(id);
+                        glm::vec3 b = sourceBary(t, x + 0.5, y + 0.5);
+                        glm::vec3 p = worldPositions[t.vertex[0]] * b.x + worldPositions[t.vertex[1]] * b.y
+                            + worldPositions[t.vertex[2]] * b.z;
+                        depth[(size_t)y * size + x] = glm::length(p - lp) / shadows.farPlane;
+                    }
+            });
+        }
+    }
+    shadowMs = msSince(start);
+
+    color.assign((size_t)width * height * 3, 0);
+    rasterize(P * V, width, height, [&](const Tile& tile, int x0, int y0, int x1, int y1) {
+        for (int y = y0; y < y1; ++y)
+            for (int x = x0; x < x1; ++x) {
+                int id = tile.id[(y - y0) * TILE + (x - x0)];
+                if (id < 0) continue; // clear color
+                glm::vec3 c = glm::clamp(shade(triangle(id), x, y, cameraPos, lights, slots, shadows), 0.0f, 1.0f);
+                unsigned char* out = &color[((size_t)y * width + x) * 3];
+                for (int k = 0; k < 3; ++k) out[k] = (unsigned char)(c[k] * 255.0f + 0.5f);
+            }
+    });
+    frameMs = msSince(start);
+}
+
+bool SoftwareRenderer::save(const std::string& path) const {
+    std::vector<unsigned char> flipped(color.size());
+    size_t row = (size_t)width * 3;
+    for (int y = 0; y < height; ++y)
+        std::copy(color.begin() + (height - 1 - y) * row, color.begin() + (height - y) * row, flipped.begin() + y * row);
+    unsigned error = lodepng::encode(path, flipped, width, height, LCT_RGB);
+    if (error) {
+        fprintf(stderr, "[SOFTRAST] failed to write %s: %s\n", path.c_str(), lodepng_error_text(error));
+        return false;
+    }
+    printf("[SOFTRAST] wrote %s\n", path.c_str());
+    return true;
+}
+
+void SoftwareRenderer::printStats() const {
+    printf("[SOFTRAST] %dx%d on %d threads: %d passes, %.1f ms total, %.1f ms of it for %zu shadowed lights\n",
+        width, height, pool.workerCount(), passes, frameMs, shadowMs, shadowMaps.size());
+    printf("[SOFTRAST] camera pass: %lld source triangles, %lld after clipping, %lld tile references, "
+        "%lld of %lld jobs stolen\n", sourceTriangles, setupTriangles, binnedTriangles,
+        pool.stolenJobs(), pool.jobsRun());
+}
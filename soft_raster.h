@@ -0,0 +1,136 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "job_pool.h"
+#include "light_clusters.h"
+#include "model.h"
+
+// CPU renderer for machines without a GPU, producing the image of the lit
+// pass from the same models, transforms and lights.
+//
+// Every pass transforms all vertices, clips triangles against the near and
+// side planes and snaps them to 1/8 pixel. Setup runs per chunk of source
+// triangles and bins each triangle into the 64x64 pixel tiles its bounds
+// touch; chunks keep their own bins so a tile sees its triangles in
+// submission order. Tiles are then rasterized independently: integer edge
+// functions with a top-left fill rule are stepped four pixels at a time
+// (simd4.h), the nearest triangle per pixel is kept, and the finished tile
+// is shaded once, so hidden surfaces cost no shading. Vertex blocks, setup
+// chunks and tiles all run as jobs on a work-stealing JobPool.
+//
+// Shading follows f_textures.glsl: Blinn-Phong over all lights with the
+// same attenuation and radius fade, the model texture sampled trilinearly,
+// and cube shadows for the castsShadow lights, rendered with the same
+// rasterizer and filtered with the shader's Poisson disk.
+class SoftwareRenderer {
+public:
+    // width and height up to MAX_SIZE, threads <= 0: all hardware threads
+    SoftwareRenderer(int width, int height, int threads = 0);
+
+    // queue one instance for render(); textures are loaded on first use
+    void add(const Model* model, const glm::mat4& M, const glm::mat3& normalMatrix);
+    void clear();
+
+    struct Shadows {
+        int faceSize;              // texels per cube face side
+        float nearPlane, farPlane; // of the point light projection
+        int taps;                  // PCF taps, as shadowTaps in the shader
+    };
+    void render(const glm::mat4& V, const glm::mat4& P, const glm::vec3& cameraPos,
+        const std::vector<PointLight>& lights, const Shadows& shadows);
+
+    // PNG, top row first
+    bool save(const std::string& path) const;
+    void printStats() const;
+
+    // keeps every snapped coordinate and edge function inside 32 bits
+    static const int MAX_SIZE = 2048;
+
+private:
+    static const int TILE = 64;
+    static const int SUBPIXEL = 8;      // snapping steps per pixel
+    static const int CHUNK = 4096;      // source triangles per setup job
+    static const int VERTEX_BLOCK = 16384;
+
+    struct Texture {
+        struct Level {
+            int width, height;
+            std::vector<unsigned char> rgba;
+        };
+        std::vector<Level> levels; // full size first, down to 1x1
+        glm::vec4 sample(const glm::vec2& uv, float lod) const;
+    };
+    struct Instance {
+        const Model* model;
+        const Texture* texture; // null: untextured, samples black like an empty unit
+        int firstVertex;
+    };
+    // a triangle after clipping and snapping, ready for any tile
+    struct Triangle {
+        int A[3], B[3], C[3]; // edge i (opposite corner i) = A x + B y + C at 1/8 pixel
+        int bias[3];          // fill rule: -1 on edges that do not own their pixels
+        int x0, y0, x1, y1;   // pixel bounds, inclusive
+        float z0, zx, zy;     // NDC depth at pixel centre (x, y): z0 + zx x + zy y
+        float invW[3];
+        glm::vec3 bary[3];    // corners in the source triangle
+        int vertex[3];        // source corners in the transformed vertex arrays
+        int instance;
+        double invArea;
+    };
+    // per worker scratch: nearest triangle of every pixel of one tile
+    struct Tile {
+        float depth[TILE * TILE];
+        int id[TILE * TILE]; // -1: empty, else chunk << 16 | index in chunk
+    };
+    struct ShadowMap {
+        glm::vec3 light;
+        glm::mat4 faces[6];             // +x -x +y -y +z -z, as cube maps
+        std::vector<float> depth[6];    // distance to the light / farPlane
+    };
+    // resolve(tile, x0, y0, x1, y1): a rasterized tile, pixels x0..x1-1, y0..y1-1
+    typedef std::function<void(const Tile&, int, int, int, int)> Resolve;
+
+    int width, height;
+    JobPool pool;
+    std::vector<Instance> instances;
+    std::map<std::string, Texture> textures;
+
+    // all instances' vertices back to back
+    std::vector<glm::vec3> worldPositions, worldNormals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec4> clipPositions;  // of the current pass
+    std::vector<glm::ivec3> vertexBlocks;  // instance, first vertex, count
+    std::vector<glm::ivec3> triangleChunks; // instance, first triangle, count
+
+    std::vector<std::vector<Triangle>> chunkTriangles;
+    std::vector<std::vector<std::vector<int>>> chunkBins; // [chunk][tile]
+    std::vector<Tile> scratch; // per worker
+
+    std::vector<unsigned char> color; // RGB, bottom row first
+    std::vector<ShadowMap> shadowMaps; // per shadow slot
+
+    // last render()
+    int passes = 0;
+    long long sourceTriangles = 0, setupTriangles = 0, binnedTriangles = 0;
+    double shadowMs = 0.0, frameMs = 0.0;
+
+    const Texture* loadTexture(const std::string& path);
+    void rasterize(const glm::mat4& viewProj, int w, int h, const Resolve& resolve);
+    void setupChunk(int chunk, int w, int h, int tilesX, int tilesY);
+    bool setupTriangle(const glm::vec4* clip, const glm::vec3* bary, const int* vertex, int instance,
+        int w, int h, Triangle& t) const;
+    static void rasterizeTriangle(const Triangle& t, int id, int tileX, int tileY, Tile& tile);
+
+    const Triangle& triangle(int id) const { return chunkTriangles[id >> 16][id & 0xFFFF]; }
+    // perspective-correct position in the source triangle at pixel (x, y)
+    glm::vec3 sourceBary(const Triangle& t, double x, double y) const;
+    glm::vec3 shade(const Triangle& t, int x, int y, const glm::vec3& cameraPos,
+        const std::vector<PointLight>& lights, const std::vector<int>& slots, const Shadows& shadows) const;
+    float shadowAmount(const ShadowMap& map, const glm::vec3& fragPos, const glm::vec3& cameraPos,
+        int x, int y, const Shadows& shadows) const;
+    float shadowTap(const ShadowMap& map, const glm::vec3& dir, float refDepth, int size) const;
+};
@@ -0,0 +1,215 @@
+#include "static_batch.h"
+#include "lodepng.h"
+#include "gl_state.h"
+#include "trace.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <map>
+
+int StaticBatch::textureSize = 1024;
+
+StaticBatch::~StaticBatch() {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteVertexArrays(1, &depthVAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &depthVBO);
+    glDeleteBuffers(1, &lightmapVBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteTextures(1, &textureArray);
+}
+
+void StaticBatch::add(const Model* model, const glm::mat4& transform) {
+    entries.push_back({ model, transform });
+}
+
+bool StaticBatch::build(Lightmap* lightmap) {
+    // one texture array layer per distinct diffuse texture
+    std::map<std::string, int> layerOf;
+    std::vector<std::string> layerPaths;
+    std::vector<int> entryLayer;
+    for (const auto& e : entries) {
+        const std::string& path = e.model->getTexturePath();
+        auto it = layerOf.find(path);
+        if (it == layerOf.end()) {
+            it = layerOf.insert({ path, (int)layerPaths.size() }).first;
+            layerPaths.push_back(path);
+        }
+        entryLayer.push_back(it->second);
+    }
+
+    // bake transforms; triangles are bucketed by layer so each material is
+    // one contiguous index range
+    std::vector<Vertex> baked;
+    std::vector<glm::uint16> bakedLayer;
+    std::vector<int> bakedEntry;
+    std::vector<std::vector<unsigned int>> perLayer(layerPaths.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const glm::mat4& M = entries[i].transform;
+        glm::mat3 N = glm::transpose(glm::inverse(glm::mat3(M)));
+        unsigned int base = (unsigned int)baked.size();
+
+        for (const Vertex& v : entries[i].model->getVertices()) {
+            Vertex w = v;
+            w.Position = glm::vec3(M * glm::vec4(v.Position, 1.0f));
+            if (glm::dot(v.Normal, v.Normal) > 0.0f)
+                w.Normal = glm::normalize(N * v.Normal);
+            baked.push_back(w);
+            bakedLayer.push_back((glm::uint16)entryLayer[i]);
+            bakedEntry.push_back((int)i);
+        }
+        for (unsigned int idx : entries[i].model->getIndices())
+            perLayer[entryLayer[i]].push_back(base + idx);
+    }
+
+    std::vector<unsigned int> indices;
+    materials.clear();
+    for (size_t layer = 0; layer < perLayer.size(); ++layer) {
+        materials.push_back({ (int)layer, (unsigned int)indices.size(), (unsigned int)perLayer[layer].size() });
+        indices.insert(indices.end(), perLayer[layer].begin(), perLayer[layer].end());
+    }
+    indexCount = (unsigned int)indices.size();
+
+    // lightmap charts split vertices along their seams
+    bool unwrapped = true;
+    if (lightmap) {
+        std::vector<glm::vec3> positions, normals;
+        for (const Vertex& v : baked) {
+            positions.push_back(v.Position);
+            normals.push_back(v.Normal);
+        }
+        std::vector<int> group;
+        for (size_t t = 0; t < indices.size(); t += 3) group.push_back(bakedEntry[indices[t]]);
+        std::vector<unsigned int> remap;
+        unwrapped = lightmap->unwrap(positions, normals, group, indices, remap);
+        if (unwrapped) {
+            std::vector<Vertex> split;
+            std::vector<glm::uint16> splitLayer;
+            for (unsigned int src : remap) {
+                split.push_back(baked[src]);
+                splitLayer.push_back(bakedLayer[src]);
+            }
+            baked.swap(split);
+            bakedLayer.swap(splitLayer);
+        }
+        else
+            lightmap = nullptr; // indices are untouched, build without it
+    }
+
+    // quantize against the AABB of the whole batch, layer goes into w
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (const auto& v : baked) {
+        lo = glm::min(lo, v.Position);
+        hi = glm::max(hi, v.Position);
+    }
+    posOffset = lo;
+    posScale = glm::max(hi - lo, glm::vec3(1e-6f));
+    glm::vec3 invScale = 1.0f / posScale;
+
+    std::vector<PackedVertex16> packed;
+    std::vector<glm::u16vec4> positions;
+    packed.reserve(baked.size());
+    positions.reserve(baked.size());
+    for (size_t i = 0; i < baked.size(); ++i) {
+        PackedVertex16 p = PackedVertex16::encode(baked[i], posOffset, invScale);
+        p.Position.w = bakedLayer[i];
+        packed.push_back(p);
+        positions.push_back(p.Position);
+    }
+
+    glGenBuffers(1, &EBO);
+    glState.bindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    createVertexStream<BatchVertexLayout>(packed, EBO, VAO, VBO);
+    createVertexStream<Unorm16PositionLayout>(positions, EBO, depthVAO, depthVBO);
+
+    buildTextureArray(layerPaths);
+
+    if (lightmap) {
+        std::vector<glm::u16vec2> coords;
+        for (const glm::vec2& c : lightmap->coords())
+            coords.push_back(glm::u16vec2(glm::round(glm::clamp(c, 0.0f, 1.0f) * 65535.0f)));
+        addVertexStream<LightmapCoordLayout>(coords, VAO, lightmapVBO);
+        std::vector<glm::vec3> albedo;
+        for (size_t t = 0; t < indices.size(); t += 3) albedo.push_back(layerAlbedo[bakedLayer[indices[t]]]);
+        lightmap->setAlbedo(albedo);
+    }
+
+    printf("[BATCH] %zu objects, %zu materials, %u triangles, %.1f MB vertices, texture array %dx%dx%zu\n",
+        entries.size(), materials.size(), indexCount / 3,
+        packed.size() * sizeof(PackedVertex16) / (1024.0 * 1024.0),
+        textureSize, textureSize, layerPaths.size());
+    return unwrapped;
+}
+
+// bilinear resample of an RGBA8 image to size x size
+static std::vector<unsigned char> resample(const std::vector<unsigned char>& src,
+    unsigned w, unsigned h, int size) {
+    std::vector<unsigned char> dst((size_t)size * size * 4);
+    for (int y = 0; y < size; ++y) {
+        float fy = glm::clamp((y + 0.5f) * h / size - 0.5f, 0.0f, (float)h - 1.0f);
+        unsigned y0 = (unsigned)fy, y1 = std::min(y0 + 1, h - 1);
+        float ty = fy - y0;
+        for (int x = 0; x < size; ++x) {
+            float fx = glm::clamp((x + 0.5f) * w / size - 0.5f, 0.0f, (float)w - 1.0f);
+            unsigned x0 = (unsigned)fx, x1 = std::min(x0 + 1, w - 1);
+            float tx = fx - x0;
+            for (int c = 0; c < 4; ++c) {
+                float a = src[(y0 * w + x0) * 4 + c] * (1 - tx) + src[(y0 * w + x1) * 4 + c] * tx;
+                float b = src[(y1 * w + x0) * 4 + c] * (1 - tx) + src[(y1 * w + x1) * 4 + c] * tx;
+                dst[((size_t)y * size + x) * 4 + c] = (unsigned char)(a * (1 - ty) + b * ty + 0.5f);
+            }
+        }
+    }
+    return dst;
+}
+
+void StaticBatch::buildTextureArray(const std::vector<std::string>& paths) {
+    glGenTextures(1, &textureArray);
+    glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, textureArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, textureSize, textureSize, (GLsizei)paths.size(),
+        0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    for (size_t layer = 0; layer < paths.size(); ++layer) {
+        std::vector<unsigned char> image, texels;
+        unsigned width, height;
+        bool loaded;
+        {
+            TRACE_SCOPE("lodepng::decode");
+            loaded = !paths[layer].empty() && !lodepng::decode(image, width, height, paths[layer]);
+        }
+        if (!loaded) {
+            // missing texture: plain white, same as an untextured model
+            texels.assign((size_t)textureSize * textureSize * 4, 255);
+        }
+        else {
+            texels = resample(image, width, height, textureSize);
+        }
+        glm::dvec3 sum(0.0);
+        for (size_t i = 0; i < texels.size(); i += 4) sum += glm::dvec3(texels[i], texels[i + 1], texels[i + 2]);
+        layerAlbedo.push_back(glm::vec3(sum / (texels.size() / 4 * 255.0)));
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)layer, textureSize, textureSize, 1,
+            GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+DrawItem StaticBatch::drawItem(ShaderProgram* shader, bool depthOnly) const {
+    DrawItem item;
+    item.shader = shader;
+    item.vao = depthOnly ? depthVAO : VAO;
+    if (!depthOnly) {
+        item.textureTarget = GL_TEXTURE_2D_ARRAY;
+        item.texture = textureArray;
+    }
+    item.indexCount = (GLsizei)indexCount;
+    item.posOffset = posOffset;
+    item.posScale = posScale;
+    return item;
+}
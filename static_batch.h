@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "model.h"
+#include "shaderprogram.h"
+#include "lightmap.h"
+
+// Load-time merge of static models: every mesh is pre-transformed into
+// world space and packed into one vertex/index buffer sorted by material,
+// with all diffuse textures resampled into one texture array. The whole
+// batch then renders with a single draw per pass.
+class StaticBatch {
+public:
+    ~StaticBatch();
+
+    void add(const Model* model, const glm::mat4& transform);
+    // bake transforms, upload buffers and build the texture array; with a
+    // lightmap the batch is unwrapped into it and gets lightmap coordinates.
+    // False when the unwrap failed: the batch is built without them
+    bool build(Lightmap* lightmap = nullptr);
+
+    // the whole batch as one render queue entry
+    DrawItem drawItem(ShaderProgram* shader, bool depthOnly) const;
+
+    // edge length every layer of the texture array is resampled to
+    static int textureSize;
+
+private:
+    struct Entry {
+        const Model* model;
+        glm::mat4 transform;
+    };
+    struct MaterialRange {
+        int layer;
+        unsigned int firstIndex, indexCount;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<MaterialRange> materials;
+    unsigned int indexCount = 0;
+    glm::vec3 posOffset = glm::vec3(0.0f), posScale = glm::vec3(1.0f);
+
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    GLuint depthVAO = 0, depthVBO = 0;
+    GLuint lightmapVBO = 0;
+    GLuint textureArray = 0;
+    std::vector<glm::vec3> layerAlbedo; // mean color of every layer
+
+    void buildTextureArray(const std::vector<std::string>& paths);
+};
@@ -0,0 +1,80 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::recording{ false };
+
+thread_local Trace::Ring* Trace::currentRing = nullptr;
+
+namespace {
+    std::mutex ringsLock; // registration and export only
+    std::vector<std::unique_ptr<Trace::Ring>> rings;
+    thread_local const char* pendingName = nullptr; // nameThread() before the ring
+
+    uint64_t startTicks = 0;
+    std::chrono::steady_clock::time_point startTime;
+}
+
+Trace::Ring* Trace::registerThread() {
+    std::lock_guard<std::mutex> l(ringsLock);
+    rings.emplace_back(new Ring());
+    currentRing = rings.back().get();
+    currentRing->id = (int)rings.size();
+    currentRing->threadName = pendingName;
+    return currentRing;
+}
+
+void Trace::start() {
+    startTime = std::chrono::steady_clock::now();
+    startTicks = now();
+    recording.store(true, std::memory_order_relaxed);
+    nameThread("main");
+}
+
+void Trace::nameThread(const char* name) {
+    pendingName = name;
+    if (!currentRing) return;
+    std::lock_guard<std::mutex> l(ringsLock);
+    currentRing->threadName = name;
+}
+
+bool Trace::write(const std::string& path) {
+    // tick rate from the whole run, long enough to make it exact to a few ppm
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+    double ticksPerUs = us > 0.0 ? (double)(now() - startTicks) / us : 1.0;
+
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "[TRACE] cannot write %s\n", path.c_str());
+        return false;
+    }
+    std::lock_guard<std::mutex> l(ringsLock);
+    long long written = 0, dropped = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto& r : rings) {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+            first ? "" : ",\n", r->id, r->threadName ? r->threadName : "thread", r->id);
+        first = false;
+        uint64_t h = r->head.load(std::memory_order_acquire);
+        uint64_t n = std::min<uint64_t>(h, RING_EVENTS);
+        dropped += (long long)(h - n);
+        for (uint64_t i = h - n; i < h; ++i) {
+            const Event& e = r->events[i & (RING_EVENTS - 1)];
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                e.name, r->id, (double)(int64_t)(e.begin - startTicks) / ticksPerUs,
+                (double)(e.end - e.begin) / ticksPerUs);
+            ++written;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    printf("[TRACE] wrote %lld events of %zu threads to %s", written, rings.size(), path.c_str());
+    if (dropped) printf(", %lld older ones overwritten", dropped);
+    printf("\n");
+    return true;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// CPU trace of named scopes, exported in the Chrome trace event format
+// (chrome://tracing, ui.perfetto.dev).
+//
+//   TRACE_SCOPE("name");   times the rest of the block; name must be a literal
+//   TRACE_FUNCTION();      the same, named after the enclosing free function
+//                          (methods name themselves, GCC drops the class)
+//   TRACE_THREAD("name");  labels the calling thread in the export
+//
+// A finished scope is one 24-byte event in a ring owned by its thread, so
+// recording takes no lock and never allocates; timestamps are raw rdtsc
+// ticks, converted to microseconds only when the trace is written. Each
+// ring keeps the latest RING_EVENTS events of its thread. Nothing is
+// recorded until start(), and an idle scope costs one relaxed load. A
+// thread gets its ring (1.5 MB) at its first scope after start(), so
+// without --trace no ring exists at all.
+//
+// A recorded scope reads the ring pointer once and the TSC twice, and
+// writes the event inline. The two rdtsc are nearly all of its cost: on the
+// test VM, where one rdtsc takes 21-24 ns, a scope takes 45-51 ns, so the
+// 50 ns budget is met only when rdtsc is at its fastest there.
+//
+// TRACE_ENABLED 0 compiles every macro to nothing. It defaults to off in
+// release (NDEBUG) builds; /D TRACE_ENABLED=1 traces a release build.
+#ifndef TRACE_ENABLED
+#ifdef NDEBUG
+#define TRACE_ENABLED 0
+#else
+#define TRACE_ENABLED 1
+#endif
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRACE_RDTSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+namespace Trace {
+    const int RING_EVENTS = 1 << 16; // per thread, a power of two
+
+    extern std::atomic<bool> recording;
+
+    // ticks of a monotonic counter: the TSC on x86, nanoseconds elsewhere
+    inline uint64_t now() {
+#ifdef TRACE_RDTSC
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    inline bool active() { return recording.load(std::memory_order_relaxed); }
+
+    struct Event {
+        const char* name;
+        uint64_t begin, end;
+    };
+    // written by its thread only; head is published after the event so a
+    // reader never sees a half-written slot it has not been told about
+    struct Ring {
+        Event events[RING_EVENTS];
+        std::atomic<uint64_t> head{ 0 };
+        const char* threadName = nullptr;
+        int id = 0;
+    };
+
+    extern thread_local Ring* currentRing;
+    Ring* registerThread();
+    // the calling thread's ring, registered at its first use; recording only
+    inline Ring* threadRing() { return currentRing ? currentRing : registerThread(); }
+
+    inline void record(Ring& r, const char* name, uint64_t begin, uint64_t end) {
+        uint64_t h = r.head.load(std::memory_order_relaxed);
+        r.events[h & (RING_EVENTS - 1)] = { name, begin, end };
+        r.head.store(h + 1, std::memory_order_release);
+    }
+
+    void start();
+    // labels the calling thread; kept until it records its first event
+    void nameThread(const char* name);
+    // every thread's ring as trace events; call with the traced threads idle
+    bool write(const std::string& path);
+}
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : name(name), ring(Trace::active() ? Trace::threadRing() : nullptr), begin(ring ? Trace::now() : 0) {}
+    ~TraceScope() {
+        if (ring) Trace::record(*ring, name, begin, Trace::now());
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    Trace::Ring* ring; // null: not recording
+    uint64_t begin;
+};
+
+#if TRACE_ENABLED
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__FUNCTION__)
+#define TRACE_THREAD(name) Trace::nameThread(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FUNCTION() ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#endif
@@ -0,0 +1,469 @@
+#include "transform_kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TK_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC / Clang need the instruction set enabled per function; MSVC accepts
+// the intrinsics anywhere, so the project needs no special flags
+#if defined(__GNUC__) || defined(__clang__)
+#define TK_SSE41 __attribute__((target("sse4.1")))
+#define TK_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TK_SSE41
+#define TK_AVX2
+#endif
+
+// ---------------------------------------------------------------- scalar
+
+static void mulMat4Scalar(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const float* A = &a[i][0][0];
+        const float* B = &b[i][0][0];
+        float R[16];
+        for (int c = 0; c < 4; ++c)
+            for (int r = 0; r < 4; ++r)
+                R[c * 4 + r] = A[r] * B[c * 4] + A[4 + r] * B[c * 4 + 1]
+                    + A[8 + r] * B[c * 4 + 2] + A[12 + r] * B[c * 4 + 3];
+        memcpy(&out[i][0][0], R, sizeof(R));
+    }
+}
+
+static void mulMat4SharedScalar(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) mulMat4Scalar(&a, &b[i], &out[i], 1);
+}
+
+// inverse transpose = cofactor matrix / determinant; for column vectors
+// the cofactor columns are the cross products of the other two columns
+static void normalMatricesScalar(const glm::mat4* m, glm::mat3* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        glm::vec3 c0(m[i][0]), c1(m[i][1]), c2(m[i][2]);
+        glm::vec3 x = glm::cross(c1, c2), y = glm::cross(c2, c0), z = glm::cross(c0, c1);
+        float invDet = 1.0f / glm::dot(c0, x);
+        out[i] = glm::mat3(x * invDet, y * invDet, z * invDet);
+    }
+}
+
+// Arvo: transform the center, the extent goes through |M|
+static void transformAABBsScalar(const glm::mat4* m, const glm::vec3* boxMin, const glm::vec3* boxMax,
+    glm::vec3* outMin, glm::vec3* outMax, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        glm::vec3 c = (boxMin[i] + boxMax[i]) * 0.5f, e = (boxMax[i] - boxMin[i]) * 0.5f;
+        const glm::mat4& M = m[i];
+        glm::vec3 wc = glm::vec3(M[3]) + glm::vec3(M[0]) * c.x + glm::vec3(M[1]) * c.y + glm::vec3(M[2]) * c.z;
+        glm::vec3 we = glm::abs(glm::vec3(M[0])) * e.x + glm::abs(glm::vec3(M[1])) * e.y
+            + glm::abs(glm::vec3(M[2])) * e.z;
+        outMin[i] = wc - we;
+        outMax[i] = wc + we;
+    }
+}
+
+static void transformPointsScalar(const glm::mat4& m, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        float px = x[i], py = y[i], pz = z[i];
+        outX[i] = m[0][0] * px + m[1][0] * py + m[2][0] * pz + m[3][0];
+        outY[i] = m[0][1] * px + m[1][1] * py + m[2][1] * pz + m[3][1];
+        outZ[i] = m[0][2] * px + m[1][2] * py + m[2][2] * pz + m[3][2];
+    }
+}
+
+#ifdef TK_X86
+
+// vec3 arrays are 12 B apart, so loads and stores of the last element must
+// not touch a fourth float
+TK_SSE41 static inline __m128 load3(const glm::vec3& v) {
+    __m128 xy = _mm_castpd_ps(_mm_load_sd((const double*)&v.x));
+    return _mm_movelh_ps(xy, _mm_load_ss(&v.z));
+}
+TK_SSE41 static inline void store3(float* p, __m128 v) {
+    _mm_storel_pi((__m64*)p, v);
+    _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+TK_SSE41 static inline __m128 abs4(__m128 v) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+#define TK_YZX _MM_SHUFFLE(3, 0, 2, 1)
+#define TK_ZXY _MM_SHUFFLE(3, 1, 0, 2)
+TK_SSE41 static inline __m128 cross4(__m128 a, __m128 b) {
+    __m128 r = _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, TK_YZX)),
+        _mm_mul_ps(_mm_shuffle_ps(a, a, TK_YZX), b));
+    return _mm_shuffle_ps(r, r, TK_YZX);
+}
+
+// ---------------------------------------------------------------- SSE4.1
+
+TK_SSE41 static inline void mulOneSSE(const __m128 a[4], const float* B, float* out) {
+    for (int c = 0; c < 4; ++c) {
+        __m128 b = _mm_loadu_ps(B + c * 4);
+        __m128 r = _mm_mul_ps(a[0], _mm_shuffle_ps(b, b, 0x00));
+        r = _mm_add_ps(r, _mm_mul_ps(a[1], _mm_shuffle_ps(b, b, 0x55)));
+        r = _mm_add_ps(r, _mm_mul_ps(a[2], _mm_shuffle_ps(b, b, 0xAA)));
+        r = _mm_add_ps(r, _mm_mul_ps(a[3], _mm_shuffle_ps(b, b, 0xFF)));
+        _mm_storeu_ps(out + c * 4, r);
+    }
+}
+
+TK_SSE41 static void mulMat4SSE(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const float* A = &a[i][0][0];
+        __m128 cols[4] = { _mm_loadu_ps(A), _mm_loadu_ps(A + 4), _mm_loadu_ps(A + 8), _mm_loadu_ps(A + 12) };
+        float R[16]; // out may alias a or b
+        mulOneSSE(cols, &b[i][0][0], R);
+        memcpy(&out[i][0][0], R, sizeof(R));
+    }
+}
+
+TK_SSE41 static void mulMat4SharedSSE(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, size_t n) {
+    const float* A = &a[0][0];
+    __m128 cols[4] = { _mm_loadu_ps(A), _mm_loadu_ps(A + 4), _mm_loadu_ps(A + 8), _mm_loadu_ps(A + 12) };
+    for (size_t i = 0; i < n; ++i) {
+        float R[16];
+        mulOneSSE(cols, &b[i][0][0], R);
+        memcpy(&out[i][0][0], R, sizeof(R));
+    }
+}
+
+TK_SSE41 static void normalMatricesSSE(const glm::mat4* m, glm::mat3* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const float* M = &m[i][0][0];
+        __m128 c0 = _mm_loadu_ps(M), c1 = _mm_loadu_ps(M + 4), c2 = _mm_loadu_ps(M + 8);
+        __m128 x = cross4(c1, c2), y = cross4(c2, c0), z = cross4(c0, c1);
+        __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), _mm_dp_ps(c0, x, 0x77));
+        float* o = &out[i][0][0];
+        store3(o, _mm_mul_ps(x, invDet));
+        store3(o + 3, _mm_mul_ps(y, invDet));
+        store3(o + 6, _mm_mul_ps(z, invDet));
+    }
+}
+
+TK_SSE41 static void transformAABBsSSE(const glm::mat4* m, const glm::vec3* boxMin, const glm::vec3* boxMax,
+    glm::vec3* outMin, glm::vec3* outMax, size_t n) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (size_t i = 0; i < n; ++i) {
+        const float* M = &m[i][0][0];
+        __m128 m0 = _mm_loadu_ps(M), m1 = _mm_loadu_ps(M + 4), m2 = _mm_loadu_ps(M + 8), m3 = _mm_loadu_ps(M + 12);
+        __m128 lo = load3(boxMin[i]), hi = load3(boxMax[i]);
+        __m128 c = _mm_mul_ps(_mm_add_ps(lo, hi), half), e = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+
+        __m128 wc = _mm_add_ps(m3, _mm_mul_ps(m0, _mm_shuffle_ps(c, c, 0x00)));
+        wc = _mm_add_ps(wc, _mm_mul_ps(m1, _mm_shuffle_ps(c, c, 0x55)));
+        wc = _mm_add_ps(wc, _mm_mul_ps(m2, _mm_shuffle_ps(c, c, 0xAA)));
+        __m128 we = _mm_mul_ps(abs4(m0), _mm_shuffle_ps(e, e, 0x00));
+        we = _mm_add_ps(we, _mm_mul_ps(abs4(m1), _mm_shuffle_ps(e, e, 0x55)));
+        we = _mm_add_ps(we, _mm_mul_ps(abs4(m2), _mm_shuffle_ps(e, e, 0xAA)));
+
+        store3(&outMin[i].x, _mm_sub_ps(wc, we));
+        store3(&outMax[i].x, _mm_add_ps(wc, we));
+    }
+}
+
+TK_SSE41 static void transformPointsSSE(const glm::mat4& m, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t n) {
+    __m128 M[16];
+    for (int k = 0; k < 16; ++k) M[k] = _mm_set1_ps((&m[0][0])[k]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+        for (int r = 0; r < 3; ++r) {
+            __m128 v = _mm_add_ps(M[12 + r], _mm_mul_ps(M[r], px));
+            v = _mm_add_ps(v, _mm_mul_ps(M[4 + r], py));
+            v = _mm_add_ps(v, _mm_mul_ps(M[8 + r], pz));
+            _mm_storeu_ps((r == 0 ? outX : r == 1 ? outY : outZ) + i, v);
+        }
+    }
+    transformPointsScalar(m, x + i, y + i, z + i, outX + i, outY + i, outZ + i, n - i);
+}
+
+// ---------------------------------------------------------------- AVX2
+
+// two output columns per register: A's column k in both halves times
+// b[c][k] / b[c+1][k] splatted inside each half
+TK_AVX2 static inline void mulOneAVX(const __m256 a[4], const float* B, float* out) {
+    for (int c = 0; c < 4; c += 2) {
+        __m256 b = _mm256_loadu_ps(B + c * 4);
+        __m256 r = _mm256_mul_ps(a[0], _mm256_permute_ps(b, 0x00));
+        r = _mm256_fmadd_ps(a[1], _mm256_permute_ps(b, 0x55), r);
+        r = _mm256_fmadd_ps(a[2], _mm256_permute_ps(b, 0xAA), r);
+        r = _mm256_fmadd_ps(a[3], _mm256_permute_ps(b, 0xFF), r);
+        _mm256_storeu_ps(out + c * 4, r);
+    }
+}
+
+TK_AVX2 static void mulMat4AVX(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const float* A = &a[i][0][0];
+        __m256 cols[4] = { _mm256_broadcast_ps((const __m128*)A), _mm256_broadcast_ps((const __m128*)(A + 4)),
+            _mm256_broadcast_ps((const __m128*)(A + 8)), _mm256_broadcast_ps((const __m128*)(A + 12)) };
+        float R[16];
+        mulOneAVX(cols, &b[i][0][0], R);
+        memcpy(&out[i][0][0], R, sizeof(R));
+    }
+}
+
+TK_AVX2 static void mulMat4SharedAVX(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, size_t n) {
+    const float* A = &a[0][0];
+    __m256 cols[4] = { _mm256_broadcast_ps((const __m128*)A), _mm256_broadcast_ps((const __m128*)(A + 4)),
+        _mm256_broadcast_ps((const __m128*)(A + 8)), _mm256_broadcast_ps((const __m128*)(A + 12)) };
+    for (size_t i = 0; i < n; ++i) {
+        float R[16];
+        mulOneAVX(cols, &b[i][0][0], R);
+        memcpy(&out[i][0][0], R, sizeof(R));
+    }
+}
+
+TK_AVX2 static inline __m256 cross8(__m256 a, __m256 b) {
+    __m256 r = _mm256_fmsub_ps(a, _mm256_permute_ps(b, TK_YZX), _mm256_mul_ps(_mm256_permute_ps(a, TK_YZX), b));
+    return _mm256_permute_ps(r, TK_YZX);
+}
+
+// two matrices per register, one in each 128-bit half
+TK_AVX2 static void normalMatricesAVX(const glm::mat4* m, glm::mat3* out, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const float* M0 = &m[i][0][0];
+        const float* M1 = &m[i + 1][0][0];
+        __m256 c0 = _mm256_loadu2_m128(M1, M0);
+        __m256 c1 = _mm256_loadu2_m128(M1 + 4, M0 + 4);
+        __m256 c2 = _mm256_loadu2_m128(M1 + 8, M0 + 8);
+        __m256 x = cross8(c1, c2), y = cross8(c2, c0), z = cross8(c0, c1);
+        __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_dp_ps(c0, x, 0x77));
+        x = _mm256_mul_ps(x, invDet);
+        y = _mm256_mul_ps(y, invDet);
+        z = _mm256_mul_ps(z, invDet);
+        for (int h = 0; h < 2; ++h) {
+            float* o = &out[i + h][0][0];
+            store3(o, h ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x));
+            store3(o + 3, h ? _mm256_extractf128_ps(y, 1) : _mm256_castps256_ps128(y));
+            store3(o + 6, h ? _mm256_extractf128_ps(z, 1) : _mm256_castps256_ps128(z));
+        }
+    }
+    normalMatricesSSE(m + i, out + i, n - i);
+}
+
+TK_AVX2 static void transformAABBsAVX(const glm::mat4* m, const glm::vec3* boxMin, const glm::vec3* boxMax,
+    glm::vec3* outMin, glm::vec3* outMax, size_t n) {
+    const __m256 half = _mm256_set1_ps(0.5f), sign = _mm256_set1_ps(-0.0f);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const float* M0 = &m[i][0][0];
+        const float* M1 = &m[i + 1][0][0];
+        __m256 m0 = _mm256_loadu2_m128(M1, M0), m1 = _mm256_loadu2_m128(M1 + 4, M0 + 4);
+        __m256 m2 = _mm256_loadu2_m128(M1 + 8, M0 + 8), m3 = _mm256_loadu2_m128(M1 + 12, M0 + 12);
+        __m256 lo = _mm256_set_m128(load3(boxMin[i + 1]), load3(boxMin[i]));
+        __m256 hi = _mm256_set_m128(load3(boxMax[i + 1]), load3(boxMax[i]));
+        __m256 c = _mm256_mul_ps(_mm256_add_ps(lo, hi), half), e = _mm256_mul_ps(_mm256_sub_ps(hi, lo), half);
+
+        __m256 wc = _mm256_fmadd_ps(m0, _mm256_permute_ps(c, 0x00), m3);
+        wc = _mm256_fmadd_ps(m1, _mm256_permute_ps(c, 0x55), wc);
+        wc = _mm256_fmadd_ps(m2, _mm256_permute_ps(c, 0xAA), wc);
+        __m256 we = _mm256_mul_ps(_mm256_andnot_ps(sign, m0), _mm256_permute_ps(e, 0x00));
+        we = _mm256_fmadd_ps(_mm256_andnot_ps(sign, m1), _mm256_permute_ps(e, 0x55), we);
+        we = _mm256_fmadd_ps(_mm256_andnot_ps(sign, m2), _mm256_permute_ps(e, 0xAA), we);
+
+        __m256 rMin = _mm256_sub_ps(wc, we), rMax = _mm256_add_ps(wc, we);
+        store3(&outMin[i].x, _mm256_castps256_ps128(rMin));
+        store3(&outMax[i].x, _mm256_castps256_ps128(rMax));
+        store3(&outMin[i + 1].x, _mm256_extractf128_ps(rMin, 1));
+        store3(&outMax[i + 1].x, _mm256_extractf128_ps(rMax, 1));
+    }
+    transformAABBsSSE(m + i, boxMin + i, boxMax + i, outMin + i, outMax + i, n - i);
+}
+
+TK_AVX2 static void transformPointsAVX(const glm::mat4& m, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t n) {
+    __m256 M[16];
+    for (int k = 0; k < 16; ++k) M[k] = _mm256_set1_ps((&m[0][0])[k]);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        for (int r = 0; r < 3; ++r) {
+            __m256 v = _mm256_fmadd_ps(M[r], px, M[12 + r]);
+            v = _mm256_fmadd_ps(M[4 + r], py, v);
+            v = _mm256_fmadd_ps(M[8 + r], pz, v);
+            _mm256_storeu_ps((r == 0 ? outX : r == 1 ? outY : outZ) + i, v);
+        }
+    }
+    transformPointsSSE(m, x + i, y + i, z + i, outX + i, outY + i, outZ + i, n - i);
+}
+
+#endif // TK_X86
+
+// ---------------------------------------------------------------- dispatch
+
+static const TransformKernels scalarKernels = {
+    SimdLevel::Scalar, mulMat4Scalar, mulMat4SharedScalar, normalMatricesScalar,
+    transformAABBsScalar, transformPointsScalar
+};
+#ifdef TK_X86
+static const TransformKernels sseKernels = {
+    SimdLevel::SSE41, mulMat4SSE, mulMat4SharedSSE, normalMatricesSSE,
+    transformAABBsSSE, transformPointsSSE
+};
+static const TransformKernels avxKernels = {
+    SimdLevel::AVX2, mulMat4AVX, mulMat4SharedAVX, normalMatricesAVX,
+    transformAABBsAVX, transformPointsAVX
+};
+#endif
+
+SimdLevel detectSimdLevel() {
+#if defined(TK_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+    // the OS must save the YMM registers too
+    bool ymm = osxsave && avx && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    if (ymm && avx2 && fma) return SimdLevel::AVX2;
+    if (sse41) return SimdLevel::SSE41;
+#elif defined(TK_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SimdLevel::SSE41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    return level == SimdLevel::AVX2 ? "AVX2" : level == SimdLevel::SSE41 ? "SSE4.1" : "scalar";
+}
+
+static const TransformKernels& kernelsFor(SimdLevel level) {
+#ifdef TK_X86
+    if (level == SimdLevel::AVX2) return avxKernels;
+    if (level == SimdLevel::SSE41) return sseKernels;
+#endif
+    return scalarKernels;
+}
+
+static const TransformKernels* activeKernels = nullptr;
+
+const TransformKernels& transformKernels() {
+    if (!activeKernels) activeKernels = &kernelsFor(detectSimdLevel());
+    return *activeKernels;
+}
+
+void setSimdLevel(SimdLevel level) {
+    activeKernels = &kernelsFor(std::min(level, detectSimdLevel()));
+}
+
+// ---------------------------------------------------------------- benchmark
+
+// best of several runs, in ns per element
+template <typename F>
+static double timeNs(F f, size_t n) {
+    double best = 1e30;
+    for (int run = 0; run < 7; ++run) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int rep = 0; rep < 20; ++rep) f();
+        auto t1 = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / (20.0 * n));
+    }
+    return best;
+}
+
+static float maxDiff(const float* a, const float* b, size_t count) {
+    float d = 0.0f;
+    for (size_t i = 0; i < count; ++i) d = std::max(d, std::fabs(a[i] - b[i]));
+    return d;
+}
+
+void benchmarkTransformKernels() {
+    const size_t N = 4096;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> U(-1.0f, 1.0f);
+
+    // random affine TRS matrices, the kind the scene produces
+    std::vector<glm::mat4> A(N), B(N), out(N), ref(N);
+    std::vector<glm::mat3> nOut(N), nRef(N);
+    std::vector<glm::vec3> lo(N), hi(N), oMin(N), oMax(N), rMin(N), rMax(N);
+    std::vector<float> px(N), py(N), pz(N), ox(N), oy(N), oz(N), rx(N), ry(N), rz(N);
+    auto randomTRS = [&]() {
+        glm::vec3 axis = glm::normalize(glm::vec3(U(rng), U(rng), U(rng)) + glm::vec3(0.01f));
+        glm::mat4 M(1.0f);
+        M[3] = glm::vec4(U(rng) * 5.0f, U(rng) * 5.0f, U(rng) * 5.0f, 1.0f);
+        float a = U(rng) * 3.14159f, c = std::cos(a), s = std::sin(a);
+        glm::mat3 K(0, axis.z, -axis.y, -axis.z, 0, axis.x, axis.y, -axis.x, 0);
+        glm::mat3 R = glm::mat3(1.0f) + s * K + (1.0f - c) * K * K;
+        glm::vec3 sc(1.0f + U(rng) * 0.4f, 1.0f + U(rng) * 0.5f, 0.8f + U(rng) * 0.3f);
+        for (int k = 0; k < 3; ++k) M[k] = glm::vec4(R[k] * sc[k], 0.0f);
+        return M;
+    };
+    for (size_t i = 0; i < N; ++i) {
+        A[i] = randomTRS();
+        B[i] = randomTRS();
+        glm::vec3 a(U(rng), U(rng), U(rng)), b(U(rng), U(rng), U(rng));
+        lo[i] = glm::min(a, b);
+        hi[i] = glm::max(a, b);
+        px[i] = U(rng) * 10.0f; py[i] = U(rng) * 10.0f; pz[i] = U(rng) * 10.0f;
+    }
+
+    // plain glm, one call per element as the code used to do it
+    double gMul = timeNs([&] { for (size_t i = 0; i < N; ++i) ref[i] = A[i] * B[i]; }, N);
+    double gShared = timeNs([&] { for (size_t i = 0; i < N; ++i) out[i] = A[0] * B[i]; }, N);
+    double gNormal = timeNs([&] {
+        for (size_t i = 0; i < N; ++i) nRef[i] = glm::transpose(glm::inverse(glm::mat3(A[i])));
+    }, N);
+    double gAABB = timeNs([&] {
+        for (size_t i = 0; i < N; ++i) {
+            glm::vec3 mn(1e30f), mx(-1e30f);
+            for (int k = 0; k < 8; ++k) {
+                glm::vec3 corner((k & 1) ? hi[i].x : lo[i].x, (k & 2) ? hi[i].y : lo[i].y, (k & 4) ? hi[i].z : lo[i].z);
+                glm::vec3 p = glm::vec3(A[i] * glm::vec4(corner, 1.0f));
+                mn = glm::min(mn, p);
+                mx = glm::max(mx, p);
+            }
+            rMin[i] = mn;
+            rMax[i] = mx;
+        }
+    }, N);
+    double gPoints = timeNs([&] {
+        for (size_t i = 0; i < N; ++i) {
+            glm::vec4 p = A[0] * glm::vec4(px[i], py[i], pz[i], 1.0f);
+            rx[i] = p.x; ry[i] = p.y; rz[i] = p.z;
+        }
+    }, N);
+
+    printf("[KERNELS] %zu elements, ns/element (speedup vs glm, max abs error)\n", N);
+    printf("  %-8s %10s %10s %10s %10s %10s\n", "", "mat4*mat4", "shared*", "normal", "AABB", "points");
+    printf("  %-8s %10.2f %10.2f %10.2f %10.2f %10.2f\n", "glm", gMul, gShared, gNormal, gAABB, gPoints);
+
+    SimdLevel best = detectSimdLevel();
+    for (int l = 0; l <= (int)best; ++l) {
+        const TransformKernels& k = kernelsFor((SimdLevel)l);
+        double tMul = timeNs([&] { k.mulMat4(A.data(), B.data(), out.data(), N); }, N);
+        float eMul = maxDiff(&out[0][0][0], &ref[0][0][0], N * 16);
+        double tShared = timeNs([&] { k.mulMat4Shared(A[0], B.data(), out.data(), N); }, N);
+        double tNormal = timeNs([&] { k.normalMatrices(A.data(), nOut.data(), N); }, N);
+        float eNormal = maxDiff(&nOut[0][0][0], &nRef[0][0][0], N * 9);
+        double tAABB = timeNs([&] { k.transformAABBs(A.data(), lo.data(), hi.data(), oMin.data(), oMax.data(), N); }, N);
+        // Arvo's box is exact for affine matrices, so it matches the corners
+        float eAABB = std::max(maxDiff(&oMin[0].x, &rMin[0].x, N * 3), maxDiff(&oMax[0].x, &rMax[0].x, N * 3));
+        double tPoints = timeNs([&] {
+            k.transformPoints(A[0], px.data(), py.data(), pz.data(), ox.data(), oy.data(), oz.data(), N);
+        }, N);
+        float ePoints = std::max(maxDiff(ox.data(), rx.data(), N),
+            std::max(maxDiff(oy.data(), ry.data(), N), maxDiff(oz.data(), rz.data(), N)));
+
+        printf("  %-8s %10.2f %10.2f %10.2f %10.2f %10.2f\n", simdLevelName((SimdLevel)l),
+            tMul, tShared, tNormal, tAABB, tPoints);
+        printf("  %-8s %9.1fx %9.1fx %9.1fx %9.1fx %9.1fx\n", "", gMul / tMul, gShared / tShared,
+            gNormal / tNormal, gAABB / tAABB, gPoints / tPoints);
+        printf("  %-8s %10.1e %10s %10.1e %10.1e %10.1e\n", "", eMul, "", eNormal, eAABB, ePoints);
+    }
+    printf("  runtime dispatch picks %s\n", simdLevelName(transformKernels().level));
+}
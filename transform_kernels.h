@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Batched transform kernels over glm types. Every kernel has a scalar, an
+// SSE4.1 and an AVX2+FMA version; the best one the CPU supports is picked
+// at runtime on first use.
+enum class SimdLevel { Scalar, SSE41, AVX2 };
+
+struct TransformKernels {
+    SimdLevel level;
+    // out[i] = a[i] * b[i]
+    void (*mulMat4)(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, size_t n);
+    // out[i] = a * b[i]
+    void (*mulMat4Shared)(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, size_t n);
+    // out[i] = inverse transpose of the upper 3x3 of m[i]
+    void (*normalMatrices)(const glm::mat4* m, glm::mat3* out, size_t n);
+    // conservative world AABB of each local box under an affine m[i]
+    void (*transformAABBs)(const glm::mat4* m, const glm::vec3* boxMin, const glm::vec3* boxMax,
+        glm::vec3* outMin, glm::vec3* outMax, size_t n);
+    // points stored as separate x / y / z arrays, transformed by one matrix;
+    // in and out may alias
+    void (*transformPoints)(const glm::mat4& m, const float* x, const float* y, const float* z,
+        float* outX, float* outY, float* outZ, size_t n);
+};
+
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+// kernels for the detected level, or the one forced with setSimdLevel
+const TransformKernels& transformKernels();
+// force a level (clamped to what the CPU supports), for benchmarks
+void setSimdLevel(SimdLevel level);
+
+// time every kernel at every supported level against plain glm loops
+void benchmarkTransformKernels();
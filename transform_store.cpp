@@ -0,0 +1,74 @@
+#include "transform_store.h"
+#include "trace.h"
+#include "transform_kernels.h"
+
+TransformStore::Handle TransformStore::create(const glm::vec3& position, const glm::quat& rotation,
+    const glm::vec3& scale, bool isStatic) {
+    positions.push_back(position);
+    rotations.push_back(rotation);
+    scales.push_back(scale);
+    dirty.push_back(1);
+    worlds.push_back(glm::mat4(1.0f));
+    normals.push_back(glm::mat3(1.0f));
+    localMin.push_back(glm::vec3(0.0f));
+    localMax.push_back(glm::vec3(0.0f));
+    worldMin.push_back(position);
+    worldMax.push_back(position);
+    if (isStatic) statics++;
+    return (Handle)positions.size() - 1;
+}
+
+void TransformStore::set(Handle h, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    positions[h] = position;
+    rotations[h] = rotation;
+    scales[h] = scale;
+    dirty[h] = 1;
+}
+
+void TransformStore::setPosition(Handle h, const glm::vec3& position) {
+    positions[h] = position;
+    dirty[h] = 1;
+}
+
+void TransformStore::setRotation(Handle h, const glm::quat& rotation) {
+    rotations[h] = rotation;
+    dirty[h] = 1;
+}
+
+void TransformStore::setBounds(Handle h, const glm::vec3& lo, const glm::vec3& hi) {
+    localMin[h] = lo;
+    localMax[h] = hi;
+    dirty[h] = 1;
+}
+
+int TransformStore::update() {
+    TRACE_SCOPE("TransformStore::update");
+    const TransformKernels& k = transformKernels();
+    int n = 0;
+    size_t runStart = 0, count = positions.size();
+    for (size_t i = 0; i <= count; ++i) {
+        if (i < count && dirty[i]) {
+            // world = T * R * S, built column by column
+            glm::mat3 R = glm::mat3_cast(rotations[i]);
+            const glm::vec3& s = scales[i];
+            glm::mat4& W = worlds[i];
+            W[0] = glm::vec4(R[0] * s.x, 0.0f);
+            W[1] = glm::vec4(R[1] * s.y, 0.0f);
+            W[2] = glm::vec4(R[2] * s.z, 0.0f);
+            W[3] = glm::vec4(positions[i], 1.0f);
+            dirty[i] = 0;
+            n++;
+            continue;
+        }
+        // end of a dirty run: its normals and bounds in one call each
+        if (i > runStart) {
+            size_t m = i - runStart;
+            k.normalMatrices(&worlds[runStart], &normals[runStart], m);
+            k.transformAABBs(&worlds[runStart], &localMin[runStart], &localMax[runStart],
+                &worldMin[runStart], &worldMax[runStart], m);
+        }
+        runStart = i + 1;
+    }
+    lastUpdated = n;
+    return n;
+}
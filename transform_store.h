@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Data-oriented store of object transforms. Translation, rotation and scale
+// live in parallel arrays; update() rebuilds the world and normal matrices
+// and the world bounds of dirty entries only, so every pass reads matrices
+// computed once per frame. Static entries are computed on the first update
+// and never again. Normals and bounds go through the batched transform
+// kernels, one call per run of consecutive dirty entries.
+class TransformStore {
+public:
+    typedef int Handle;
+
+    Handle create(const glm::vec3& position, const glm::quat& rotation = glm::quat(1, 0, 0, 0),
+        const glm::vec3& scale = glm::vec3(1.0f), bool isStatic = false);
+
+    // moving a static entry is allowed, it just gets recomputed once
+    void set(Handle h, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+    void setPosition(Handle h, const glm::vec3& position);
+    void setRotation(Handle h, const glm::quat& rotation);
+    // local box whose world AABB the culling reads, empty at the origin until set
+    void setBounds(Handle h, const glm::vec3& lo, const glm::vec3& hi);
+
+    // rebuild matrices of dirty entries, returns how many were rebuilt
+    int update();
+
+    const glm::mat4& world(Handle h) const { return worlds[h]; }
+    // inverse transpose of the upper 3x3 of world()
+    const glm::mat3& normal(Handle h) const { return normals[h]; }
+    const glm::vec3& position(Handle h) const { return positions[h]; }
+    // conservative world AABB of the local box
+    const glm::vec3& boundsMin(Handle h) const { return worldMin[h]; }
+    const glm::vec3& boundsMax(Handle h) const { return worldMax[h]; }
+    // world position of the local box center
+    glm::vec3 boundsCenter(Handle h) const { return (worldMin[h] + worldMax[h]) * 0.5f; }
+    // largest axis scale, how much world() grows lengths at most
+    float maxScale(Handle h) const {
+        glm::vec3 s = glm::abs(scales[h]);
+        return glm::max(s.x, glm::max(s.y, s.z));
+    }
+
+    int size() const { return (int)positions.size(); }
+    int staticCount() const { return statics; }
+    int lastUpdateCount() const { return lastUpdated; }
+
+private:
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<uint8_t> dirty;
+    std::vector<glm::mat4> worlds;
+    std::vector<glm::mat3> normals;
+    std::vector<glm::vec3> localMin, localMax, worldMin, worldMax;
+    int statics = 0;
+    int lastUpdated = 0;
+};
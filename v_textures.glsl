@@ -3,20 +3,44 @@
 layout(location = 0) in vec3 vertex;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
+layout(location = 3) in float texLayer;   // texture array layer (static batch)
+layout(location = 4) in uint instanceTransform; // GPU-driven draws (gpu_culling.h)
+layout(location = 5) in vec2 lightmapCoord;     // static batch with a lightmap (lightmap.h)
 
 uniform mat4 M;
 uniform mat4 V;
 uniform mat4 P;
 uniform mat3 normalMatrix;
+uniform vec3 posOffset;   // dequantization of packed positions
+uniform vec3 posScale;
+// GPU-driven draws take M and normalMatrix from 7 texels per transform
+uniform bool gpuDriven;
+uniform samplerBuffer instanceTransforms;
 
 out vec3 fragPos;
 out vec3 fragNormal;
 out vec2 fragTexCoord;
+flat out float fragTexLayer;
+out vec2 fragLightmapCoord;
+
+// the depth pre-pass (prepass.vs) has to match this exactly
+invariant gl_Position;
 
 void main() {
-    vec4 worldPosition = M * vec4(vertex, 1.0);
+    mat4 model = M;
+    mat3 normalModel = normalMatrix;
+    if (gpuDriven) {
+        int t = int(instanceTransform) * 7;
+        model = mat4(texelFetch(instanceTransforms, t), texelFetch(instanceTransforms, t + 1),
+                     texelFetch(instanceTransforms, t + 2), texelFetch(instanceTransforms, t + 3));
+        normalModel = mat3(texelFetch(instanceTransforms, t + 4).xyz, texelFetch(instanceTransforms, t + 5).xyz,
+                           texelFetch(instanceTransforms, t + 6).xyz);
+    }
+    vec4 worldPosition = model * vec4(posOffset + vertex * posScale, 1.0);
     fragPos = vec3(worldPosition);
-    fragNormal = normalize(normalMatrix * normal);
+    fragNormal = normalize(normalModel * normal);
     fragTexCoord = texCoord;
+    fragTexLayer = texLayer;
+    fragLightmapCoord = lightmapCoord;
     gl_Position = P * V * worldPosition;
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include "gl_state.h"
+
+// Full precision vertex as produced by the OBJ loader (32 bytes)
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+// Packed vertex formats. Positions are unsigned-normalized inside the
+// model's AABB and rebuilt in the shaders as posOffset + p * posScale.
+enum class VertexFormat {
+    Float32,  // 32 B: float position, normal, uv
+    Packed16, // 16 B: 16-bit position, 10:10:10:2 normal, half uv
+    Packed12  // 12 B: 10:10:10:2 position, 10:10:10:2 normal, half uv
+};
+
+struct PackedVertex16 {
+    glm::u16vec4 Position; // xyz unorm16, w unused
+    glm::uint32 Normal;    // snorm 10:10:10:2
+    glm::uint32 TexCoords; // 2 x half
+
+    static PackedVertex16 encode(const Vertex& v, const glm::vec3& offset, const glm::vec3& invScale) {
+        PackedVertex16 p;
+        glm::vec3 q = glm::clamp((v.Position - offset) * invScale, 0.0f, 1.0f);
+        p.Position = glm::u16vec4(glm::round(q * 65535.0f), 0);
+        p.Normal = glm::packSnorm3x10_1x2(glm::vec4(v.Normal, 0.0f));
+        p.TexCoords = glm::packHalf2x16(v.TexCoords);
+        return p;
+    }
+    Vertex decode(const glm::vec3& offset, const glm::vec3& scale) const {
+        Vertex v;
+        v.Position = offset + glm::vec3(Position) / 65535.0f * scale;
+        v.Normal = glm::vec3(glm::unpackSnorm3x10_1x2(Normal));
+        v.TexCoords = glm::unpackHalf2x16(TexCoords);
+        return v;
+    }
+};
+
+struct PackedVertex12 {
+    glm::uint32 Position;  // unorm 10:10:10:2
+    glm::uint32 Normal;    // snorm 10:10:10:2
+    glm::uint32 TexCoords; // 2 x half
+
+    static PackedVertex12 encode(const Vertex& v, const glm::vec3& offset, const glm::vec3& invScale) {
+        PackedVertex12 p;
+        glm::vec3 q = glm::clamp((v.Position - offset) * invScale, 0.0f, 1.0f);
+        p.Position = glm::packUnorm3x10_1x2(glm::vec4(q, 0.0f));
+        p.Normal = glm::packSnorm3x10_1x2(glm::vec4(v.Normal, 0.0f));
+        p.TexCoords = glm::packHalf2x16(v.TexCoords);
+        return p;
+    }
+    Vertex decode(const glm::vec3& offset, const glm::vec3& scale) const {
+        Vertex v;
+        v.Position = offset + glm::vec3(glm::unpackUnorm3x10_1x2(Position)) * scale;
+        v.Normal = glm::vec3(glm::unpackSnorm3x10_1x2(Normal));
+        v.TexCoords = glm::unpackHalf2x16(TexCoords);
+        return v;
+    }
+};
+
+static_assert(sizeof(Vertex) == 32, "Vertex must stay tightly packed");
+static_assert(sizeof(PackedVertex16) == 16, "PackedVertex16 must be 16 bytes");
+static_assert(sizeof(PackedVertex12) == 12, "PackedVertex12 must be 12 bytes");
+
+// Compile-time description of one attribute inside a vertex struct
+template <GLuint Location, GLint Size, GLenum Type, GLboolean Normalized, std::size_t Offset>
+struct VertexAttrib {
+    static void setup(GLsizei stride) {
+        glEnableVertexAttribArray(Location);
+        glVertexAttribPointer(Location, Size, Type, Normalized, stride, (void*)Offset);
+    }
+};
+
+// A vertex struct plus its attribute list; setup() issues the
+// glVertexAttribPointer calls for the currently bound VAO/VBO
+template <typename VertexT, typename... Attribs>
+struct VertexLayout {
+    typedef VertexT VertexType;
+    static const GLsizei stride = sizeof(VertexT);
+
+    static void setup() {
+        int expand[] = { 0, (Attribs::setup(stride), 0)... };
+        (void)expand;
+    }
+};
+
+typedef VertexLayout<Vertex,
+    VertexAttrib<0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position)>,
+    VertexAttrib<1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal)>,
+    VertexAttrib<2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords)>> FloatVertexLayout;
+
+typedef VertexLayout<PackedVertex16,
+    VertexAttrib<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex16, Position)>,
+    VertexAttrib<1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex16, Normal)>,
+    VertexAttrib<2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex16, TexCoords)>> Packed16VertexLayout;
+
+typedef VertexLayout<PackedVertex12,
+    VertexAttrib<0, 4, GL_UNSIGNED_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex12, Position)>,
+    VertexAttrib<1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex12, Normal)>,
+    VertexAttrib<2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex12, TexCoords)>> Packed12VertexLayout;
+
+// Static batches reuse PackedVertex16 and keep the texture array layer in
+// the spare w of the position
+typedef VertexLayout<PackedVertex16,
+    VertexAttrib<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex16, Position)>,
+    VertexAttrib<1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex16, Normal)>,
+    VertexAttrib<2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex16, TexCoords)>,
+    VertexAttrib<3, 1, GL_UNSIGNED_SHORT, GL_FALSE, offsetof(PackedVertex16, Position) + 3 * sizeof(glm::uint16)>> BatchVertexLayout;
+
+// Lightmap coordinates of the static batch (lightmap.h), a second stream
+// in the batch VAO
+typedef VertexLayout<glm::u16vec2,
+    VertexAttrib<5, 2, GL_UNSIGNED_SHORT, GL_TRUE, 0>> LightmapCoordLayout;
+
+// Position-only streams for depth passes
+typedef VertexLayout<glm::vec3,
+    VertexAttrib<0, 3, GL_FLOAT, GL_FALSE, 0>> FloatPositionLayout;
+typedef VertexLayout<glm::u16vec4,
+    VertexAttrib<0, 3, GL_HALF_FLOAT, GL_FALSE, 0>> HalfPositionLayout;
+typedef VertexLayout<glm::u16vec4,
+    VertexAttrib<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0>> Unorm16PositionLayout;
+typedef VertexLayout<glm::uint32,
+    VertexAttrib<0, 4, GL_UNSIGNED_INT_2_10_10_10_REV, GL_TRUE, 0>> Unorm10PositionLayout;
+
+// GPU-driven draws (gpu_culling.h) read the transform of each instance from
+// this attribute: one uint per instance, picked through the baseInstance
+// of the indirect command. Plain draws leave the shaders' gpuDriven off.
+const GLuint INSTANCE_TRANSFORM_LOCATION = 4;
+
+inline void enableInstanceTransforms(GLuint vao, GLuint buffer) {
+    glState.bindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION);
+    glVertexAttribIPointer(INSTANCE_TRANSFORM_LOCATION, 1, GL_UNSIGNED_INT, 0, nullptr);
+    glVertexAttribDivisor(INSTANCE_TRANSFORM_LOCATION, 1);
+    glState.bindVertexArray(0);
+}
+
+// Create a VAO with one interleaved VBO described by Layout; ebo is bound
+// into the VAO so several streams can share the same index buffer
+template <typename Layout>
+void createVertexStream(const std::vector<typename Layout::VertexType>& data, GLuint ebo,
+    GLuint& vao, GLuint& vbo) {
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glState.bindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(typename Layout::VertexType),
+        data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    Layout::setup();
+    glState.bindVertexArray(0);
+}
+
+// Add one more VBO described by Layout to an existing VAO
+template <typename Layout>
+void addVertexStream(const std::vector<typename Layout::VertexType>& data, GLuint vao, GLuint& vbo) {
+    glGenBuffers(1, &vbo);
+    glState.bindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(typename Layout::VertexType),
+        data.data(), GL_STATIC_DRAW);
+    Layout::setup();
+    glState.bindVertexArray(0);
+}